@@ -33,9 +33,31 @@
  * CREATE FUNCTION levenshtein_k_ratio RETURNS REAL SONAME 'similarities.so';
  * CREATE FUNCTION levenshtein_substring_k RETURNS INT SONAME 'similarities.so';
  * CREATE FUNCTION levenshtein_substring_ci_k RETURNS INT SONAME 'similarities.so';
+ * CREATE FUNCTION levenshtein_best RETURNS STRING SONAME 'similarities.so';
+ * CREATE FUNCTION levenshtein_best_json RETURNS STRING SONAME 'similarities.so';
  * CREATE FUNCTION damerau RETURNS INT SONAME 'similarities.so';
+ * CREATE FUNCTION damerau_k RETURNS INT SONAME 'similarities.so';
+ * CREATE FUNCTION damerau_k_ratio RETURNS REAL SONAME 'similarities.so';
+ * CREATE FUNCTION damerau_full RETURNS INT SONAME 'similarities.so';
  * CREATE FUNCTION damerau_substring RETURNS INT SONAME 'similarities.so';
  * CREATE FUNCTION damerau_substring_ci RETURNS INT SONAME 'similarities.so';
+ * CREATE FUNCTION levenshtein_utf8 RETURNS INT SONAME 'similarities.so';
+ * CREATE FUNCTION levenshtein_k_utf8 RETURNS INT SONAME 'similarities.so';
+ * CREATE FUNCTION damerau_utf8 RETURNS INT SONAME 'similarities.so';
+ * CREATE FUNCTION levenshtein_signature RETURNS STRING SONAME 'similarities.so';
+ * CREATE FUNCTION levenshtein_sig_may_match RETURNS INT SONAME 'similarities.so';
+ * CREATE FUNCTION levenshtein_partition_keys RETURNS STRING SONAME 'similarities.so';
+ * CREATE FUNCTION levenshtein_partition_probes RETURNS STRING SONAME 'similarities.so';
+ * CREATE AGGREGATE FUNCTION levenshtein_argmin RETURNS STRING SONAME 'similarities.so';
+ * CREATE AGGREGATE FUNCTION levenshtein_topn RETURNS STRING SONAME 'similarities.so';
+ * CREATE FUNCTION bktree_load RETURNS INT SONAME 'similarities.so';
+ * CREATE FUNCTION bktree_search RETURNS STRING SONAME 'similarities.so';
+ * CREATE FUNCTION symspell_build RETURNS INT SONAME 'similarities.so';
+ * CREATE FUNCTION symspell_lookup RETURNS STRING SONAME 'similarities.so';
+ * CREATE FUNCTION trie_load RETURNS INT SONAME 'similarities.so';
+ * CREATE FUNCTION trie_search RETURNS STRING SONAME 'similarities.so';
+ * CREATE FUNCTION similarities_cpu_features RETURNS STRING SONAME 'similarities.so';
+ * CREATE FUNCTION similarities_prefilter_stats RETURNS STRING SONAME 'similarities.so';
  *
  * -------------------------------------------------------------------------
  *
@@ -62,530 +84,6067 @@
 #define MIN(a,b) (((a)<(b))?(a):(b))
 #define MAX(a,b) (((a)>(b))?(a):(b))
 
-extern char *_strip_w(const char *str, const int str_len);
-extern char *_tolowercase(char *str);
+/* Number of 64 bit words holding one bit-vector column of a pattern of length n */
+#define BP_WORD_BITS 64
+#define BP_WORDS(n) (((n) + BP_WORD_BITS - 1) / BP_WORD_BITS)
+#define BP_ALPHABET 256
+
+//normalization of a constant pattern argument, see _udf_pattern_init
+#define PATTERN_STRIP   1 //_strip_w
+#define PATTERN_LOWER   2 //_tolowercase, after PATTERN_STRIP
+#define PATTERN_COMPILE 4 //bit-parallel masks built once, see _bp_compile
+#define PATTERN_FOLD    8 //folded by the table of the collation, masks matching the whole class, see _bp_peq_fold
+
+//collations of the _ci functions, see _udf_collation_init
+#define COLLATION_ASCII   0 //case of the ASCII letters
+#define COLLATION_LATIN1  1 //case and accents of latin1 bytes
+#define COLLATION_UTF8MB4 2 //case and accents of UTF-8 code points
+
+//compiled values kept across rows, see _bp_cache_lookup
+#define BP_CACHE_SLOTS 4
+
+/* Shorter strings or narrower strips are faster with the scalar strip of _levenshtein_k_core */
+#define LEVENSHTEIN_K_BP_MIN_LEN 256
+#define LEVENSHTEIN_K_BP_MIN_K 8
+//levenshtein_k and damerau_k look up repeated values from this k and strip size, (k + 1) * l cells, on;
+//the scalar strip, which mostly stops after a few rows, is cheaper below
+#define BP_K_CACHE_MIN_K 2
+#define BP_K_CACHE_MIN_CELLS 32
+
+//lower bounds the k-bounded functions try before any recurrence, see _prefilter_k
+#define PREFILTER_LENGTH   0 //rows rejected by the length difference
+#define PREFILTER_BAG      1 //by the bag distance
+#define PREFILTER_QGRAM    2 //by the count filter of the 2-grams
+#define PREFILTER_PASSED   3 //left to the recurrence
+#define PREFILTER_COUNTERS 4
+#define PREFILTER_QGRAM_SLOTS 1024 //2-grams are counted hashed into these slots
+//the bounds only run from this strip size, (k + 1) * l cells, on; the
+//recurrence of narrower strips mostly stops after a few rows, for less
+#define PREFILTER_MIN_CELLS 1024
+
+//binary fingerprint of levenshtein_signature, see _signature_of
+#define SIGNATURE_VERSION 1 //first byte, fingerprints of another layout are never discarded
+#define SIGNATURE_SIZE 32
+#define SIGNATURE_GRAM_WORDS 2 //the 2-grams are hashed into 128 bits
+
+//dictionaries of bktree_load and trie_load and indexes of symspell_build, files of the directory
+//in the environment variable DICT_DIR_ENV of mysqld
+#define DICT_DIR_ENV "SIMILARITIES_DICT_DIR"
+#define DICT_WORD_MAX 65535 //longer lines are skipped
+#define DICT_NAME_MAX 64
+#define DICT_BKTREE 0 //kinds of the loaded dictionaries, each with its own names
+#define DICT_TRIE 1
+
+//indexes of symspell_build, see _symspell_build
+#define SYMSPELL_MAGIC "SYMSPEL1"
+#define SYMSPELL_ORDER 0x01020304 //as written, indexes of another byte order are refused
+#define SYMSPELL_PREFIX 7 //the variants are deletions of the first bytes of the words only
+#define SYMSPELL_K_MAX 3
 
 /**
- * @param s string
- * @result strip duplicate spaces, CR or CRLF
+ * Scratch of the bit-parallel levenshtein engine.
+ *
+ * peq holds the match masks of the pattern, BP_ALPHABET x words, laid out
+ * character major (peq[c * words + block]). It is kept all zero between calls:
+ * the cores set the masks of the pattern before running a kernel and clear
+ * them afterwards, so no memset of the whole table is needed per row. The only
+ * exception is a scratch compiled for the constant pattern of a statement
+ * (compiled), whose masks stay for all its rows. pv/mv are the vertical delta vectors of the
+ * current column, one word per block, score the value of the last row of each
+ * block (only maintained by the banded kernel), d0/eq the diagonal zero deltas
+ * and match masks of the previous column (only maintained by the OSA kernel).
+ * carry holds one byte per text column for the SIMD kernels.
  */
-inline char *_strip_w(const char *str, const int str_len){
-    char *striped_str = (char *)malloc((str_len+1));
-    enum {START, INGORE, WRITE} condition = START;
-    int i,x;
-    for (i=x=0; i < str_len; i++){
-        if (condition == START && isspace(str[i]))
-            continue;
-        else if ((isspace(str[i]) && isspace(str[i+1]))
-                || (isspace(str[i]) && str[i+1]=='\0')) {
-            condition = INGORE;
-            continue;
-        }
-        else if ((!isspace(str[i]) && isspace(str[i+1]))
-                || (!isspace(str[i]) && !isspace(str[i+1]))
-                || (isspace(str[i]) && !isspace(str[i+1])))
-            condition = WRITE;
+typedef struct {
+  uint64_t *peq;
+  uint64_t *pv;
+  uint64_t *mv;
+  int64_t  *score;
+  uint64_t *d0;
+  uint64_t *eq;
+  size_t   words;
+  unsigned char *carry;
+  size_t   carry_size;
+  const char *compiled; //pattern whose masks are kept in peq, NULL if none
+} BP_SCRATCH;
 
-        if (condition == WRITE)
-            striped_str[x++] = str[i];
-    }
+/**
+ * Compiled argument value, owned by the cache slot
+ */
+typedef struct {
+  char       *pattern;
+  int        len;
+  uint64_t   hash; //_bp_cache_hash
+  BP_SCRATCH *bp; //bp->compiled == pattern
+} BP_CACHE_SLOT;
 
-    striped_str[x] = '\0';
-    return striped_str;
-}
+/**
+ * Column states of the one word k-bounded kernels for a compiled pattern,
+ * kept from the previous row: pv, mv (and d0 for the OSA) and the score of the
+ * last row after each column of the text. A row sharing a prefix with the
+ * previous one resumes after it, see _bp_trail_resume.
+ */
+typedef struct {
+  const BP_SCRATCH *owner; //compiled pattern the states belong to, NULL if none
+  unsigned char *text; //the previous row
+  int      len; //columns of it whose state is kept
+  size_t   size; //capacity in columns
+  uint64_t *pv;
+  uint64_t *mv;
+  uint64_t *d0;
+  int64_t  *score;
+} BP_TRAIL;
 
 /**
- * @param s string
- * @result lowercase string
+ * Block of the per row arena, the buffers follow the header
  */
-inline char *_tolowercase(char *str){
-    int i = 0;
-    for(i = 0; str[i]; i++){
-        str[i] = tolower(str[i]);
-    }
-    return str;
-}
+typedef struct ARENA_BLOCK {
+  struct ARENA_BLOCK *prev; //older block of the same row, NULL in steady state
+  size_t size; //capacity in bytes
+  size_t used;
+} ARENA_BLOCK;
 
 /**
- * Levenshtein distance
- *
- * @param s string 1 to compare, length n
- * @param t string 2 to compare, length m
- * @result levenshtein distance between s and t
- *
- * @time O(nm), quadratic
- * @space O(nm)
+ * Walk over a string stripping whitespace, and optionally lowercasing, on
+ * the fly, see _norm_next
  */
-my_bool  levenshtein_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
-void     levenshtein_deinit(UDF_INIT *initid);
-longlong levenshtein(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error);
+typedef struct {
+  const unsigned char *p; //next byte
+  const unsigned char *end;
+  int lower;
+  int started; //a character was returned, whitespace is no longer leading
+} NORM_ITER;
 
+/**
+ * Byte folding of a collation, see _fold_init
+ */
+typedef struct {
+  unsigned char fold[256]; //representative of the class of each byte
+  unsigned char folded[256]; //bytes which are not their own representative
+  int           folded_count;
+} FOLD_TABLE;
 
 /**
- * Levenshtein distance with threshold k (maximum allowed distance)
- *
- * @param s string 1 to compare, length n
- * @param t string 2 to compare, length m
- * @param k maximum threshold
- * @result levenshtein distance between s and t or >k (not specified) if the distance is greater than k
- *
- * @time O(kl), linear; where l = min(n, m)
- * @space O(k), constant
+ * Counts of the lower bounds of _prefilter_k, per byte and per hashed 2-gram:
+ * those of string 1 minus those of string 2. The counts of string 1 alone are
+ * kept when it is the same for the following rows (the constant pattern of a
+ * statement, the first argument of a list), each row starts from a copy.
  */
-my_bool  levenshtein_k_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
-void     levenshtein_k_deinit(UDF_INIT *initid);
-longlong levenshtein_k(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error);
-extern longlong _levenshtein_k_core(const char *s, const int s_len, const char *t, const int t_len, const int k);
+typedef struct {
+  int        bag[BP_ALPHABET];
+  int        qgram[PREFILTER_QGRAM_SLOTS];
+  int        loaded_bag[BP_ALPHABET];
+  int        loaded_qgram[PREFILTER_QGRAM_SLOTS];
+  const char *loaded; //string whose counts are kept, NULL if none
+  int        loaded_len;
+  int        loaded_grams; //loaded_qgram is set, computed by the first row needing it
+  uint64_t   counts[PREFILTER_COUNTERS]; //rows of the statement, added to the totals when it ends
+} PREFILTER;
 
 /**
- * Levenshtein ratio
- *
- * @param s string 1 to compare, length n
- * @param t string 2 to compare, length m
- * @result levenshtein ratio between s and t
- *
- * @time O(nm), quadratic
- * @space O(nm)
+ * Decoded fingerprint of levenshtein_signature: length, bitmap of the byte
+ * classes (byte & 63) and of the hashed 2-grams present in the string
  */
-my_bool levenshtein_ratio_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
-void    levenshtein_ratio_deinit(UDF_INIT *initid);
-double  levenshtein_ratio(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error);
+typedef struct {
+  uint32_t len; //bytes, saturated at UINT32_MAX
+  uint64_t classes;
+  uint64_t grams[SIGNATURE_GRAM_WORDS];
+} SIGNATURE;
 
+/**
+ * Group state of levenshtein_argmin: the closest value so far, copied, since
+ * the arguments of a row do not outlive it
+ */
+typedef struct {
+  char      *value;
+  int       len;
+  size_t    size; //capacity of value
+  int       found; //0 until a value of the group is within k
+  longlong  dist;
+  ulonglong row; //arrival in the group, ties of levenshtein_topn go to the first
+} GROUP_BEST;
 
 /**
- * Levenshtein ratio with threshold k (maximum allowed distance)
- *
- * @param s string 1 to compare, length n
- * @param t string 2 to compare, length m
- * @param k maximum threshold
- * @result levenshtein ratio between s and t if (levenshtein distance <= k), otherwise 0.0
- *
- * @time O(kl), linear: where 1 = min(n, m)
- * @space O(k), constant
+ * Group state of levenshtein_topn: max-heap of the closest values so far, the
+ * one to give up first on top. The entries past count keep their buffers for
+ * the following groups.
  */
-my_bool levenshtein_k_ratio_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
-void    levenshtein_k_ratio_deinit(UDF_INIT *initid);
-double  levenshtein_k_ratio(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error);
+typedef struct {
+  GROUP_BEST *heap;
+  int        count;
+  int        capacity;
+  ulonglong  rows; //of the group
+} GROUP_TOPN;
 
 /**
- * Levenshtein substring distance with threshold k (maximum allowed distance)
- *
- * @param s string 1 to compare, length n
- * @param t string 2 to compare, length m
- * @param k maximum threshold
- * @result levenshtein substring matching distance between s and t or >k (not specified) if the distance is greater than k
- * If the left string is longer than the right string then both strings are swapped
- *
+ * Loaded dictionary, shared read only by all the connections: the head of a
+ * BKTREE or a TRIE
  */
-my_bool levenshtein_substring_k_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
-void    levenshtein_substring_k_deinit(UDF_INIT *initid);
-longlong  levenshtein_substring_k(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error);
+typedef struct DICT {
+  struct DICT *next; //in the registry
+  char        name[DICT_NAME_MAX + 1];
+  int         kind; //DICT_BKTREE, DICT_TRIE
+  int         refs; //one of the registry, one per running search
+} DICT;
 
 /**
- * Levenshtein substring distance with threshold k (maximum allowed distance) case insensitive
- *
- * @param s string 1 to compare, length n
- * @param t string 2 to compare, length m
- * @param k maximum threshold
- * @result levenshtein substring matching distance between s and t or >k (not specified) if the distance is greater than k
- * If the left string is longer than the right string then both strings are swapped
- *
+ * Node of a BK-tree, see _bktree_build
  */
-my_bool levenshtein_substring_ci_k_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
-void    levenshtein_substring_ci_k_deinit(UDF_INIT *initid);
-longlong  levenshtein_substring_ci_k(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error);
+typedef struct {
+  uint32_t word; //offset in the words of the tree
+  uint32_t first_child; //index, the other children follow it
+  uint16_t len;
+  uint16_t children;
+  uint16_t edge; //distance to the parent
+  uint16_t max_edge; //of the last child
+} BKTREE_NODE;
 
 /**
- * Damerau-Levenshtein
- *
- * @param s string 1 to compare, length n
- * @param t string 2 to compare, length m
- * @result damerau levenshtein distance between s and t
- *
+ * BK-tree of a dictionary
  */
-my_bool damerau_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
-void damerau_deinit(UDF_INIT *initid);
-longlong damerau(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error);
-extern longlong _damerau_core(const char *str1,int s_len1, const char * str2, int s_len2,
-                       const int swap_costs, const int substitute_costs, const int insert_costs, const int delete_costs);
+typedef struct {
+  DICT        dict;
+  char        *words; //one after another, in the order of the nodes
+  uint32_t    *line; //per node, offset of its word in the file, to order the results
+  BKTREE_NODE *nodes; //breadth first, the root first
+  uint32_t    count;
+} BKTREE;
 
 /**
- * Damerau-Levenshtein
- *
- * @param s string 1 to compare, length n
- * @param t string 2 to compare, length m
- * @result damerau levenshtein substring matching distance
+ * Trie of a dictionary, see _trie_build. The nodes are in the order of LOUDS,
+ * breadth first with the children of a node by byte, but with the offset of
+ * the first child of each node instead of the bits of their degrees: a child
+ * range is two loads, without the rank and select of a succinct trie.
  */
-my_bool damerau_substring_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
-void    damerau_substring_deinit(UDF_INIT *initid);
-longlong  damerau_substring(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error);
+typedef struct {
+  DICT     dict;
+  uint32_t *first; //per node and one past the last, the children of node i are first[i] up to first[i + 1]
+  uint8_t  *label; //per node, the byte of the edge from its parent
+  uint8_t  *terminal; //bit per node, set where a word ends
+  uint32_t count; //nodes
+  uint32_t words;
+  int      max_len; //of the words, the depth of the trie
+} TRIE;
 
 /**
- * Damerau-Levenshtein case insensitive
- *
- * @param s string 1 to compare, length n
- * @param t string 2 to compare, length m
- * @result damerau levenshtein substring matching distance
+ * Word of a dictionary being sorted, see _trie_build
  */
-my_bool damerau_substring_ci_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
-void    damerau_substring_ci_deinit(UDF_INIT *initid);
-longlong  damerau_substring_ci(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error);
+typedef struct {
+  const char *word;
+  uint32_t   len;
+} DICT_WORD;
 
-//-------------------------------------------------------------------------
+/**
+ * Header of an index of symspell_build, its sections follow, see _symspell_build
+ */
+typedef struct {
+  char     magic[8]; //SYMSPELL_MAGIC, not terminated
+  uint32_t order; //SYMSPELL_ORDER
+  uint32_t k; //deletions indexed
+  uint32_t prefix; //bytes of the words the deletions are made of
+  uint32_t words;
+  uint64_t slots; //of the table, a power of 2
+  uint64_t postings;
+  uint64_t size; //of the file
+} SYMSPELL_HEADER;
 
+/**
+ * Index of symspell_lookup, mapped read only: the pages are those of the page
+ * cache, shared by every connection
+ */
+typedef struct {
+  const char *base; //NULL if none
+  size_t     size;
+  char       *path; //as given
+  int        path_len;
+  const uint32_t *words; //{offset in text, length} per word
+  const uint32_t *table; //slots + 1 offsets in postings
+  const uint32_t *postings; //words per slot, ascending
+  const char *text; //the words, one after another
+  uint64_t   text_size;
+} SYMSPELL_MAP;
 
-my_bool levenshtein_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
-  if ((args->arg_count != 2) ||
-      (args->arg_type[0] != STRING_RESULT || args->arg_type[1] != STRING_RESULT)) {
-    strcpy(message, "Function requires 2 arguments, (string, string)");
-    return 1;
-  }
+/**
+ * Per statement scratch, kept in initid->ptr and reused across rows: the
+ * arena of the per row buffers (rolling rows of the scalar recurrences,
+ * normalized strings, parsed arguments) and the bit-parallel engine (heap
+ * instead of stack, mysqld threads have small stacks). A constant pattern
+ * argument is copied by the init, already normalized, and optionally compiled.
+ */
+typedef struct {
+  ARENA_BLOCK *arena; //see _arena_alloc
+  BP_SCRATCH *bp;
+  char       *pattern; //constant argument, NULL if none
+  int        pattern_len;
+  int        pattern_arg; //its index in args
+  BP_SCRATCH *compiled; //masks of pattern, NULL if not compiled
+  BP_CACHE_SLOT cache[BP_CACHE_SLOTS]; //values repeated across rows
+  int        cache_next; //slot replaced by the next compiled value
+  uint64_t   last_hash[2]; //value of args 0 and 1 in the previous lookup
+  int        last_len[2];
+  BP_TRAIL   trail; //states of the previous row, for the k-bounded functions
+  int        collation; //COLLATION_*, of the _ci functions
+  PREFILTER  *prefilter; //lower bounds of the k-bounded functions, NULL until their first row
+  GROUP_BEST best; //of the group, levenshtein_argmin
+  GROUP_TOPN topn; //of the group, levenshtein_topn
+  DICT       *dict; //searched by bktree_search or trie_search, held until the end of the statement
+  SYMSPELL_MAP symspell; //of symspell_lookup
+} UDF_SCRATCH;
 
-  //matrix for levenshtein calculations of size n+1 x m+1 (+1 for base values)
-  int *d = (int *) malloc(sizeof(int) * (args->lengths[0] + 1) * (args->lengths[1] + 1));
-  if (d == NULL) {
-    strcpy(message, "Failed to allocate memory");
-    return 1;
-  }
+extern char *_strip_w(const char *str, const int str_len);
+extern char *_strip_w_to(char *out, const char *str, const int str_len);
+extern char *_tolowercase(char *str);
+extern void _norm_init(NORM_ITER *it, const char *str, const int str_len, const int lower);
+extern int _norm_next(NORM_ITER *it);
+extern int _normalize_to(char *out, const char *str, const int str_len, const int lower);
+extern BP_SCRATCH *_bp_scratch_alloc(const size_t len);
+extern BP_SCRATCH *_bp_scratch_reserve(BP_SCRATCH *bp, const size_t len);
+extern void _bp_scratch_free(BP_SCRATCH *bp);
+extern const FOLD_TABLE *_fold_table(const int collation);
+extern char *_fold_bytes(char *str, const int len, const FOLD_TABLE *ft);
+extern BP_SCRATCH *_bp_compile(const char *s, const int n, const FOLD_TABLE *ft);
+extern BP_SCRATCH *_bp_scratch_for(UDF_INIT *initid, const size_t len);
+extern void *_arena_alloc(UDF_INIT *initid, const size_t size);
+extern void _arena_reset(UDF_INIT *initid);
+extern char *_arena_normalize(UDF_INIT *initid, const char *str, const int str_len, const int flags, int *out_len);
+extern int _udf_pattern_init(UDF_INIT *initid, UDF_ARGS *args, const unsigned int arg, const int flags);
+extern int _udf_collation_init(UDF_INIT *initid, UDF_ARGS *args, const unsigned int arg, char *message);
+extern BP_SCRATCH *_bp_cache_lookup(UDF_INIT *initid, const int arg, const char *s, const int n);
+extern int _bp_trail_resume(BP_TRAIL *tr, const BP_SCRATCH *bp, const char *t, const int m);
+extern int _prefilter_k(PREFILTER *pf, const char *s, const int n, const char *t, const int m, const int k,
+                       const int osa, const int keep);
+extern void _prefilter_unload(PREFILTER *pf);
+extern PREFILTER *_prefilter_for(UDF_INIT *initid);
+extern int _prefilter_row(UDF_INIT *initid, const char *s, const int n, const char *t, const int m, const int k,
+                          const int osa);
+extern void _udf_scratch_free(UDF_INIT *initid);
+extern void _dict_release(DICT *dict);
+extern void _symspell_unmap(SYMSPELL_MAP *map);
+extern const char *_bp_simd_path(void);
 
-  initid->ptr = (char*) d;
-  initid->max_length = LEVENSHTEIN_MAX;
-  initid->maybe_null = 0; //doesn't return null
+/**
+ * Lowercase of the ASCII letters, the other bytes as they are: the same in
+ * every locale, and the folding of the ASCII collation, see _fold_init
+ */
+static inline int _fold_case(const int c) {
+    return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
 
-  return 0;
+/**
+ * @param s string
+ * @result strip duplicate spaces, CR or CRLF
+ */
+inline char *_strip_w(const char *str, const int str_len){
+    char *striped_str = (char *)malloc((str_len+1));
+    if (striped_str == NULL)
+        return NULL;
+    return _strip_w_to(striped_str, str, str_len);
 }
 
-void levenshtein_deinit(UDF_INIT *initid) {
-  if (initid->ptr != NULL)
-    free(initid->ptr);
+/**
+ * @param out buffer of at least str_len + 1 bytes
+ * @param str string, length str_len
+ * @result out, holding str stripped as by _strip_w
+ */
+inline char *_strip_w_to(char *out, const char *str, const int str_len){
+    _normalize_to(out, str, str_len, 0);
+    return out;
 }
 
-longlong levenshtein(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error) {
-  const char *s = args->args[0];
-  const char *t = args->args[1];
+/**
+ * Start a normalizing walk over str, see _norm_next.
+ *
+ * @param it iterator
+ * @param str string, length str_len, not null terminated
+ * @param lower non zero to lowercase on the fly
+ */
+inline void _norm_init(NORM_ITER *it, const char *str, const int str_len, const int lower){
+    it->p = (const unsigned char *) str;
+    it->end = it->p + (str_len > 0 ? str_len : 0);
+    it->lower = lower;
+    it->started = 0;
+}
 
-  int n = (s == NULL) ? 0 : args->lengths[0];
-  int m = (t == NULL) ? 0 : args->lengths[1];
+/**
+ * Next byte of the string as _strip_w, then _tolowercase, would write it:
+ * leading whitespace and runs of whitespace not followed by a character are
+ * dropped, and the walk ends at the first NUL like the strlen of the copy.
+ *
+ * @param it iterator
+ * @result next byte, -1 at the end
+ */
+inline int _norm_next(NORM_ITER *it){
+    while (it->p < it->end) {
+        const unsigned char c = *it->p++;
+        if (c == '\0')
+            break;
+        if (!isspace(c)) {
+            it->started = 1;
+            return it->lower ? _fold_case(c) : c;
+        }
+        //whitespace is kept only before a character that is written
+        if (it->p < it->end && *it->p != '\0' && !isspace(*it->p) && it->started)
+            return c;
+    }
+    it->p = it->end;
+    return -1;
+}
 
-  if (0 == n)
-    return m;
-  if (0 == m)
-    return n;
+/**
+ * @param out buffer of at least str_len + 1 bytes
+ * @param str string, length str_len
+ * @param lower non zero to lowercase
+ * @result length of str stripped, and lowercased, into out in a single pass
+ */
+inline int _normalize_to(char *out, const char *str, const int str_len, const int lower){
+    NORM_ITER it;
+    int c, x = 0;
+    _norm_init(&it, str, str_len, lower);
+    while ((c = _norm_next(&it)) >= 0)
+        out[x++] = (char) c;
+    out[x] = '\0';
+    return x;
+}
+
+/**
+ * @param s string
+ * @result lowercase string
+ */
+inline char *_tolowercase(char *str){
+    int i = 0;
+    for(i = 0; str[i]; i++){
+        str[i] = _fold_case((unsigned char) str[i]);
+    }
+    return str;
+}
 
-  int *d = (int*) initid->ptr;
+/**
+ * @param len length of the longest pattern the scratch must hold
+ * @result zeroed bit-parallel scratch, NULL if out of memory
+ */
+BP_SCRATCH *_bp_scratch_alloc(const size_t len) {
+  const size_t words = BP_WORDS(len > 0 ? len : 1);
+  BP_SCRATCH *bp = (BP_SCRATCH *) malloc(sizeof(BP_SCRATCH));
+  if (bp == NULL)
+    return NULL;
+
+  bp->peq = (uint64_t *) calloc((BP_ALPHABET + 5) * words, sizeof(uint64_t));
+  if (bp->peq == NULL) {
+    free(bp);
+    return NULL;
+  }
+  bp->pv = bp->peq + BP_ALPHABET * words;
+  bp->mv = bp->pv + words;
+  bp->score = (int64_t *) (bp->mv + words);
+  bp->d0 = (uint64_t *) (bp->score + words);
+  bp->eq = bp->d0 + words;
+  bp->words = words;
+  bp->carry = NULL;
+  bp->carry_size = 0;
+  bp->compiled = NULL;
+
+  return bp;
+}
 
-  /* Initialization */
-  n++; m++;
+/**
+ * Scratch is sized from the actual rows, never from the declared column
+ * lengths, and grows geometrically so that a statement only reallocates
+ * O(log l) times.
+ *
+ * @param bp scratch to grow, may be NULL
+ * @param len length of the pattern about to be compiled
+ * @result bp itself if big enough, otherwise a replacement (bp is released), NULL if out of memory
+ */
+BP_SCRATCH *_bp_scratch_reserve(BP_SCRATCH *bp, const size_t len) {
+  size_t grow = len;
+
+  if (bp != NULL) {
+    if (BP_WORDS(len) <= bp->words)
+      return bp;
+    grow = MAX(len, 2 * bp->words * BP_WORD_BITS);
+    _bp_scratch_free(bp);
+  }
+
+  return _bp_scratch_alloc(grow);
+}
+
+void _bp_scratch_free(BP_SCRATCH *bp) {
+  if (bp == NULL)
+    return;
+  free(bp->carry);
+  free(bp->peq);
+  free(bp);
+}
 
+/**
+ * Set the match masks of the pattern s, length n, in peq
+ */
+static inline void _bp_peq_set(uint64_t *peq, const unsigned char *s, const int n) {
+  const int words = BP_WORDS(n);
   int i;
+
   for (i = 0; i < n; i++)
-    d[i] = i;
+    peq[s[i] * words + i / BP_WORD_BITS] |= 1ULL << (i % BP_WORD_BITS);
+}
 
-  int j;
-  for (j = 0; j < m; j++)
-    d[n * j] = j;
+/**
+ * Clear them again, back to an all zero peq
+ */
+static inline void _bp_peq_clear(uint64_t *peq, const unsigned char *s, const int n) {
+  const int words = BP_WORDS(n);
+  int i;
 
-  /* Recurrence */
+  for (i = 0; i < n; i++)
+    peq[s[i] * words + i / BP_WORD_BITS] = 0;
+}
 
-  int p = 0, h = 0; //indices for d matrix seen as a vector, see below
+/*
+ * Folding of the _ci functions: each character stands for the representative
+ * of its class, its lowercase without accents ('E', 'e', 'É' and 'è' all fold
+ * to 'e'). The classes of the code points are listed as ranges over Latin,
+ * Greek and Cyrillic, either shifted by delta or all mapped to one character,
+ * and expanded when the plugin is loaded into pages of 256 code points: a two
+ * level table, where code points of the pages without entries fold to
+ * themselves. The latin1 bytes fold as the first page, the ASCII collation
+ * only folds the case of the ASCII letters.
+ */
+typedef struct {
+  uint16_t first;
+  uint16_t last;
+  uint8_t  step;
+  int16_t  delta; //added to the code point, when to is 0
+  uint16_t to;
+} FOLD_RANGE;
+
+static const FOLD_RANGE _fold_ranges[] = {
+  {0x0041, 0x005A, 1, 32, 0}, {0x00C0, 0x00C5, 1, 0, 0x0061}, {0x00C6, 0x00C6, 1, 0, 0x00E6},
+  {0x00C7, 0x00C7, 1, 0, 0x0063}, {0x00C8, 0x00CB, 1, 0, 0x0065}, {0x00CC, 0x00CF, 1, 0, 0x0069},
+  {0x00D0, 0x00D0, 1, 0, 0x00F0}, {0x00D1, 0x00D2, 1, -99, 0}, {0x00D3, 0x00D6, 1, 0, 0x006F},
+  {0x00D8, 0x00D8, 1, 0, 0x00F8}, {0x00D9, 0x00DC, 1, 0, 0x0075}, {0x00DD, 0x00DD, 1, 0, 0x0079},
+  {0x00DE, 0x00DE, 1, 0, 0x00FE}, {0x00E0, 0x00E5, 1, 0, 0x0061}, {0x00E7, 0x00E7, 1, 0, 0x0063},
+  {0x00E8, 0x00EB, 1, 0, 0x0065}, {0x00EC, 0x00EF, 1, 0, 0x0069}, {0x00F1, 0x00F2, 1, -131, 0},
+  {0x00F3, 0x00F6, 1, 0, 0x006F}, {0x00F9, 0x00FC, 1, 0, 0x0075}, {0x00FD, 0x00FF, 2, 0, 0x0079},
+  {0x0100, 0x0105, 1, 0, 0x0061}, {0x0106, 0x010D, 1, 0, 0x0063}, {0x010E, 0x010F, 1, 0, 0x0064},
+  {0x0110, 0x0110, 1, 0, 0x0111}, {0x0112, 0x011B, 1, 0, 0x0065}, {0x011C, 0x0123, 1, 0, 0x0067},
+  {0x0124, 0x0125, 1, 0, 0x0068}, {0x0126, 0x0126, 1, 0, 0x0127}, {0x0128, 0x0130, 1, 0, 0x0069},
+  {0x0132, 0x0132, 1, 0, 0x0133}, {0x0134, 0x0135, 1, 0, 0x006A}, {0x0136, 0x0137, 1, 0, 0x006B},
+  {0x0139, 0x013E, 1, 0, 0x006C}, {0x013F, 0x0141, 2, 1, 0}, {0x0143, 0x0148, 1, 0, 0x006E},
+  {0x014A, 0x014A, 1, 0, 0x014B}, {0x014C, 0x0151, 1, 0, 0x006F}, {0x0152, 0x0152, 1, 0, 0x0153},
+  {0x0154, 0x0159, 1, 0, 0x0072}, {0x015A, 0x0161, 1, 0, 0x0073}, {0x0162, 0x0165, 1, 0, 0x0074},
+  {0x0166, 0x0166, 1, 0, 0x0167}, {0x0168, 0x0173, 1, 0, 0x0075}, {0x0174, 0x0175, 1, 0, 0x0077},
+  {0x0176, 0x0178, 1, 0, 0x0079}, {0x0179, 0x017E, 1, 0, 0x007A}, {0x0181, 0x0181, 1, 0, 0x0253},
+  {0x0182, 0x0184, 2, 1, 0}, {0x0186, 0x0186, 1, 0, 0x0254}, {0x0187, 0x0187, 1, 0, 0x0188},
+  {0x0189, 0x018A, 1, 205, 0}, {0x018B, 0x018B, 1, 0, 0x018C}, {0x018E, 0x018E, 1, 0, 0x01DD},
+  {0x018F, 0x018F, 1, 0, 0x0259}, {0x0190, 0x0190, 1, 0, 0x025B}, {0x0191, 0x0191, 1, 0, 0x0192},
+  {0x0193, 0x0193, 1, 0, 0x0260}, {0x0194, 0x0194, 1, 0, 0x0263}, {0x0196, 0x0196, 1, 0, 0x0269},
+  {0x0197, 0x0197, 1, 0, 0x0268}, {0x0198, 0x0198, 1, 0, 0x0199}, {0x019C, 0x019C, 1, 0, 0x026F},
+  {0x019D, 0x019D, 1, 0, 0x0272}, {0x019F, 0x019F, 1, 0, 0x0275}, {0x01A0, 0x01A1, 1, 0, 0x006F},
+  {0x01A2, 0x01A4, 2, 1, 0}, {0x01A6, 0x01A6, 1, 0, 0x0280}, {0x01A7, 0x01A7, 1, 0, 0x01A8},
+  {0x01A9, 0x01A9, 1, 0, 0x0283}, {0x01AC, 0x01AC, 1, 0, 0x01AD}, {0x01AE, 0x01AE, 1, 0, 0x0288},
+  {0x01AF, 0x01B0, 1, 0, 0x0075}, {0x01B1, 0x01B2, 1, 217, 0}, {0x01B3, 0x01B5, 2, 1, 0},
+  {0x01B7, 0x01B7, 1, 0, 0x0292}, {0x01B8, 0x01B8, 1, 0, 0x01B9}, {0x01BC, 0x01BC, 1, 0, 0x01BD},
+  {0x01C4, 0x01C5, 1, 0, 0x01C6}, {0x01C7, 0x01C8, 1, 0, 0x01C9}, {0x01CA, 0x01CB, 1, 0, 0x01CC},
+  {0x01CD, 0x01CE, 1, 0, 0x0061}, {0x01CF, 0x01D0, 1, 0, 0x0069}, {0x01D1, 0x01D2, 1, 0, 0x006F},
+  {0x01D3, 0x01DC, 1, 0, 0x0075}, {0x01DE, 0x01E1, 1, 0, 0x0061}, {0x01E2, 0x01E3, 1, 0, 0x00E6},
+  {0x01E4, 0x01E4, 1, 0, 0x01E5}, {0x01E6, 0x01E7, 1, 0, 0x0067}, {0x01E8, 0x01E9, 1, 0, 0x006B},
+  {0x01EA, 0x01ED, 1, 0, 0x006F}, {0x01EE, 0x01EF, 1, 0, 0x0292}, {0x01F0, 0x01F0, 1, 0, 0x006A},
+  {0x01F1, 0x01F2, 1, 0, 0x01F3}, {0x01F4, 0x01F5, 1, 0, 0x0067}, {0x01F6, 0x01F6, 1, 0, 0x0195},
+  {0x01F7, 0x01F7, 1, 0, 0x01BF}, {0x01F8, 0x01F9, 1, 0, 0x006E}, {0x01FA, 0x01FB, 1, 0, 0x0061},
+  {0x01FC, 0x01FD, 1, 0, 0x00E6}, {0x01FE, 0x01FF, 1, 0, 0x00F8}, {0x0200, 0x0203, 1, 0, 0x0061},
+  {0x0204, 0x0207, 1, 0, 0x0065}, {0x0208, 0x020B, 1, 0, 0x0069}, {0x020C, 0x020F, 1, 0, 0x006F},
+  {0x0210, 0x0213, 1, 0, 0x0072}, {0x0214, 0x0217, 1, 0, 0x0075}, {0x0218, 0x0219, 1, 0, 0x0073},
+  {0x021A, 0x021B, 1, 0, 0x0074}, {0x021C, 0x021C, 1, 0, 0x021D}, {0x021E, 0x021F, 1, 0, 0x0068},
+  {0x0220, 0x0220, 1, 0, 0x019E}, {0x0222, 0x0224, 2, 1, 0}, {0x0226, 0x0227, 1, 0, 0x0061},
+  {0x0228, 0x0229, 1, 0, 0x0065}, {0x022A, 0x0231, 1, 0, 0x006F}, {0x0232, 0x0233, 1, 0, 0x0079},
+  {0x023B, 0x023B, 1, 0, 0x023C}, {0x023D, 0x023D, 1, 0, 0x019A}, {0x0241, 0x0241, 1, 0, 0x0242},
+  {0x0243, 0x0243, 1, 0, 0x0180}, {0x0244, 0x0244, 1, 0, 0x0289}, {0x0245, 0x0245, 1, 0, 0x028C},
+  {0x0246, 0x024E, 2, 1, 0}, {0x0370, 0x0372, 2, 1, 0}, {0x0374, 0x0374, 1, 0, 0x02B9},
+  {0x0376, 0x0376, 1, 0, 0x0377}, {0x037E, 0x037E, 1, 0, 0x003B}, {0x037F, 0x037F, 1, 0, 0x03F3},
+  {0x0385, 0x0385, 1, 0, 0x00A8}, {0x0386, 0x0386, 1, 0, 0x03B1}, {0x0387, 0x0387, 1, 0, 0x00B7},
+  {0x0388, 0x0388, 1, 0, 0x03B5}, {0x0389, 0x0389, 1, 0, 0x03B7}, {0x038A, 0x038A, 1, 0, 0x03B9},
+  {0x038C, 0x038C, 1, 0, 0x03BF}, {0x038E, 0x038E, 1, 0, 0x03C5}, {0x038F, 0x038F, 1, 0, 0x03C9},
+  {0x0390, 0x0390, 1, 0, 0x03B9}, {0x0391, 0x03A1, 1, 32, 0}, {0x03A3, 0x03A9, 1, 32, 0},
+  {0x03AA, 0x03AA, 1, 0, 0x03B9}, {0x03AB, 0x03AB, 1, 0, 0x03C5}, {0x03AC, 0x03AC, 1, 0, 0x03B1},
+  {0x03AD, 0x03AD, 1, 0, 0x03B5}, {0x03AE, 0x03AE, 1, 0, 0x03B7}, {0x03AF, 0x03AF, 1, 0, 0x03B9},
+  {0x03B0, 0x03B0, 1, 0, 0x03C5}, {0x03C2, 0x03C2, 1, 0, 0x03C3}, {0x03CA, 0x03CA, 1, 0, 0x03B9},
+  {0x03CB, 0x03CB, 1, 0, 0x03C5},
+  {0x03CC, 0x03CC, 1, 0, 0x03BF}, {0x03CD, 0x03CD, 1, 0, 0x03C5}, {0x03CE, 0x03CE, 1, 0, 0x03C9},
+  {0x03CF, 0x03CF, 1, 0, 0x03D7}, {0x03D3, 0x03D4, 1, 0, 0x03D2}, {0x03D8, 0x03EE, 2, 1, 0},
+  {0x03F4, 0x03F4, 1, 0, 0x03B8}, {0x03F7, 0x03F7, 1, 0, 0x03F8}, {0x03F9, 0x03F9, 1, 0, 0x03F2},
+  {0x03FA, 0x03FA, 1, 0, 0x03FB}, {0x03FD, 0x03FF, 1, -130, 0}, {0x0400, 0x0401, 1, 0, 0x0435},
+  {0x0402, 0x0402, 1, 0, 0x0452}, {0x0403, 0x0403, 1, 0, 0x0433}, {0x0404, 0x0406, 1, 80, 0},
+  {0x0407, 0x0407, 1, 0, 0x0456}, {0x0408, 0x040B, 1, 80, 0}, {0x040C, 0x040C, 1, 0, 0x043A},
+  {0x040D, 0x040D, 1, 0, 0x0438}, {0x040E, 0x040E, 1, 0, 0x0443}, {0x040F, 0x040F, 1, 0, 0x045F},
+  {0x0410, 0x0418, 1, 32, 0}, {0x0419, 0x0419, 1, 0, 0x0438}, {0x041A, 0x042F, 1, 32, 0},
+  {0x0439, 0x0439, 1, 0, 0x0438}, {0x0450, 0x0451, 1, 0, 0x0435}, {0x0453, 0x0453, 1, 0, 0x0433},
+  {0x0457, 0x0457, 1, 0, 0x0456}, {0x045C, 0x045C, 1, 0, 0x043A}, {0x045D, 0x045D, 1, 0, 0x0438},
+  {0x045E, 0x045E, 1, 0, 0x0443}, {0x0460, 0x0474, 2, 1, 0}, {0x0476, 0x0477, 1, 0, 0x0475},
+  {0x0478, 0x0480, 2, 1, 0}, {0x048A, 0x04BE, 2, 1, 0}, {0x04C0, 0x04C0, 1, 0, 0x04CF},
+  {0x04C1, 0x04C2, 1, 0, 0x0436}, {0x04C3, 0x04CD, 2, 1, 0}, {0x04D0, 0x04D3, 1, 0, 0x0430},
+  {0x04D4, 0x04D4, 1, 0, 0x04D5}, {0x04D6, 0x04D7, 1, 0, 0x0435}, {0x04D8, 0x04DA, 2, 0, 0x04D9},
+  {0x04DB, 0x04DB, 1, 0, 0x04D9}, {0x04DC, 0x04DD, 1, 0, 0x0436}, {0x04DE, 0x04DF, 1, 0, 0x0437},
+  {0x04E0, 0x04E0, 1, 0, 0x04E1}, {0x04E2, 0x04E5, 1, 0, 0x0438}, {0x04E6, 0x04E7, 1, 0, 0x043E},
+  {0x04E8, 0x04EA, 2, 0, 0x04E9}, {0x04EB, 0x04EB, 1, 0, 0x04E9}, {0x04EC, 0x04ED, 1, 0, 0x044D},
+  {0x04EE, 0x04F3, 1, 0, 0x0443}, {0x04F4, 0x04F5, 1, 0, 0x0447}, {0x04F6, 0x04F6, 1, 0, 0x04F7},
+  {0x04F8, 0x04F9, 1, 0, 0x044B}, {0x04FA, 0x052E, 2, 1, 0}, {0x0531, 0x0556, 1, 48, 0},
+  {0x1E00, 0x1E01, 1, 0, 0x0061}, {0x1E02, 0x1E07, 1, 0, 0x0062}, {0x1E08, 0x1E09, 1, 0, 0x0063},
+  {0x1E0A, 0x1E13, 1, 0, 0x0064}, {0x1E14, 0x1E1D, 1, 0, 0x0065}, {0x1E1E, 0x1E1F, 1, 0, 0x0066},
+  {0x1E20, 0x1E21, 1, 0, 0x0067}, {0x1E22, 0x1E2B, 1, 0, 0x0068}, {0x1E2C, 0x1E2F, 1, 0, 0x0069},
+  {0x1E30, 0x1E35, 1, 0, 0x006B}, {0x1E36, 0x1E3D, 1, 0, 0x006C}, {0x1E3E, 0x1E43, 1, 0, 0x006D},
+  {0x1E44, 0x1E4B, 1, 0, 0x006E}, {0x1E4C, 0x1E53, 1, 0, 0x006F}, {0x1E54, 0x1E57, 1, 0, 0x0070},
+  {0x1E58, 0x1E5F, 1, 0, 0x0072}, {0x1E60, 0x1E69, 1, 0, 0x0073}, {0x1E6A, 0x1E71, 1, 0, 0x0074},
+  {0x1E72, 0x1E7B, 1, 0, 0x0075}, {0x1E7C, 0x1E7F, 1, 0, 0x0076}, {0x1E80, 0x1E89, 1, 0, 0x0077},
+  {0x1E8A, 0x1E8D, 1, 0, 0x0078}, {0x1E8E, 0x1E8F, 1, 0, 0x0079}, {0x1E90, 0x1E95, 1, 0, 0x007A},
+  {0x1E96, 0x1E96, 1, 0, 0x0068}, {0x1E97, 0x1E97, 1, 0, 0x0074}, {0x1E98, 0x1E98, 1, 0, 0x0077},
+  {0x1E99, 0x1E99, 1, 0, 0x0079}, {0x1E9B, 0x1E9B, 1, 0, 0x017F}, {0x1E9E, 0x1E9E, 1, 0, 0x00DF},
+  {0x1EA0, 0x1EB7, 1, 0, 0x0061}, {0x1EB8, 0x1EC7, 1, 0, 0x0065}, {0x1EC8, 0x1ECB, 1, 0, 0x0069},
+  {0x1ECC, 0x1EE3, 1, 0, 0x006F}, {0x1EE4, 0x1EF1, 1, 0, 0x0075}, {0x1EF2, 0x1EF9, 1, 0, 0x0079},
+  {0x1EFA, 0x1EFE, 2, 1, 0}, {0x1F00, 0x1F0F, 1, 0, 0x03B1}, {0x1F10, 0x1F15, 1, 0, 0x03B5},
+  {0x1F18, 0x1F1D, 1, 0, 0x03B5}, {0x1F20, 0x1F2F, 1, 0, 0x03B7}, {0x1F30, 0x1F3F, 1, 0, 0x03B9},
+  {0x1F40, 0x1F45, 1, 0, 0x03BF}, {0x1F48, 0x1F4D, 1, 0, 0x03BF}, {0x1F50, 0x1F57, 1, 0, 0x03C5},
+  {0x1F59, 0x1F5F, 2, 0, 0x03C5}, {0x1F60, 0x1F6F, 1, 0, 0x03C9}, {0x1F70, 0x1F71, 1, 0, 0x03B1},
+  {0x1F72, 0x1F73, 1, 0, 0x03B5}, {0x1F74, 0x1F75, 1, 0, 0x03B7}, {0x1F76, 0x1F77, 1, 0, 0x03B9},
+  {0x1F78, 0x1F79, 1, 0, 0x03BF}, {0x1F7A, 0x1F7B, 1, 0, 0x03C5}, {0x1F7C, 0x1F7D, 1, 0, 0x03C9},
+  {0x1F80, 0x1F8F, 1, 0, 0x03B1}, {0x1F90, 0x1F9F, 1, 0, 0x03B7}, {0x1FA0, 0x1FAF, 1, 0, 0x03C9},
+  {0x1FB0, 0x1FB4, 1, 0, 0x03B1}, {0x1FB6, 0x1FBC, 1, 0, 0x03B1}, {0x1FBE, 0x1FBE, 1, 0, 0x03B9},
+  {0x1FC1, 0x1FC1, 1, 0, 0x00A8}, {0x1FC2, 0x1FC4, 1, 0, 0x03B7}, {0x1FC6, 0x1FC7, 1, 0, 0x03B7},
+  {0x1FC8, 0x1FC9, 1, 0, 0x03B5}, {0x1FCA, 0x1FCC, 1, 0, 0x03B7}, {0x1FCD, 0x1FCF, 1, 0, 0x1FBF},
+  {0x1FD0, 0x1FD3, 1, 0, 0x03B9}, {0x1FD6, 0x1FDB, 1, 0, 0x03B9}, {0x1FDD, 0x1FDF, 1, 0, 0x1FFE},
+  {0x1FE0, 0x1FE3, 1, 0, 0x03C5}, {0x1FE4, 0x1FE5, 1, 0, 0x03C1}, {0x1FE6, 0x1FEB, 1, 0, 0x03C5},
+  {0x1FEC, 0x1FEC, 1, 0, 0x03C1}, {0x1FED, 0x1FEE, 1, 0, 0x00A8}, {0x1FEF, 0x1FEF, 1, 0, 0x0060},
+  {0x1FF2, 0x1FF4, 1, 0, 0x03C9}, {0x1FF6, 0x1FF7, 1, 0, 0x03C9}, {0x1FF8, 0x1FF9, 1, 0, 0x03BF},
+  {0x1FFA, 0x1FFC, 1, 0, 0x03C9}, {0x1FFD, 0x1FFD, 1, 0, 0x00B4}
+};
+
+#define FOLD_PAGES 8 //pages of the BMP with folded code points: 0x00 to 0x05, 0x1E and 0x1F
+
+static uint16_t _fold_page_data[FOLD_PAGES][256];
+static uint16_t *_fold_bmp[256]; //page of each 256 code points of the BMP, NULL if they fold to themselves
+static FOLD_TABLE _fold_ascii, _fold_latin1;
+
+static inline uint32_t _fold_cp(const uint32_t c) {
+  const uint16_t *page = (c < 0x10000) ? _fold_bmp[c >> 8] : NULL;
+  return (page == NULL) ? c : page[c & 0xFF];
+}
 
-  int im1 = 0; //i minus 1
-  for (i = 1; i < n; i++) {
-    p = i;
-    int jm1 = 0; //j minus 1
-    for (j = 1; j < m; j++) {
-      h = p; // d[h] = d[i,j-1], h = (j * n + i - n)  = ((j - 1) * n + i)
-      p += n; // d[p] = d[i,j], p = (j * n + i)
+static void _fold_table_init(FOLD_TABLE *ft) {
+  int c;
 
-      if (s[im1] == t[jm1]) {
-        d[p] = d[h-1]; //no operation required, d[i-1,j-1]
-      }
+  ft->folded_count = 0;
+  for (c = 0; c < 256; c++)
+    if (ft->fold[c] != c)
+      ft->folded[ft->folded_count++] = (unsigned char) c;
+}
 
-      else {
-        d[p] = MIN(d[p-1],          //deletion, d[i-1, j]
-                   MIN(d[h],        //insertion, d[i, j-1]
-                       d[h-1])      //substitution, d[i-1,j-1]
-                       ) + 1;       //can put +1 outside because the cost is the same
+__attribute__((constructor)) static void _fold_init(void) {
+  const size_t count = sizeof(_fold_ranges) / sizeof(_fold_ranges[0]);
+  unsigned char used[256] = {0};
+  uint16_t *page;
+  uint32_t c;
+  size_t i;
+  int pages = 0, b;
+
+  for (i = 0; i < count; i++)
+    for (c = _fold_ranges[i].first; c <= _fold_ranges[i].last; c += _fold_ranges[i].step)
+      if (!used[c >> 8]) {
+        used[c >> 8] = 1;
+        pages++;
       }
 
-      jm1 = j;
+  //all the ranges or none: with more pages than FOLD_PAGES nothing past ASCII folds, which fails every
+  //non-ASCII _ci test, instead of the ranges of the pages left over quietly folding to themselves
+  if (pages <= FOLD_PAGES) {
+    for (b = 0, pages = 0; b < 256; b++) {
+      if (!used[b])
+        continue;
+      page = _fold_bmp[b] = _fold_page_data[pages++];
+      for (c = 0; c < 256; c++)
+        page[c] = (uint16_t) ((b << 8) + c);
     }
+    for (i = 0; i < count; i++)
+      for (c = _fold_ranges[i].first; c <= _fold_ranges[i].last; c += _fold_ranges[i].step)
+        _fold_bmp[c >> 8][c & 0xFF] = _fold_ranges[i].to ? _fold_ranges[i].to
+                                                          : (uint16_t) (c + _fold_ranges[i].delta);
+  }
 
-    im1 = i;
+  for (b = 0; b < 256; b++) {
+    _fold_ascii.fold[b] = (unsigned char) _fold_case(b);
+    _fold_latin1.fold[b] = (unsigned char) _fold_cp(b);
   }
+  _fold_table_init(&_fold_ascii);
+  _fold_table_init(&_fold_latin1);
+}
 
-  return (longlong) d[p];
+/**
+ * @param collation COLLATION_*
+ * @result byte folding of the collation, the ASCII one for UTF-8 (its multibyte
+ *         characters are folded as code points, see _utf8_substring_core)
+ */
+const FOLD_TABLE *_fold_table(const int collation) {
+  return (collation == COLLATION_LATIN1) ? &_fold_latin1 : &_fold_ascii;
 }
 
-//-------------------------------------------------------------------------
+/**
+ * @param str string, length len, folded in place
+ * @result str
+ */
+char *_fold_bytes(char *str, const int len, const FOLD_TABLE *ft) {
+  int i;
 
-my_bool levenshtein_ratio_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
-  if ((args->arg_count != 2) ||
-      (args->arg_type[0] != STRING_RESULT || args->arg_type[1] != STRING_RESULT)) {
-    strcpy(message, "Function requires 2 arguments, (string, string)");
-    return 1;
-  }
+  for (i = 0; i < len; i++)
+    str[i] = (char) ft->fold[(unsigned char) str[i]];
+  return str;
+}
 
-  //matrix for levenshtein calculations of size n+1 x m+1 (+1 for base values)
-  int *d = (int *) malloc(sizeof(int) * (args->lengths[0] + 1) * (args->lengths[1] + 1));
-  if (d == NULL) {
-    strcpy(message, "Failed to allocate memory");
-    return 1;
+/**
+ * Folded masks: the masks of all the bytes of a class get the bits of each
+ * other, so that the text is matched as it is, without a folded copy.
+ * O(words) per folded byte of the table on top of _bp_peq_set, whatever the
+ * length of the text.
+ */
+static inline void _bp_peq_fold(uint64_t *peq, const int n, const FOLD_TABLE *ft) {
+  const int words = BP_WORDS(n);
+  uint64_t *from, *to;
+  int i, w;
+
+  for (i = 0; i < ft->folded_count; i++) {
+    from = peq + ft->folded[i] * words;
+    to = peq + ft->fold[ft->folded[i]] * words;
+    for (w = 0; w < words; w++)
+      to[w] |= from[w];
   }
+  for (i = 0; i < ft->folded_count; i++) {
+    from = peq + ft->fold[ft->folded[i]] * words;
+    to = peq + ft->folded[i] * words;
+    for (w = 0; w < words; w++)
+      to[w] = from[w];
+  }
+}
 
-  initid->ptr = (char*) d;
-  initid->max_length = LEVENSHTEIN_MAX;
-  initid->maybe_null = 0; //doesn't return null
+/**
+ * Clear masks folded by _bp_peq_fold, back to an all zero peq
+ */
+static inline void _bp_peq_clear_fold(uint64_t *peq, const unsigned char *s, const int n, const FOLD_TABLE *ft) {
+  const int words = BP_WORDS(n);
+  int i;
 
-  return 0;
+  _bp_peq_clear(peq, s, n);
+  for (i = 0; i < ft->folded_count; i++) {
+    memset(peq + ft->folded[i] * words, 0, words * sizeof(uint64_t));
+    memset(peq + ft->fold[ft->folded[i]] * words, 0, words * sizeof(uint64_t));
+  }
 }
 
-void levenshtein_ratio_deinit(UDF_INIT *initid) {
-  if (initid->ptr != NULL)
-    free(initid->ptr);
+/**
+ * @param s pattern, length n, must stay valid as long as the scratch is used
+ * @param ft folding of the masks, NULL for none
+ * @result scratch whose masks of s stay set; cores run with it keep s as the pattern
+ *         and skip building the masks. NULL if out of memory
+ */
+BP_SCRATCH *_bp_compile(const char *s, const int n, const FOLD_TABLE *ft) {
+  BP_SCRATCH *bp = _bp_scratch_alloc(n);
+  if (bp == NULL)
+    return NULL;
+
+  _bp_peq_set(bp->peq, (const unsigned char *) s, n);
+  if (ft != NULL)
+    _bp_peq_fold(bp->peq, n, ft);
+  bp->compiled = s;
+  return bp;
 }
 
-double levenshtein_ratio(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error) {
-  const char *s = args->args[0];
-  const char *t = args->args[1];
-
-  int n = (s == NULL) ? 0 : args->lengths[0];
-  int m = (t == NULL) ? 0 : args->lengths[1];
-  double maxlen = MAX(n, m);
-  if (maxlen == 0)
-    return 0.0;
+/**
+ * Masks of the needle s, length n, of a sliding window search, set once for
+ * all the windows of the row: the cores then take s as compiled.
+ *
+ * @result 0 if bp already holds them compiled, otherwise 1 and they are to be
+ *         cleared by _bp_needle_clear at the end of the row
+ */
+static inline int _bp_needle_set(BP_SCRATCH *bp, const char *s, const int n, const FOLD_TABLE *ft) {
+  if (s == bp->compiled)
+    return 0;
 
-  double dist = (double) levenshtein(initid, args, is_null, error);
-  return 1.0 - dist/maxlen;
+  _bp_peq_set(bp->peq, (const unsigned char *) s, n);
+  if (ft != NULL)
+    _bp_peq_fold(bp->peq, n, ft);
+  bp->compiled = s;
+  return 1;
 }
 
-//-------------------------------------------------------------------------
+static inline void _bp_needle_clear(BP_SCRATCH *bp, const int n, const FOLD_TABLE *ft) {
+  if (ft != NULL)
+    _bp_peq_clear_fold(bp->peq, (const unsigned char *) bp->compiled, n, ft);
+  else
+    _bp_peq_clear(bp->peq, (const unsigned char *) bp->compiled, n);
+  bp->compiled = NULL;
+}
 
-my_bool levenshtein_k_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
-  if ((args->arg_count != 3) ||
-      (args->arg_type[0] != STRING_RESULT || args->arg_type[1] != STRING_RESULT || args->arg_type[2] != INT_RESULT)) {
-    strcpy(message, "Function requires 3 arguments, (string, string, int)");
+/**
+ * @param initid owner of the scratch (initid->ptr, NULL on the first row)
+ * @result the statement scratch, NULL if out of memory
+ */
+static UDF_SCRATCH *_udf_scratch(UDF_INIT *initid) {
+  if (initid->ptr == NULL)
+    initid->ptr = (char*) calloc(1, sizeof(UDF_SCRATCH));
+  return (UDF_SCRATCH*) initid->ptr;
+}
+
+/*
+ * Per row buffers come from a bump allocator, reset by _arena_reset at the
+ * start of every row that uses it. A row needing more than the current block
+ * chains a new one, at least twice as large; the next reset merges the chain
+ * into a single block of the total size. Once the statement has seen its
+ * largest row, rows cause no heap traffic at all.
+ */
+#define ARENA_ALIGN 16
+#define ARENA_MIN_SIZE 4096
+#define ARENA_HEADER ((sizeof(ARENA_BLOCK) + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1))
+
+static ARENA_BLOCK *_arena_block(ARENA_BLOCK *prev, const size_t size) {
+  ARENA_BLOCK *b = (ARENA_BLOCK *) malloc(ARENA_HEADER + size);
+  if (b == NULL)
+    return NULL;
+
+  b->prev = prev;
+  b->size = size;
+  b->used = 0;
+  return b;
+}
+
+/**
+ * @param initid owner of the scratch
+ * @param size number of bytes needed
+ * @result size bytes, valid until the next _arena_reset, NULL if out of memory
+ */
+void *_arena_alloc(UDF_INIT *initid, const size_t size) {
+  UDF_SCRATCH *sc = _udf_scratch(initid);
+  const size_t aligned = (size + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1);
+  ARENA_BLOCK *b;
+
+  if (sc == NULL)
+    return NULL;
+
+  b = sc->arena;
+  if (b == NULL || b->size - b->used < aligned) {
+    b = _arena_block(b, MAX(aligned, (b == NULL) ? ARENA_MIN_SIZE : 2 * b->size));
+    if (b == NULL)
+      return NULL;
+    sc->arena = b;
+  }
+
+  b->used += aligned;
+  return (char *) b + ARENA_HEADER + b->used - aligned;
+}
+
+/**
+ * Release the buffers of the previous row
+ */
+void _arena_reset(UDF_INIT *initid) {
+  UDF_SCRATCH *sc = (UDF_SCRATCH*) initid->ptr;
+  ARENA_BLOCK *b, *prev;
+  size_t size = 0;
+
+  if (sc == NULL || sc->arena == NULL)
+    return;
+
+  if (sc->arena->prev == NULL) {
+    sc->arena->used = 0;
+    return;
+  }
+
+  for (b = sc->arena; b != NULL; b = prev) {
+    prev = b->prev;
+    size += b->size;
+    free(b);
+  }
+  sc->arena = _arena_block(NULL, size); //NULL if out of memory, _arena_alloc tries again
+}
+
+/**
+ * @param initid owner of the arena
+ * @param str string, length str_len
+ * @param flags PATTERN_STRIP, PATTERN_LOWER
+ * @param out_len length of the normalized copy
+ * @result normalized copy of str in the arena, NULL if out of memory
+ */
+char *_arena_normalize(UDF_INIT *initid, const char *str, const int str_len, const int flags, int *out_len) {
+  char *out = (char *) _arena_alloc(initid, str_len + 1);
+  if (out == NULL)
+    return NULL;
+
+  if (flags & PATTERN_STRIP)
+    *out_len = _normalize_to(out, str, str_len, flags & PATTERN_LOWER);
+  else {
+    if (str_len > 0)
+      memcpy(out, str, str_len);
+    out[str_len] = '\0';
+    *out_len = str_len;
+    if (flags & PATTERN_LOWER)
+      *out_len = strlen(_tolowercase(out));
+  }
+
+  return out;
+}
+
+/**
+ * @param initid owner of the scratch
+ * @param len length of the pattern about to be compiled
+ * @result bit-parallel scratch for patterns of at least len characters, NULL if out of memory
+ */
+BP_SCRATCH *_bp_scratch_for(UDF_INIT *initid, const size_t len) {
+  UDF_SCRATCH *sc = _udf_scratch(initid);
+  if (sc == NULL)
+    return NULL;
+
+  sc->bp = _bp_scratch_reserve(sc->bp, len);
+  return sc->bp;
+}
+
+/**
+ * Precompute a constant argument once for all the rows. Arguments given as
+ * constants already hold their value in the init, the others are NULL there.
+ *
+ * @param initid owner of the scratch
+ * @param args arguments of the init
+ * @param arg index of the pattern argument
+ * @param flags PATTERN_STRIP, PATTERN_LOWER, PATTERN_FOLD, PATTERN_COMPILE
+ * @result 0 if done or the argument is not constant, 1 if out of memory
+ */
+int _udf_pattern_init(UDF_INIT *initid, UDF_ARGS *args, const unsigned int arg, const int flags) {
+  const char *s = args->args[arg];
+  const int n = (s == NULL) ? 0 : args->lengths[arg];
+  char *pattern;
+
+  if (s == NULL)
+    return 0;
+
+  UDF_SCRATCH *sc = _udf_scratch(initid);
+  if (sc == NULL)
     return 1;
+
+  if (flags & PATTERN_STRIP) {
+    pattern = (char *) malloc(n + 1);
+    if (pattern == NULL)
+      return 1;
+    sc->pattern_len = _normalize_to(pattern, s, n, flags & PATTERN_LOWER);
+  }
+  else {
+    pattern = (char *) malloc(n + 1);
+    if (pattern == NULL)
+      return 1;
+    memcpy(pattern, s, n);
+    pattern[n] = '\0';
+    sc->pattern_len = n;
   }
+  sc->pattern = pattern;
+  sc->pattern_arg = arg;
 
-  initid->ptr = NULL;
-  initid->max_length = LEVENSHTEIN_MAX;
-  initid->maybe_null = 0; //doesn't return null
+  if (flags & PATTERN_FOLD)
+    _fold_bytes(pattern, sc->pattern_len, _fold_table(sc->collation));
+
+  if (flags & PATTERN_COMPILE) {
+    sc->compiled = _bp_compile(pattern, sc->pattern_len, (flags & PATTERN_FOLD) ? _fold_table(sc->collation) : NULL);
+    if (sc->compiled == NULL)
+      return 1;
+  }
+
+  return 0;
+}
+
+static int _collation_is(const char *name, const size_t len, const char *collation) {
+  size_t i;
+
+  for (i = 0; i < len && collation[i] != '\0'; i++)
+    if (_fold_case((unsigned char) name[i]) != collation[i])
+      return 0;
+  return i == len && collation[i] == '\0';
+}
+
+/**
+ * Collation of a _ci function, given as an optional constant argument, kept in
+ * the scratch; call before _udf_pattern_init, which folds with it.
+ *
+ * @param initid owner of the scratch
+ * @param args arguments of the init
+ * @param arg index of the collation argument, absent for the default 'ascii'
+ * @param message of the init
+ * @result 0 if done, 1 with message set otherwise
+ */
+int _udf_collation_init(UDF_INIT *initid, UDF_ARGS *args, const unsigned int arg, char *message) {
+  const char *name = (arg < args->arg_count) ? args->args[arg] : NULL;
+  UDF_SCRATCH *sc;
+  int collation;
+
+  if (arg >= args->arg_count)
+    return 0;
+  if (name == NULL) {
+    strcpy(message, "The collation must be a constant, 'ascii', 'latin1' or 'utf8mb4'");
+    return 1;
+  }
+
+  if (_collation_is(name, args->lengths[arg], "ascii"))
+    collation = COLLATION_ASCII;
+  else if (_collation_is(name, args->lengths[arg], "latin1"))
+    collation = COLLATION_LATIN1;
+  else if (_collation_is(name, args->lengths[arg], "utf8mb4") || _collation_is(name, args->lengths[arg], "utf8"))
+    collation = COLLATION_UTF8MB4;
+  else {
+    strcpy(message, "Unknown collation, expected 'ascii', 'latin1' or 'utf8mb4'");
+    return 1;
+  }
 
+  if (collation == COLLATION_ASCII)
+    return 0;
+
+  sc = _udf_scratch(initid);
+  if (sc == NULL) {
+    strcpy(message, "Not enough memory for the collation");
+    return 1;
+  }
+  sc->collation = collation;
   return 0;
 }
 
 /**
- *  deallocate memory, clean and close
+ * @result hash of the length and the first and last 8 bytes of s, O(1)
  */
-void levenshtein_k_deinit(UDF_INIT *initid) {
-    if (initid->ptr != NULL)
-        free(initid->ptr);
+static inline uint64_t _bp_cache_hash(const char *s, const int n) {
+  uint64_t head = 0, tail = 0;
+
+  if (n >= 8) {
+    memcpy(&head, s, 8);
+    memcpy(&tail, s + n - 8, 8);
+  }
+  else if (n > 0)
+    memcpy(&head, s, n);
+
+  return (head * 0x9E3779B97F4A7C15ULL) ^ (tail * 0xC2B2AE3D27D4EB4FULL) ^ (uint64_t) n;
 }
 
 /*
- * 1st observation: time O(kl)
- * (see Algorithms on Strings, Trees, and Sequences, Dan Gusfield, pg. 263)
+ * Cache of compiled argument values for the rows of a statement, e.g. the
+ * outer side of a nested loop join, which stays the same for all the inner
+ * rows. A value is compiled the second time in a row it is seen for the same
+ * argument, and then found by length, hash and content: mysqld reuses its
+ * argument buffers, so neither the pointer nor the hash alone identifies it.
  *
- * When the levenshtein distance is limited to k the alignment path cannot be >k
- * cells off the main diagonal, either from the left (insertions) or from the
- * right (deletions) This means we don't have to fill the whole recurrence
- * matrix; it suffices to fill a strip of 2k + 1 cells in a row. Also, r <= k,
- * for r = m - n, is a necessary condition for there to be any solution.
+ * @param initid owner of the scratch
+ * @param arg 0 or 1, the argument s comes from
+ * @param s string, length n
+ * @result compiled scratch whose pattern (bp->compiled) equals s, NULL if s is not cached
+ */
+BP_SCRATCH *_bp_cache_lookup(UDF_INIT *initid, const int arg, const char *s, const int n) {
+  UDF_SCRATCH *sc = _udf_scratch(initid);
+  BP_CACHE_SLOT *slot;
+  uint64_t hash;
+  int i;
+
+  if (sc == NULL || s == NULL || n == 0)
+    return NULL;
+
+  hash = _bp_cache_hash(s, n);
+  for (i = 0; i < BP_CACHE_SLOTS; i++) {
+    slot = &sc->cache[i];
+    if (slot->bp != NULL && slot->len == n && slot->hash == hash && memcmp(slot->pattern, s, n) == 0)
+      return slot->bp;
+  }
+
+  //first time in a row, only remembered
+  if (sc->last_hash[arg] != hash || sc->last_len[arg] != n) {
+    sc->last_hash[arg] = hash;
+    sc->last_len[arg] = n;
+    return NULL;
+  }
+
+  slot = &sc->cache[sc->cache_next];
+  sc->cache_next = (sc->cache_next + 1) % BP_CACHE_SLOTS;
+  if (sc->trail.owner == slot->bp)
+    sc->trail.owner = NULL;
+  _bp_scratch_free(slot->bp);
+  free(slot->pattern);
+  slot->bp = NULL;
+
+  slot->pattern = (char *) malloc(n + 1);
+  if (slot->pattern == NULL)
+    return NULL;
+  memcpy(slot->pattern, s, n);
+  slot->pattern[n] = '\0';
+  slot->len = n;
+  slot->hash = hash;
+  slot->bp = _bp_compile(slot->pattern, n, NULL);
+
+  return slot->bp;
+}
+
+/**
+ * @param tr trail of the statement
+ * @param bp compiled pattern about to be run over t
+ * @param t text, length m
+ * @result number of leading columns of t whose state is in the trail, the
+ *         kernel resumes after them; -1 if out of memory
+ */
+int _bp_trail_resume(BP_TRAIL *tr, const BP_SCRATCH *bp, const char *t, const int m) {
+  int j = 0;
+
+  if (tr->owner != bp) {
+    tr->owner = bp;
+    tr->len = 0;
+  }
+
+  if ((size_t) m > tr->size) {
+    const size_t size = MAX((size_t) m, 2 * tr->size);
+    void *p;
+
+    tr->len = 0;
+    if ((p = realloc(tr->text, size)) == NULL)
+      return -1;
+    tr->text = (unsigned char *) p;
+    if ((p = realloc(tr->pv, size * sizeof(uint64_t))) == NULL)
+      return -1;
+    tr->pv = (uint64_t *) p;
+    if ((p = realloc(tr->mv, size * sizeof(uint64_t))) == NULL)
+      return -1;
+    tr->mv = (uint64_t *) p;
+    if ((p = realloc(tr->d0, size * sizeof(uint64_t))) == NULL)
+      return -1;
+    tr->d0 = (uint64_t *) p;
+    if ((p = realloc(tr->score, size * sizeof(int64_t))) == NULL)
+      return -1;
+    tr->score = (int64_t *) p;
+    tr->size = size;
+  }
+
+  while (j < tr->len && j < m && tr->text[j] == (unsigned char) t[j])
+    j++;
+
+  return j;
+}
+
+/*
+ * Most candidate pairs of a k-bounded scan are far apart. Before any
+ * recurrence, a cascade of O(n + m) lower bounds of the distance, cheapest
+ * first, rejects them with k + 1:
  *
+ * - the length difference |n - m|;
+ * - the bag distance, max(n, m) minus the characters of the two strings that
+ *   can be paired: an edit, a transposition included, pairs at most one more;
+ * - the count filter of the 2-grams: the longer string has max(n, m) - 1 of
+ *   them, and an edit destroys at most 2 (a transposition 3), so a distance of
+ *   at most k leaves at least max(n, m) - 1 - 2k (3k) in common. The 2-grams
+ *   share PREFILTER_QGRAM_SLOTS counters, a collision can only add common ones.
  *
- * 2nd observation: exactly k + 1
+ * The last two cost a pass over both strings, so they only run for strips of
+ * at least PREFILTER_MIN_CELLS: a narrower recurrence stops on a far pair
+ * after a few rows, for less. Each statement counts the rows every bound rejects, and those passed to the
+ * recurrence; the counts are added to the totals of the plugin when it ends.
+ */
+static uint64_t _prefilter_totals[PREFILTER_COUNTERS]; //see similarities_prefilter_stats
+
+#define PREFILTER_QGRAM_HASH(a, b) ((((unsigned int) (a) << 2) ^ (b)) & (PREFILTER_QGRAM_SLOTS - 1))
+
+static inline void _prefilter_count_bag(int *bag, const unsigned char *s, const int n) {
+  int i;
+
+  memset(bag, 0, BP_ALPHABET * sizeof(int));
+  for (i = 0; i < n; i++)
+    bag[s[i]]++;
+}
+
+static inline void _prefilter_count_qgram(int *qgram, const unsigned char *s, const int n) {
+  int i;
+
+  memset(qgram, 0, PREFILTER_QGRAM_SLOTS * sizeof(int));
+  for (i = 1; i < n; i++)
+    qgram[PREFILTER_QGRAM_HASH(s[i - 1], s[i])]++;
+}
+
+/**
+ * Forget the counts kept by _prefilter_k
+ */
+void _prefilter_unload(PREFILTER *pf) {
+  if (pf != NULL)
+    pf->loaded = NULL;
+}
+
+/**
+ * @param pf counts of the statement, NULL to only compare the lengths
+ * @param s string 1, length n
+ * @param t string 2, length m
+ * @param k maximum threshold
+ * @param osa 1 for the optimal string alignment, 0 for levenshtein
+ * @param keep 1 to keep the counts of s for the following rows, until _prefilter_unload
+ * @result 1 if the distance is certainly greater than k, 0 if the recurrence has to tell
  *
- * The number of _unpaired_ insertions/deletions (the absolute difference in the
- * number of these operations) is as maximum k. When n == m (r == 0) any
- * movement to the left, insertion, in the recurrence matrix is corresponded to
- * a movement to the right, deletion, or viceversa. Analogously when m > n only
- * a maximum of k insertions/deletions operations can be left unpaired. This
- * makes the required strip size to be k + 1 cells.
+ * @time O(n + m), O(m) when the counts of s are kept
+ */
+int _prefilter_k(PREFILTER *pf, const char *s, const int n, const char *t, const int m, const int k,
+                 const int osa, const int keep) {
+  const unsigned char *su = (const unsigned char *) s, *tu = (const unsigned char *) t;
+  const int l = MAX(n, m);
+  const int grams = l - 1 - (osa ? 3 : 2) * k; //2-grams left in common by k edits
+  int common = 0, j, h, rejected = 0;
+
+  if (abs(n - m) > k) {
+    if (pf != NULL)
+      pf->counts[PREFILTER_LENGTH]++;
+    return 1;
+  }
+  if (pf == NULL)
+    return 0;
+  //no bound is greater than max(n, m)
+  if (k >= l || (longlong) (k + 1) * MIN(n, m) < PREFILTER_MIN_CELLS) {
+    pf->counts[PREFILTER_PASSED]++;
+    return 0;
+  }
+
+  if (s != pf->loaded || n != pf->loaded_len) {
+    pf->loaded = NULL;
+    if (keep) {
+      _prefilter_count_bag(pf->loaded_bag, su, n);
+      pf->loaded = s;
+      pf->loaded_len = n;
+      pf->loaded_grams = 0;
+    }
+  }
+  if (pf->loaded != NULL)
+    memcpy(pf->bag, pf->loaded_bag, sizeof(pf->bag));
+  else
+    _prefilter_count_bag(pf->bag, su, n);
+
+  for (j = 0; j < m; j++)
+    common += (pf->bag[tu[j]]-- > 0);
+
+  if (l - common > k) {
+    pf->counts[PREFILTER_BAG]++;
+    rejected = 1;
+  }
+  else if (grams > 0) {
+    if (pf->loaded != NULL) {
+      if (!pf->loaded_grams)
+        _prefilter_count_qgram(pf->loaded_qgram, su, n);
+      pf->loaded_grams = 1;
+      memcpy(pf->qgram, pf->loaded_qgram, sizeof(pf->qgram));
+    }
+    else
+      _prefilter_count_qgram(pf->qgram, su, n);
+
+    common = 0;
+    for (j = 1; j < m; j++) {
+      h = PREFILTER_QGRAM_HASH(tu[j - 1], tu[j]);
+      common += (pf->qgram[h]-- > 0);
+    }
+    if (common < grams) {
+      pf->counts[PREFILTER_QGRAM]++;
+      rejected = 1;
+    }
+  }
+
+  if (!rejected)
+    pf->counts[PREFILTER_PASSED]++;
+  if (!keep)
+    pf->loaded = NULL;
+  return rejected;
+}
+
+/**
+ * @param initid owner of the counts
+ * @result counts of the statement, NULL if out of memory
+ */
+PREFILTER *_prefilter_for(UDF_INIT *initid) {
+  UDF_SCRATCH *sc = _udf_scratch(initid);
+
+  if (sc == NULL)
+    return NULL;
+  if (sc->prefilter == NULL)
+    sc->prefilter = (PREFILTER *) calloc(1, sizeof(PREFILTER));
+  return sc->prefilter;
+}
+
+/**
+ * _prefilter_k of a row of a k-bounded function; the counts of its constant
+ * argument, if any, are loaded once for all the rows
+ */
+int _prefilter_row(UDF_INIT *initid, const char *s, const int n, const char *t, const int m, const int k,
+                   const int osa) {
+  PREFILTER *pf = _prefilter_for(initid);
+  const UDF_SCRATCH *sc = (UDF_SCRATCH*) initid->ptr;
+
+  if (sc != NULL && sc->pattern != NULL)
+    return (sc->pattern_arg == 0) ? _prefilter_k(pf, sc->pattern, sc->pattern_len, t, m, k, osa, 1)
+                                  : _prefilter_k(pf, sc->pattern, sc->pattern_len, s, n, k, osa, 1);
+  return _prefilter_k(pf, s, n, t, m, k, osa, 0);
+}
+
+void _udf_scratch_free(UDF_INIT *initid) {
+  UDF_SCRATCH *sc = (UDF_SCRATCH*) initid->ptr;
+  ARENA_BLOCK *b, *prev;
+  int i;
+
+  if (sc == NULL)
+    return;
+  for (b = sc->arena; b != NULL; b = prev) {
+    prev = b->prev;
+    free(b);
+  }
+  free(sc->pattern);
+  _bp_scratch_free(sc->bp);
+  _bp_scratch_free(sc->compiled);
+  for (i = 0; i < BP_CACHE_SLOTS; i++) {
+    free(sc->cache[i].pattern);
+    _bp_scratch_free(sc->cache[i].bp);
+  }
+  free(sc->trail.text);
+  free(sc->trail.pv);
+  free(sc->trail.mv);
+  free(sc->trail.d0);
+  free(sc->trail.score);
+  if (sc->prefilter != NULL) {
+    for (i = 0; i < PREFILTER_COUNTERS; i++)
+      __atomic_fetch_add(&_prefilter_totals[i], sc->prefilter->counts[i], __ATOMIC_RELAXED);
+    free(sc->prefilter);
+  }
+  free(sc->best.value);
+  for (i = 0; i < sc->topn.capacity; i++)
+    free(sc->topn.heap[i].value);
+  free(sc->topn.heap);
+  _dict_release(sc->dict);
+  _symspell_unmap(&sc->symspell);
+  free(sc);
+  initid->ptr = NULL;
+}
+
+//-------------------------------------------------------------------------
+
+/*
+ * SIMD kernels of the multi-word bit-parallel engine
  *
- * Call l = min(n, m). Place the string with length l on the y axis, and the
- * other on the x axis. By doing this, the number of rows is equal or less than
- * the number of columns and so the algorithm effectively runs in O(kl) Also, by
- * this arrangement of s and t in the recurrence matrix, r indicates the forced
- * number of unpaired deletions, i.e., since r>=0, there cannot be unpaired
- * deletions. Observe that for there to be any insertion k must be equal or
- * greater than 2.
+ * In _levenshtein_bp_blocks and _damerau_bp_blocks block b of column j only
+ * depends on block b of column j-1 (its own vectors) and on block b-1 of
+ * column j (the horizontal carry, plus the transposition bit for OSA). So all
+ * blocks on an anti-diagonal b + j = const are independent and can be advanced
+ * together, one block per SIMD lane. Stripes of as many blocks as lanes sweep the
+ * text along such anti-diagonals: lane l works on column d - l at step d and
+ * takes the carry lane l-1 produced at step d-1. The bottom lane of a stripe
+ * leaves its carries, one byte per column, for the top lane of the next stripe.
  *
- * This arrangement leaves (k-r)/2 possible insertions (left) and (k-r)/2 + r
- * possible deletions (right) --> (k-r)/2 + (k-r)/2 + r + 1 == k + 1
+ * Every lane runs exactly the word operations of the scalar blocked kernels,
+ * so the results are identical. The score is tracked in the last row of the
+ * last block (padding rows included) and corrected to row n at the end.
+ *
+ * The same generic vector code is compiled for SSE4.1, AVX2 and AVX-512 and
+ * the best one the CPU supports is chosen once when the plugin is loaded.
+ * SIMILARITIES_SIMD=scalar|sse4.1|avx2|avx512 in mysqld's environment caps the
+ * choice.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BP_SIMD 1
+#endif
+
+/* Patterns of fewer blocks are faster with the scalar blocked kernels */
+#define BP_SIMD_MIN_WORDS 4
+
+/* Widest batch of candidates scored together by a batch kernel */
+#define BP_SIMD_MAX_LANES 8
+
+typedef longlong (*BP_KERNEL)(const unsigned char *s, const int n, const unsigned char *t, const int m, BP_SCRATCH *bp);
+typedef void (*BP_BATCH_KERNEL)(const unsigned char *s, const int n, const unsigned char **c, const int *len,
+                                longlong *dist, uint64_t *peq);
+
+static struct {
+  const char      *name;
+  BP_KERNEL       levenshtein;
+  BP_KERNEL       damerau;
+  BP_BATCH_KERNEL levenshtein_batch;
+  int             lanes;
+} _bp_simd = {"scalar", NULL, NULL, NULL, 1};
+
+const char *_bp_simd_path(void) {
+  return _bp_simd.name;
+}
+
+#ifdef BP_SIMD
+
+/* Lanes of v moved up by one, lane 0 taken from lane 0 of w */
+#ifdef __clang__
+#define BP_LANES_UP(v, w, L, ...) __builtin_shufflevector(v, w, L, __VA_ARGS__)
+#else
+#define BP_LANES_UP(v, w, L, ...) __builtin_shuffle(v, w, (bp_idx##L) {L, __VA_ARGS__})
+#endif
+
+static unsigned char *_bp_carry_reserve(BP_SCRATCH *bp, const int m) {
+  unsigned char *carry = bp->carry;
+
+  if (bp->carry_size < (size_t) m) {
+    carry = (unsigned char *) realloc(bp->carry, m);
+    if (carry == NULL)
+      return NULL;
+    bp->carry = carry;
+    bp->carry_size = m;
+  }
+
+  return carry;
+}
+
+/*
+ * Stripe kernels over L lanes of 64 bit blocks, BP_STRIPE##L holds the vectors
+ * of the blocks a stripe is working on. hp/hm/tc are the carries out of the
+ * last row of each lane (+1, -1, transposition), taken by the next lane at the
+ * next step; carry[j] holds the ones of the bottom lane for the next stripe.
+ * Lanes past the last block shadow it, their results are never used.
+ * _bp_stripe_step##L advances every lane (or only those in act) by one column.
+ */
+#define BP_SIMD_STRIPED(L, ...)                                                                     \
+typedef uint64_t bp_vec##L __attribute__((vector_size(8 * L)));                                     \
+typedef int64_t bp_idx##L __attribute__((vector_size(8 * L)));                                      \
+                                                                                                    \
+typedef struct {                                                                                    \
+  bp_vec##L p;                                                                                      \
+  bp_vec##L m;                                                                                      \
+  bp_vec##L d0;                                                                                     \
+  bp_vec##L eqo;                                                                                    \
+  bp_vec##L hp;                                                                                     \
+  bp_vec##L hm;                                                                                     \
+  bp_vec##L tc;                                                                                     \
+} BP_STRIPE##L;                                                                                     \
+                                                                                                    \
+static inline __attribute__((always_inline))                                                        \
+void _bp_stripe_step##L(BP_STRIPE##L *st, const bp_vec##L *eqp, const uint64_t c,                   \
+                        const bp_vec##L *act, const int osa) {                                      \
+  const bp_vec##L zero = {0}, eq = *eqp;                                                            \
+  bp_vec##L hp, hm, x, tr, eqh, dd, xv, ph, mh, p, m;                                               \
+                                                                                                    \
+  hp = BP_LANES_UP(st->hp, ((bp_vec##L) {c & 1}), L, __VA_ARGS__);                                  \
+  hm = BP_LANES_UP(st->hm, ((bp_vec##L) {(c >> 1) & 1}), L, __VA_ARGS__);                           \
+                                                                                                    \
+  if (osa) {                                                                                        \
+    x = ~st->d0 & eq;                                                                               \
+    tr = ((x << 1) | BP_LANES_UP(st->tc, ((bp_vec##L) {(c >> 2) & 1}), L, __VA_ARGS__)) & st->eqo;  \
+    st->tc = x >> (BP_WORD_BITS - 1);                                                               \
+  }                                                                                                 \
+  else                                                                                              \
+    tr = zero;                                                                                      \
+                                                                                                    \
+  eqh = eq | hm;                                                                                    \
+  dd = (((eqh & st->p) + st->p) ^ st->p) | eqh | st->m | tr;                                        \
+  xv = osa ? dd : (eq | st->m);                                                                     \
+  ph = st->m | ~(dd | st->p);                                                                       \
+  mh = st->p & dd;                                                                                  \
+                                                                                                    \
+  st->hp = ph >> (BP_WORD_BITS - 1);                                                                \
+  st->hm = mh >> (BP_WORD_BITS - 1);                                                                \
+  ph = (ph << 1) | hp;                                                                              \
+  mh = (mh << 1) | hm;                                                                              \
+                                                                                                    \
+  p = mh | ~(xv | ph);                                                                              \
+  m = ph & xv;                                                                                      \
+  if (act == NULL) {                                                                                \
+    st->p = p;                                                                                      \
+    st->m = m;                                                                                      \
+    if (osa) {                                                                                      \
+      st->d0 = dd;                                                                                  \
+      st->eqo = eq;                                                                                 \
+    }                                                                                               \
+  }                                                                                                 \
+  else {                                                                                            \
+    st->p = (*act & p) | (~*act & st->p);                                                           \
+    st->m = (*act & m) | (~*act & st->m);                                                           \
+    if (osa) {                                                                                      \
+      st->d0 = (*act & dd) | (~*act & st->d0);                                                      \
+      st->eqo = (*act & eq) | (~*act & st->eqo);                                                    \
+    }                                                                                               \
+  }                                                                                                 \
+}                                                                                                   \
+                                                                                                    \
+static inline __attribute__((always_inline))                                                        \
+longlong _bp_striped##L(const unsigned char *s, const int n, const unsigned char *t, const int m,   \
+                        BP_SCRATCH *bp, const int osa) {                                            \
+  const int words = BP_WORDS(n);                                                                    \
+  const int lastbit = (n - 1) % BP_WORD_BITS;                                                       \
+  const bp_vec##L zero = {0};                                                                       \
+  uint64_t *peq = bp->peq, eql[L], lastp = 0, lastm = 0, pad;                                       \
+  BP_STRIPE##L st;                                                                                  \
+  bp_vec##L eq, act;                                                                                \
+  unsigned char *carry;                                                                             \
+  longlong score;                                                                                   \
+  int j, d, l, b0, nl, lo[L];                                                                       \
+                                                                                                    \
+  carry = _bp_carry_reserve(bp, m);                                                                 \
+  if (carry == NULL)                                                                                \
+    return -1;                                                                                      \
+                                                                                                    \
+  for (j = 0; j < m; j++)                                                                           \
+    carry[j] = 1;                                                                                   \
+                                                                                                    \
+  for (b0 = 0; b0 < words; b0 += L) {                                                               \
+    const uint64_t *pe = peq + b0;                                                                  \
+                                                                                                    \
+    nl = MIN(L, words - b0);                                                                        \
+    for (l = 0; l < L; l++)                                                                         \
+      lo[l] = MIN(l, nl - 1);                                                                       \
+                                                                                                    \
+    st.p = ~zero;                                                                                   \
+    st.m = st.d0 = st.eqo = zero;                                                                   \
+    st.hp = st.hm = st.tc = zero;                                                                   \
+                                                                                                    \
+    for (d = 0; d < m + nl - 1; d++) {                                                              \
+      if (d >= nl - 1 && d < m) {                                                                   \
+        const unsigned char *tj = t + d;                                                            \
+        for (l = 0; l < L; l++)                                                                     \
+          eql[l] = pe[tj[-lo[l]] * words + lo[l]];                                                  \
+        memcpy(&eq, eql, sizeof(eq));                                                               \
+        _bp_stripe_step##L(&st, &eq, carry[d], NULL, osa);                                          \
+      }                                                                                             \
+      else {                                                                                        \
+        eq = act = zero;                                                                            \
+        for (l = 0; l < nl; l++) {                                                                  \
+          j = d - l;                                                                                \
+          if (j >= 0 && j < m) {                                                                    \
+            eq[l] = pe[t[j] * words + l];                                                           \
+            act[l] = ~0ULL;                                                                         \
+          }                                                                                         \
+        }                                                                                           \
+        _bp_stripe_step##L(&st, &eq, (d < m) ? carry[d] : 0, &act, osa);                            \
+      }                                                                                             \
+                                                                                                    \
+      j = d - (nl - 1);                                                                             \
+      if (j >= 0)                                                                                   \
+        carry[j] = (unsigned char) (st.hp[nl - 1] | (st.hm[nl - 1] << 1) | (st.tc[nl - 1] << 2));   \
+    }                                                                                               \
+                                                                                                    \
+    lastp = st.p[nl - 1];                                                                           \
+    lastm = st.m[nl - 1];                                                                           \
+  }                                                                                                 \
+                                                                                                    \
+  score = (longlong) words * BP_WORD_BITS;                                                          \
+  for (j = 0; j < m; j++)                                                                           \
+    score += (carry[j] & 1) - ((carry[j] >> 1) & 1);                                                \
+  pad = ~((2ULL << lastbit) - 1);                                                                   \
+  score -= __builtin_popcountll(lastp & pad) - __builtin_popcountll(lastm & pad);                   \
+                                                                                                    \
+  return score;                                                                                     \
+}
+
+BP_SIMD_STRIPED(2, 0)
+BP_SIMD_STRIPED(4, 0, 1, 2)
+BP_SIMD_STRIPED(8, 0, 1, 2, 3, 4, 5, 6)
+
+/*
+ * Batch kernels: one pattern of at most 64 characters against L candidates,
+ * one candidate per lane, each lane running _levenshtein_bp_1w on its own
+ * candidate. Lanes past the end of their candidate (len[l] <= j) keep their
+ * score, so lanes of length 0 can pad a batch.
+ */
+#define BP_SIMD_BATCH(L)                                                                            \
+static inline __attribute__((always_inline))                                                        \
+void _bp_batch##L(const unsigned char *s, const int n, const unsigned char **c, const int *len,     \
+                  longlong *dist, uint64_t *peq) {                                                  \
+  static const unsigned char pad = 0;                                                               \
+  const bp_vec##L zero = {0};                                                                       \
+  bp_vec##L p = ~zero, m = zero, score = zero + (uint64_t) n, rem;                                  \
+  bp_vec##L eq, act, xv, xh, ph, mh;                                                                \
+  const unsigned char *cl[L];                                                                       \
+  uint64_t eql[L], reml[L];                                                                         \
+  int last[L], j, l, maxlen = 0;                                                                    \
+                                                                                                    \
+  for (l = 0; l < L; l++) {                                                                         \
+    cl[l] = (len[l] > 0) ? c[l] : &pad;                                                             \
+    last[l] = MAX(len[l] - 1, 0);                                                                   \
+    reml[l] = len[l];                                                                               \
+    maxlen = MAX(maxlen, len[l]);                                                                   \
+  }                                                                                                 \
+  memcpy(&rem, reml, sizeof(rem));                                                                  \
+                                                                                                    \
+  for (j = 0; j < maxlen; j++) {                                                                    \
+    for (l = 0; l < L; l++)                                                                         \
+      eql[l] = peq[cl[l][MIN(j, last[l])]];                                                         \
+    memcpy(&eq, eql, sizeof(eq));                                                                   \
+    act = ((rem - 1) >> (BP_WORD_BITS - 1)) - 1;                                                    \
+    rem -= 1;                                                                                       \
+                                                                                                    \
+    xv = eq | m;                                                                                    \
+    xh = (((eq & p) + p) ^ p) | eq;                                                                 \
+    ph = m | ~(xh | p);                                                                             \
+    mh = p & xh;                                                                                    \
+    score += act & (((ph >> (n - 1)) & 1) - ((mh >> (n - 1)) & 1));                                 \
+                                                                                                    \
+    ph = (ph << 1) | 1;                                                                             \
+    mh <<= 1;                                                                                       \
+    p = mh | ~(xv | ph);                                                                            \
+    m = ph & xv;                                                                                    \
+  }                                                                                                 \
+                                                                                                    \
+  for (l = 0; l < L; l++)                                                                           \
+    dist[l] = (longlong) score[l];                                                                  \
+}
+
+BP_SIMD_BATCH(2)
+BP_SIMD_BATCH(4)
+BP_SIMD_BATCH(8)
+
+#define BP_SIMD_KERNELS(SUFFIX, TARGET, L)                                                         \
+  __attribute__((target(TARGET))) static longlong _levenshtein_bp_##SUFFIX(                        \
+      const unsigned char *s, const int n, const unsigned char *t, const int m, BP_SCRATCH *bp) {  \
+    return _bp_striped##L(s, n, t, m, bp, 0);                                                      \
+  }                                                                                                \
+  __attribute__((target(TARGET))) static longlong _damerau_bp_##SUFFIX(                            \
+      const unsigned char *s, const int n, const unsigned char *t, const int m, BP_SCRATCH *bp) {  \
+    return _bp_striped##L(s, n, t, m, bp, 1);                                                      \
+  }                                                                                                \
+  __attribute__((target(TARGET))) static void _levenshtein_batch_##SUFFIX(                         \
+      const unsigned char *s, const int n, const unsigned char **c, const int *len,                \
+      longlong *dist, uint64_t *peq) {                                                             \
+    _bp_batch##L(s, n, c, len, dist, peq);                                                         \
+  }
+
+BP_SIMD_KERNELS(sse41, "sse4.1", 2)
+BP_SIMD_KERNELS(avx2, "avx2", 4)
+BP_SIMD_KERNELS(avx512, "avx512f", 8)
+
+/**
+ * Pick the widest kernels the CPU supports, once, when the plugin is loaded
+ */
+__attribute__((constructor)) static void _bp_simd_init(void) {
+  static const char *paths[] = {"scalar", "sse4.1", "avx2", "avx512"};
+  const char *cap = getenv("SIMILARITIES_SIMD");
+  int allowed = 3, i;
+
+  if (cap != NULL) {
+    for (i = 0; i <= 3; i++) {
+      if (strcmp(cap, paths[i]) == 0)
+        allowed = i;
+    }
+  }
+
+  __builtin_cpu_init();
+  if (allowed >= 3 && __builtin_cpu_supports("avx512f")) {
+    _bp_simd.name = paths[3];
+    _bp_simd.levenshtein = _levenshtein_bp_avx512;
+    _bp_simd.damerau = _damerau_bp_avx512;
+    _bp_simd.levenshtein_batch = _levenshtein_batch_avx512;
+    _bp_simd.lanes = 8;
+  }
+  else if (allowed >= 2 && __builtin_cpu_supports("avx2")) {
+    _bp_simd.name = paths[2];
+    _bp_simd.levenshtein = _levenshtein_bp_avx2;
+    _bp_simd.damerau = _damerau_bp_avx2;
+    _bp_simd.levenshtein_batch = _levenshtein_batch_avx2;
+    _bp_simd.lanes = 4;
+  }
+  else if (allowed >= 1 && __builtin_cpu_supports("sse4.1")) {
+    _bp_simd.name = paths[1];
+    _bp_simd.levenshtein = _levenshtein_bp_sse41;
+    _bp_simd.damerau = _damerau_bp_sse41;
+    _bp_simd.levenshtein_batch = _levenshtein_batch_sse41;
+    _bp_simd.lanes = 2;
+  }
+}
+
+#endif /* BP_SIMD */
+
+/**
+ * Levenshtein distance
  *
+ * @param s string 1 to compare, length n
+ * @param t string 2 to compare, length m
+ * @result levenshtein distance between s and t
  *
- * 3rd observation: space O(k)
+ * @time O(lm/w), where l = min(n, m) and w = 64 (machine word)
+ * @space O(l/w)
+ */
+my_bool  levenshtein_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+void     levenshtein_deinit(UDF_INIT *initid);
+longlong levenshtein(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error);
+extern longlong _levenshtein_bp_core(const char *s, const int s_len, const char *t, const int t_len, BP_SCRATCH *bp);
+
+
+/**
+ * Levenshtein distance with threshold k (maximum allowed distance)
  *
- * As with the original levenshtein algorithm, only the current and last rows
- * are needed (that is, when we don't do traceback because we need not the
- * alignment path). By the previous observation, we just need 2 rows of k + 1
- * cells. For this, considering the last row, the previous diagonal is actually
- * in the same column (substitution) and the above cell is actually in the next
- * column (deletion). Observe that by doing this, we're virtually creating a
- * recurrence matrix of n * (k+1) being now the original diagonal in the middle
- * column (-r) (matrix which could be used to do the traceback)
+ * @param s string 1 to compare, length n
+ * @param t string 2 to compare, length m
+ * @param k maximum threshold
+ * @result levenshtein distance between s and t or >k (not specified) if the distance is greater than k
+ *
+ * @time O(kl), linear; where l = min(n, m)
+ *       O(kl/w) for l >= LEVENSHTEIN_K_BP_MIN_LEN and k >= LEVENSHTEIN_K_BP_MIN_K, w = 64
+ *       O(m - p) for a constant or repeated s of up to 64 characters, p = prefix shared with the previous t
+ * @space O(k), constant
+ *        O(l/w) for the bit-parallel case, O(m) for the states kept from the previous row
+ */
+my_bool  levenshtein_k_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+void     levenshtein_k_deinit(UDF_INIT *initid);
+longlong levenshtein_k(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error);
+extern longlong _levenshtein_k_core(const char *s, const int s_len, const char *t, const int t_len, const int k);
+extern longlong _levenshtein_k_row(UDF_INIT *initid, const char *s, const int n, const char *t, const int m,
+                                   const int k);
+extern longlong _levenshtein_k_bp_core(const char *s, const int s_len, const char *t, const int t_len, const int k,
+                                       BP_SCRATCH *bp);
+extern longlong _levenshtein_k_compiled(const char *p, const int p_len, const char *o, const int o_len, const int k,
+                                        BP_SCRATCH *bp, BP_TRAIL *tr);
+
+/**
+ * Levenshtein ratio
+ *
+ * @param s string 1 to compare, length n
+ * @param t string 2 to compare, length m
+ * @result levenshtein ratio between s and t
+ *
+ * @time O(lm/w), see levenshtein
+ * @space O(l/w)
+ */
+my_bool levenshtein_ratio_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+void    levenshtein_ratio_deinit(UDF_INIT *initid);
+double  levenshtein_ratio(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error);
+
+
+/**
+ * Levenshtein ratio with threshold k (maximum allowed distance)
+ *
+ * @param s string 1 to compare, length n
+ * @param t string 2 to compare, length m
+ * @param k maximum threshold
+ * @result levenshtein ratio between s and t if (levenshtein distance <= k), otherwise 0.0
+ *
+ * @time O(kl), linear: where 1 = min(n, m)
+ * @space O(k), constant
+ */
+my_bool levenshtein_k_ratio_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+void    levenshtein_k_ratio_deinit(UDF_INIT *initid);
+double  levenshtein_k_ratio(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error);
+
+/**
+ * Levenshtein substring distance with threshold k (maximum allowed distance)
+ *
+ * @param s string 1 to compare, length n
+ * @param t string 2 to compare, length m
+ * @param k maximum threshold
+ * @result levenshtein substring matching distance between s and t or >k (not specified) if the distance is greater than k
+ * If the left string is longer than the right string then both strings are swapped
+ *
+ */
+my_bool levenshtein_substring_k_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+void    levenshtein_substring_k_deinit(UDF_INIT *initid);
+longlong  levenshtein_substring_k(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error);
+
+/**
+ * Levenshtein substring distance with threshold k (maximum allowed distance) case insensitive
+ *
+ * @param s string 1 to compare, length n
+ * @param t string 2 to compare, length m
+ * @param k maximum threshold
+ * @param collation optional constant: 'ascii' (default), 'latin1' for single byte latin1 strings, or
+ *        'utf8mb4' for UTF-8 strings compared per code point, case and accents folded
+ * @result levenshtein substring matching distance between s and t or >k (not specified) if the distance is greater than k
+ * If the left string is longer than the right string then both strings are swapped
+ *
+ */
+my_bool levenshtein_substring_ci_k_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+void    levenshtein_substring_ci_k_deinit(UDF_INIT *initid);
+longlong  levenshtein_substring_ci_k(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error);
+
+/**
+ * Closest of a list of candidates with threshold k (maximum allowed distance)
+ *
+ * @param s pattern, length n
+ * @param k maximum threshold
+ * @param c1, ..., cN candidates (NULL candidates are skipped)
+ * @result "[i, d]", the 1-based position of the closest candidate (the first
+ *         one on ties) and its levenshtein distance to s, NULL if none is within k
+ *
+ * @time O(nM/(wL)), M = total length of the candidates, w = 64, L = SIMD lanes (1, 2, 4 or 8)
+ *       for n <= 64, see levenshtein otherwise
+ * @space O(N)
+ */
+my_bool levenshtein_best_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+void    levenshtein_best_deinit(UDF_INIT *initid);
+char    *levenshtein_best(UDF_INIT *initid, UDF_ARGS *args, char *result,
+                          unsigned long *length, char *is_null, char *error);
+extern longlong _levenshtein_best_core(const char *s, const int s_len, const char **c, const int *c_len,
+                                       const int count, const int k, longlong *dist, BP_SCRATCH *bp,
+                                       PREFILTER *pf);
+
+/**
+ * Closest of a JSON array of candidates with threshold k, see levenshtein_best
+ *
+ * @param s pattern, length n
+ * @param k maximum threshold
+ * @param json array of strings (null elements are skipped)
+ * @result "[i, d]" as levenshtein_best, NULL if none is within k, error if json is not an array of strings
+ */
+my_bool levenshtein_best_json_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+void    levenshtein_best_json_deinit(UDF_INIT *initid);
+char    *levenshtein_best_json(UDF_INIT *initid, UDF_ARGS *args, char *result,
+                               unsigned long *length, char *is_null, char *error);
+extern int _json_string_array(const char *json, const size_t len, const char **items, int *items_len, char *buf);
+extern char *_json_escape_to(char *out, const char *str, const int len, const int ascii);
+
+/**
+ * Damerau-Levenshtein
+ *
+ * @param s string 1 to compare, length n
+ * @param t string 2 to compare, length m
+ * @result damerau levenshtein distance between s and t
+ *
+ */
+my_bool damerau_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+void damerau_deinit(UDF_INIT *initid);
+longlong damerau(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error);
+extern longlong _damerau_core(const char *str1,int s_len1, const char * str2, int s_len2,
+                       const int swap_costs, const int substitute_costs, const int insert_costs, const int delete_costs,
+                       int *rows, BP_SCRATCH *bp);
+extern longlong _damerau_bp_core(const char *s, const int s_len, const char *t, const int t_len, BP_SCRATCH *bp);
+
+/**
+ * Damerau-Levenshtein with threshold k (maximum allowed distance)
+ *
+ * @param s string 1 to compare, length n
+ * @param t string 2 to compare, length m
+ * @param k maximum threshold
+ * @result damerau levenshtein distance between s and t or k+1 if the distance is greater than k
+ *
+ * @time O(kl), linear; where l = min(n, m)
+ *       O(m - p) for a constant or repeated s of up to 64 characters, p = prefix shared with the previous t
+ * @space O(k)
+ *        O(m) for the states kept from the previous row
+ */
+my_bool  damerau_k_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+void     damerau_k_deinit(UDF_INIT *initid);
+longlong damerau_k(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error);
+extern longlong _damerau_k_core(const char *s, const int s_len, const char *t, const int t_len, const int k, int *rows);
+extern longlong _damerau_k_compiled(const char *p, const int p_len, const char *o, const int o_len, const int k,
+                                    BP_SCRATCH *bp, BP_TRAIL *tr);
+
+/**
+ * Damerau-Levenshtein ratio with threshold k (maximum allowed distance)
+ *
+ * @param s string 1 to compare, length n
+ * @param t string 2 to compare, length m
+ * @param k maximum threshold
+ * @result damerau levenshtein ratio between s and t if (distance <= k), otherwise 0.0
+ *
+ * @time O(kl), linear: where l = min(n, m)
+ * @space O(k)
+ */
+my_bool damerau_k_ratio_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+void    damerau_k_ratio_deinit(UDF_INIT *initid);
+double  damerau_k_ratio(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error);
+
+/**
+ * Unrestricted Damerau-Levenshtein (transpositions of substrings which are
+ * edited in between are allowed, unlike the optimal string alignment of
+ * damerau). It satisfies the triangle inequality, hence it is a metric.
+ *
+ * @param s string 1 to compare, length n
+ * @param t string 2 to compare, length m
+ * @result damerau levenshtein distance between s and t
+ *
+ * @time O(nm), quadratic
+ * @space O(min(sigma, n) * m), sigma = distinct bytes of the longer string, m = length of the shorter one
+ */
+my_bool  damerau_full_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+void     damerau_full_deinit(UDF_INIT *initid);
+longlong damerau_full(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error);
+extern size_t _damerau_full_rows(const char *s, const int s_len, const char *t, const int t_len);
+extern longlong _damerau_full_core(const char *s, const int s_len, const char *t, const int t_len, int *rows);
+
+/**
+ * Damerau-Levenshtein
+ *
+ * @param s string 1 to compare, length n
+ * @param t string 2 to compare, length m
+ * @result damerau levenshtein substring matching distance
+ */
+my_bool damerau_substring_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+void    damerau_substring_deinit(UDF_INIT *initid);
+longlong  damerau_substring(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error);
+
+/**
+ * Damerau-Levenshtein case insensitive
+ *
+ * @param s string 1 to compare, length n
+ * @param t string 2 to compare, length m
+ * @param collation optional constant, as for levenshtein_substring_ci_k
+ * @result damerau levenshtein substring matching distance
+ */
+my_bool damerau_substring_ci_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+void    damerau_substring_ci_deinit(UDF_INIT *initid);
+longlong  damerau_substring_ci(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error);
+extern longlong _utf8_substring_core(UDF_INIT *initid, const char *s, const int s_len, const char *t, const int t_len,
+                                     const int osa, const int k, char *error);
+
+/**
+ * Levenshtein distance counting edits per UTF-8 code point, e.g. 1 for "café" and "cafe"
+ *
+ * @param s UTF-8 string 1 to compare, n code points
+ * @param t UTF-8 string 2 to compare, m code points
+ * @result levenshtein distance between the code points of s and t
+ *
+ * @time O(lm/w) as levenshtein, plus O(n + m) to decode rows that are not pure ASCII;
+ *       O(nm) if both strings have more than 127 distinct non-ASCII characters
+ * @space O(n + m)
+ */
+my_bool  levenshtein_utf8_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+void     levenshtein_utf8_deinit(UDF_INIT *initid);
+longlong levenshtein_utf8(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error);
+extern int _utf8_is_ascii(const char *s, const int n);
+extern int _utf8_decode(const char *str, const int len, uint32_t *out);
+extern int _utf8_remap(UDF_INIT *initid, const char **s, int *n, const char **t, int *m,
+                       uint32_t **s_cp, uint32_t **t_cp);
+extern int _utf8_remap_cp(UDF_INIT *initid, const uint32_t *s_cp, const int n, const uint32_t *t_cp, const int m,
+                          const char **s_bytes, const char **t_bytes);
+extern longlong _utf8_edit_core(const uint32_t *s, const int n, const uint32_t *t, const int m, const int osa,
+                                int *rows);
+
+/**
+ * Levenshtein distance per UTF-8 code point with threshold k (maximum allowed distance)
+ *
+ * @param s UTF-8 string 1 to compare, n code points
+ * @param t UTF-8 string 2 to compare, m code points
+ * @param k maximum threshold
+ * @result levenshtein distance between the code points of s and t or k+1 if the distance is greater than k
+ *
+ * @time O(kl) as levenshtein_k, plus O(n + m) to decode rows that are not pure ASCII
+ * @space O(n + m)
+ */
+my_bool  levenshtein_k_utf8_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+void     levenshtein_k_utf8_deinit(UDF_INIT *initid);
+longlong levenshtein_k_utf8(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error);
+
+/**
+ * Damerau-Levenshtein (optimal string alignment) per UTF-8 code point
+ *
+ * @param s UTF-8 string 1 to compare, n code points
+ * @param t UTF-8 string 2 to compare, m code points
+ * @result damerau levenshtein distance between the code points of s and t
+ *
+ * @time O(lm/w) as damerau, plus O(n + m) to decode rows that are not pure ASCII
+ * @space O(n + m)
+ */
+my_bool  damerau_utf8_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+void     damerau_utf8_deinit(UDF_INIT *initid);
+longlong damerau_utf8(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error);
+
+/**
+ * Fixed size fingerprint of a string for levenshtein_sig_may_match, stored once
+ * per row in a BINARY(32) column
+ *
+ * @param s string, NULL as the empty string
+ * @result 32 bytes: version, length, bitmap of the byte classes, sketch of the 2-grams
+ *
+ * @time O(n)
+ * @space O(1)
+ */
+my_bool levenshtein_signature_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+void    levenshtein_signature_deinit(UDF_INIT *initid);
+char    *levenshtein_signature(UDF_INIT *initid, UDF_ARGS *args, char *result,
+                               unsigned long *length, char *is_null, char *error);
+extern void _signature_of(const char *s, const int n, SIGNATURE *sig);
+extern void _signature_store(const SIGNATURE *sig, unsigned char *out);
+extern int _signature_load(const char *buf, const unsigned long len, SIGNATURE *sig);
+extern int _signature_may_match(const SIGNATURE *a, const SIGNATURE *b, const int k, const int transpositions);
+
+/**
+ * Filter of two fingerprints of levenshtein_signature, e.g.
+ * WHERE levenshtein_sig_may_match(sig, levenshtein_signature('term'), 2) AND levenshtein_k(name, 'term', 2) <= 2
+ *
+ * @param sig_a fingerprint of string 1
+ * @param sig_b fingerprint of string 2
+ * @param k maximum threshold
+ * @param transpositions optional, 1 to filter for the damerau functions
+ * @result 0 if the levenshtein (damerau) distance of the strings is certainly greater than k, 1 otherwise;
+ *         1 as well if a fingerprint is NULL or not one of levenshtein_signature
+ *
+ * @time O(1)
+ * @space O(1)
+ */
+my_bool  levenshtein_sig_may_match_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+void     levenshtein_sig_may_match_deinit(UDF_INIT *initid);
+longlong levenshtein_sig_may_match(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error);
+
+/**
+ * Keys of the pigeonhole filter of a fuzzy join (PassJoin): a string of length
+ * l is cut into k + 1 segments, and a string within distance k of it contains
+ * one of them unedited, close to its position. Materialized into an indexed
+ * table, the keys of one side and the probes (levenshtein_partition_probes) of
+ * the other side turn levenshtein_k(a.x, b.y, k) <= k into an equi-join on the
+ * key; levenshtein_k only verifies the candidate pairs.
+ *
+ * @param s string, NULL as the empty string
+ * @param k maximum threshold, the same for the keys and the probes
+ * @result JSON array of the k + 1 keys "l:i:segment i", bytes from 0x80 on \u00XX escaped, only the key
+ *         "l:0:" of the empty first segment if l <= k; null if k is null or negative
+ *
+ * @time O(n)
+ * @space O(n)
+ */
+my_bool levenshtein_partition_keys_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+void    levenshtein_partition_keys_deinit(UDF_INIT *initid);
+char    *levenshtein_partition_keys(UDF_INIT *initid, UDF_ARGS *args, char *result,
+                                    unsigned long *length, char *is_null, char *error);
+extern void _partition_segment(const int l, const int k, const int i, int *start, int *len);
+extern char *_partition_key_to(char *out, const int l, const int i, const char *seg, const int len);
+
+/**
+ * Probes of the pigeonhole filter of a fuzzy join, see levenshtein_partition_keys:
+ * for every length l within k of n, the substrings of s that segment i of a
+ * string of length l can be aligned to without more than k edits in total
+ *
+ * @param s string, NULL as the empty string
+ * @param k maximum threshold, the same for the keys and the probes
+ * @result JSON array of the keys "l:i:substring", only "l:0:" for a length l <= k; a substring
+ *         repeated at the next shift of its segment once, farther repeats again; null if k is null
+ *         or negative
+ *
+ * @time O(k^2 n), O(k^2 min(k, n)) probes of about n / (k + 1) bytes each
+ * @space O(k^2 n)
+ */
+my_bool levenshtein_partition_probes_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+void    levenshtein_partition_probes_deinit(UDF_INIT *initid);
+char    *levenshtein_partition_probes(UDF_INIT *initid, UDF_ARGS *args, char *result,
+                                      unsigned long *length, char *is_null, char *error);
+
+/**
+ * Aggregate: value of the group closest to a pattern, e.g.
+ * SELECT city, levenshtein_argmin('Levenshtein', name, 3) FROM people GROUP BY city
+ *
+ * Each row is scored with levenshtein_k against the best distance so far less
+ * one, not k, so the band narrows and the kernels give up sooner as better
+ * values are found; once a value is equal to the pattern, rows are skipped.
+ *
+ * @param s pattern, usually constant
+ * @param t value of the row, NULL values are skipped
+ * @param k maximum threshold
+ * @result the first value of the group at the smallest distance, null if none is within k
+ *
+ * @time O(kl) per row as levenshtein_k, k the best distance so far less one
+ * @space O(k) as levenshtein_k, plus the closest value
+ */
+my_bool levenshtein_argmin_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+void    levenshtein_argmin_deinit(UDF_INIT *initid);
+void    levenshtein_argmin_clear(UDF_INIT *initid, char *is_null, char *error);
+void    levenshtein_argmin_add(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error);
+void    levenshtein_argmin_reset(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error);
+char    *levenshtein_argmin(UDF_INIT *initid, UDF_ARGS *args, char *result,
+                            unsigned long *length, char *is_null, char *error);
+
+/**
+ * Aggregate: the n values of the group closest to a pattern, e.g. for a typeahead
+ * SELECT levenshtein_topn('Levenshtein', name, 10, 3) FROM people
+ * instead of ORDER BY levenshtein(name, 'Levenshtein') LIMIT 10
+ *
+ * Once n values are kept, a row is scored with levenshtein_k against the
+ * distance of the farthest of them less one, so the band narrows as the heap
+ * fills with closer values.
+ *
+ * @param s pattern, usually constant
+ * @param t value of the row, NULL values are skipped
+ * @param n number of values
+ * @param k maximum threshold
+ * @result JSON array of [value, distance] by distance, ties in the order of the rows, e.g.
+ *         [["Levenshtein", 0], ["Levenshtain", 1]]; null if no value is within k
+ *
+ * @time O(kl + log n) per row as levenshtein_k, k the distance of the n-th value less one
+ * @space O(k) as levenshtein_k, plus the n closest values
+ */
+my_bool levenshtein_topn_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+void    levenshtein_topn_deinit(UDF_INIT *initid);
+void    levenshtein_topn_clear(UDF_INIT *initid, char *is_null, char *error);
+void    levenshtein_topn_add(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error);
+void    levenshtein_topn_reset(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error);
+char    *levenshtein_topn(UDF_INIT *initid, UDF_ARGS *args, char *result,
+                          unsigned long *length, char *is_null, char *error);
+
+/**
+ * Builds the BK-tree of a dictionary, shared by the searches of all the
+ * connections until it is loaded again under the same name. The file is read
+ * by mysqld from the directory in its SIMILARITIES_DICT_DIR environment
+ * variable, loading is refused if it is not set.
+ *
+ * @param name of the tree, up to 64 bytes
+ * @param path of the file, one word per line, relative to SIMILARITIES_DICT_DIR, without ".."
+ * @result number of distinct words in the tree, null on error (no such file, out of memory)
+ *
+ * @time O(w d l^2/w) for w words, d the depth of the tree
+ * @space O(file size + 16 w)
+ */
+my_bool  bktree_load_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+void     bktree_load_deinit(UDF_INIT *initid);
+longlong bktree_load(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error);
+extern BKTREE *_bktree_build(char *pool, const size_t size);
+extern void _bktree_free(BKTREE *tree);
+
+/**
+ * Words of a tree of bktree_load within distance k of a query
+ *
+ * @param name of the tree
+ * @param q query
+ * @param k maximum threshold
+ * @result JSON array of [word, distance] by distance, then in the order of the file, e.g.
+ *         [["Levenshtein", 0], ["Levenstein", 1]]; null if no word is within k, or the tree is not loaded
+ *
+ * @time O(kl) for each node visited, as levenshtein_k, plus O(r log r) for r results
+ * @space O(k) plus the results
+ */
+my_bool bktree_search_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+void    bktree_search_deinit(UDF_INIT *initid);
+char    *bktree_search(UDF_INIT *initid, UDF_ARGS *args, char *result,
+                       unsigned long *length, char *is_null, char *error);
+
+/**
+ * Writes the SymSpell index of a dictionary: every deletion of up to k bytes
+ * of the first 7 bytes of each word, hashed into a table of the words they
+ * come from. The index replaces the file atomically, lookups running on the
+ * previous one keep it until their statement ends. Both files are in the
+ * directory in the SIMILARITIES_DICT_DIR environment variable of mysqld.
+ *
+ * @param path of the dictionary, one word per line, relative to SIMILARITIES_DICT_DIR, without ".."
+ * @param index path of the index, as path
+ * @param k deletions indexed, 0 to 3, the largest k of the lookups
+ * @result number of distinct words in the index, null on error (no such file, k out of range, out of memory)
+ *
+ * @time O(w 2^7) for w words
+ * @space O(file size + 4 w v), v = sum of C(7, i) for i <= k, variants per word
+ */
+my_bool  symspell_build_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+void     symspell_build_deinit(UDF_INIT *initid);
+longlong symspell_build(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error);
+extern longlong _symspell_build(const char *pool, const size_t size, const int k, const char *full);
+
+/**
+ * Words of an index of symspell_build within distance k of a query. The
+ * deletions of the query are looked up in the index, mapped into memory, and
+ * the words found verified as levenshtein_k, or damerau_k.
+ *
+ * @param index path of the index, relative to SIMILARITIES_DICT_DIR
+ * @param q query
+ * @param k maximum threshold, at most the k of the index
+ * @param transpositions optional, non zero for the optimal string alignment distance of damerau
+ * @result JSON array of [word, distance] by distance, then in the order of the dictionary, e.g.
+ *         [["Levenshtein", 0], ["Levenstein", 1]]; null if no word is within k, the index cannot be
+ *         mapped or k is over the k of the index
+ *
+ * @time O(2^7 + c k l) for c candidates sharing a deletion with q, plus O(r log r) for r results
+ * @space O(c) plus the results, the index is in the page cache
+ */
+my_bool symspell_lookup_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+void    symspell_lookup_deinit(UDF_INIT *initid);
+char    *symspell_lookup(UDF_INIT *initid, UDF_ARGS *args, char *result,
+                         unsigned long *length, char *is_null, char *error);
+extern int _symspell_variants(const char *w, const int len, const int k, const int prefix, uint64_t *out);
+
+/**
+ * Builds the trie of a dictionary, shared by the searches of all the
+ * connections until it is loaded again under the same name. The file is read
+ * as by bktree_load, in any order: the words are sorted first.
+ *
+ * @param name of the trie, up to 64 bytes, apart from the names of bktree_load
+ * @param path of the file, one word per line, relative to SIMILARITIES_DICT_DIR, without ".."
+ * @result number of distinct words in the trie, null on error (no such file, out of memory)
+ *
+ * @time O(w log w l) for w words of length l, the sort
+ * @space 5 bytes and a bit per node, at most a node per byte of the file; the file and 16 bytes per
+ *        byte while building
+ */
+my_bool  trie_load_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+void     trie_load_deinit(UDF_INIT *initid);
+longlong trie_load(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error);
+extern TRIE *_trie_build(char *pool, const size_t size);
+extern void _trie_free(TRIE *trie);
+
+/**
+ * Words of a trie of trie_load within distance k of a query. The trie is
+ * walked depth first, one row of the levenshtein_k strip per edge: a prefix
+ * shared by many words is scored once, and a subtree is left as soon as no
+ * cell of its row is within k.
+ *
+ * @param name of the trie
+ * @param q query
+ * @param k maximum threshold
+ * @param transpositions optional, non zero for the optimal string alignment distance of damerau
+ * @result JSON array of [word, distance] by distance, then by byte order, e.g.
+ *         [["Levenshtein", 0], ["Levenstein", 1]]; null if no word is within k, or the trie is not loaded
+ *
+ * @time O(k) for each node visited, plus O(r (log r + l log c)) for r results of length l
+ * @space O(k l) for the longest word l, plus the results
+ */
+my_bool trie_search_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+void    trie_search_deinit(UDF_INIT *initid);
+char    *trie_search(UDF_INIT *initid, UDF_ARGS *args, char *result,
+                     unsigned long *length, char *is_null, char *error);
+
+/**
+ * Kernels picked for this CPU, followed by the SIMD extensions it supports
+ *
+ * @result string, e.g. "avx2 (sse4.1 avx2)"
+ */
+my_bool similarities_cpu_features_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+void    similarities_cpu_features_deinit(UDF_INIT *initid);
+char    *similarities_cpu_features(UDF_INIT *initid, UDF_ARGS *args, char *result,
+                                   unsigned long *length, char *is_null, char *error);
+
+/**
+ * Rows of the k-bounded functions rejected by each lower bound of the
+ * prefilter, and passed on to the recurrence, over the statements ended since
+ * the plugin was loaded
+ *
+ * @result string, e.g. "length 120, bag 3400, qgram 95, passed 210"
+ */
+my_bool similarities_prefilter_stats_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+void    similarities_prefilter_stats_deinit(UDF_INIT *initid);
+char    *similarities_prefilter_stats(UDF_INIT *initid, UDF_ARGS *args, char *result,
+                                      unsigned long *length, char *is_null, char *error);
+
+//-------------------------------------------------------------------------
+
+
+my_bool levenshtein_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
+  if ((args->arg_count != 2) ||
+      (args->arg_type[0] != STRING_RESULT || args->arg_type[1] != STRING_RESULT)) {
+    strcpy(message, "Function requires 2 arguments, (string, string)");
+    return 1;
+  }
+
+  //bit-parallel scratch, allocated by the first row from its actual lengths
+  initid->ptr = NULL;
+  initid->max_length = LEVENSHTEIN_MAX;
+  initid->maybe_null = 0; //doesn't return null
+
+  //a constant string is compiled once for all the rows
+  if (_udf_pattern_init(initid, args, (args->args[0] != NULL) ? 0 : 1, PATTERN_COMPILE)) {
+    _udf_scratch_free(initid);
+    strcpy(message, "Not enough memory for the constant argument");
+    return 1;
+  }
+
+  return 0;
+}
+
+void levenshtein_deinit(UDF_INIT *initid) {
+  _udf_scratch_free(initid);
+}
+
+longlong levenshtein(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error) {
+  const UDF_SCRATCH *sc = (UDF_SCRATCH*) initid->ptr;
+  const char *s = args->args[0];
+  const char *t = args->args[1];
+
+  int n = (s == NULL) ? 0 : args->lengths[0];
+  int m = (t == NULL) ? 0 : args->lengths[1];
+
+  if (0 == n)
+    return m;
+  if (0 == m)
+    return n;
+
+  //constant argument, its masks were compiled by the init
+  if (sc != NULL && sc->compiled != NULL) {
+    if (sc->pattern_arg == 0)
+      return _levenshtein_bp_core(sc->pattern, sc->pattern_len, t, m, sc->compiled);
+    return _levenshtein_bp_core(sc->pattern, sc->pattern_len, s, n, sc->compiled);
+  }
+
+  //value repeated across rows, e.g. the outer side of a join
+  BP_SCRATCH *bp = _bp_cache_lookup(initid, 0, s, n);
+  if (bp != NULL)
+    return _levenshtein_bp_core(bp->compiled, n, t, m, bp);
+  bp = _bp_cache_lookup(initid, 1, t, m);
+  if (bp != NULL)
+    return _levenshtein_bp_core(bp->compiled, m, s, n, bp);
+
+  //O(min(n, m)) scratch, grows lazily with the rows and is reused by the next ones
+  bp = _bp_scratch_for(initid, MIN(n, m));
+  if (bp == NULL) {
+    *error = 1;
+    return 0;
+  }
+
+  return _levenshtein_bp_core(s, n, t, m, bp);
+}
+
+/*
+ * Bit-parallel levenshtein distance
+ * (see G. Myers, A fast bit-vector algorithm for approximate string matching
+ * based on dynamic programming, J. ACM 46(3), 1999, and H. Hyyro, A bit-vector
+ * algorithm for computing Levenshtein and Damerau edit distances, 2003)
+ *
+ * Adjacent cells of the recurrence matrix differ by -1, 0 or +1 only. A
+ * column of the matrix is therefore fully described by two bit-vectors, pv and
+ * mv, holding the positions of the +1 and -1 vertical deltas, and a whole
+ * column can be advanced with a handful of word operations instead of one min()
+ * per cell. The pattern (the shorter string) lies along the bit-vector, the
+ * text is consumed one character per column. The score is tracked in the last
+ * row, starting from d[n, 0] = n.
+ *
+ * Patterns of up to 64 characters fit in one machine word. Longer patterns are
+ * split in blocks of 64 rows, which are advanced top to bottom, each block
+ * passing the horizontal delta of its last row on to the next one as carry.
+ *
+ * The result is exactly the one of the classic O(nm) recurrence.
+ */
+static inline longlong _levenshtein_bp_1w(const unsigned char *s, const int n,
+                                          const unsigned char *t, const int m, uint64_t *peq) {
+  const uint64_t last = 1ULL << (n - 1);
+  uint64_t pv = ~0ULL, mv = 0, eq, xv, xh, ph, mh;
+  longlong score = n;
+  int j;
+
+  for (j = 0; j < m; j++) {
+    eq = peq[t[j]];
+    xv = eq | mv;
+    xh = (((eq & pv) + pv) ^ pv) | eq;
+    ph = mv | ~(xh | pv);
+    mh = pv & xh;
+
+    if (ph & last)
+      score++;
+    else if (mh & last)
+      score--;
+
+    ph = (ph << 1) | 1; //first row is d[0, j] = j, always +1
+    mh <<= 1;
+    pv = mh | ~(xv | ph);
+    mv = ph & xv;
+  }
+
+  return score;
+}
+
+static inline longlong _levenshtein_bp_blocks(const unsigned char *s, const int n,
+                                              const unsigned char *t, const int m, BP_SCRATCH *bp) {
+  const int words = BP_WORDS(n);
+  const uint64_t high = 1ULL << (BP_WORD_BITS - 1);
+  const uint64_t last = 1ULL << ((n - 1) % BP_WORD_BITS);
+  uint64_t *peq = bp->peq, *pv = bp->pv, *mv = bp->mv;
+  uint64_t eq, xv, xh, ph, mh, p, q, top;
+  longlong score = n;
+  int j, b, hin, hout;
+
+  for (b = 0; b < words; b++) {
+    pv[b] = ~0ULL;
+    mv[b] = 0;
+  }
+
+  for (j = 0; j < m; j++) {
+    const uint64_t *eqc = peq + t[j] * words;
+    hin = 1; //first row is d[0, j] = j, always +1
+
+    for (b = 0; b < words; b++) {
+      eq = eqc[b];
+      p = pv[b];
+      q = mv[b];
+
+      xv = eq | q;
+      if (hin < 0)
+        eq |= 1;
+      xh = (((eq & p) + p) ^ p) | eq;
+      ph = q | ~(xh | p);
+      mh = p & xh;
+
+      top = (b == words - 1) ? last : high;
+      hout = (ph & top) ? 1 : ((mh & top) ? -1 : 0);
+
+      ph <<= 1;
+      mh <<= 1;
+      if (hin < 0)
+        mh |= 1;
+      else if (hin > 0)
+        ph |= 1;
+
+      pv[b] = mh | ~(xv | ph);
+      mv[b] = ph & xv;
+      hin = hout;
+    }
+
+    score += hin;
+  }
+
+  return score;
+}
+
+inline longlong _levenshtein_bp_core(const char *s, const int s_len, const char *t, const int t_len, BP_SCRATCH *bp) {
+  int n = (s == NULL) ? 0 : s_len;
+  int m = (t == NULL) ? 0 : t_len;
+  const int compiled = (s != NULL && s == bp->compiled);
+  longlong score = -1;
+
+  //order the strings so that the pattern (bit-vector side) is the shorter one, unless its masks are compiled
+  if (n > m && !compiled) {
+    int aux = n;
+    n = m;
+    m = aux;
+    const char *auxs = s;
+    s = t;
+    t = auxs;
+  }
+
+  if (0 == n)
+    return m;
+
+  if (!compiled)
+    _bp_peq_set(bp->peq, (const unsigned char *) s, n);
+
+  if (n <= BP_WORD_BITS)
+    score = _levenshtein_bp_1w((const unsigned char *) s, n, (const unsigned char *) t, m, bp->peq);
+  else if (_bp_simd.levenshtein != NULL && BP_WORDS(n) >= BP_SIMD_MIN_WORDS)
+    score = _bp_simd.levenshtein((const unsigned char *) s, n, (const unsigned char *) t, m, bp);
+  if (score < 0)
+    score = _levenshtein_bp_blocks((const unsigned char *) s, n, (const unsigned char *) t, m, bp);
+
+  if (!compiled)
+    _bp_peq_clear(bp->peq, (const unsigned char *) s, n);
+
+  return score;
+}
+
+//-------------------------------------------------------------------------
+
+my_bool levenshtein_ratio_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
+  if ((args->arg_count != 2) ||
+      (args->arg_type[0] != STRING_RESULT || args->arg_type[1] != STRING_RESULT)) {
+    strcpy(message, "Function requires 2 arguments, (string, string)");
+    return 1;
+  }
+
+  //bit-parallel scratch, allocated by the first row from its actual lengths
+  initid->ptr = NULL;
+  initid->max_length = LEVENSHTEIN_MAX;
+  initid->maybe_null = 0; //doesn't return null
+
+  //a constant string is compiled once for all the rows
+  if (_udf_pattern_init(initid, args, (args->args[0] != NULL) ? 0 : 1, PATTERN_COMPILE)) {
+    _udf_scratch_free(initid);
+    strcpy(message, "Not enough memory for the constant argument");
+    return 1;
+  }
+
+  return 0;
+}
+
+void levenshtein_ratio_deinit(UDF_INIT *initid) {
+  _udf_scratch_free(initid);
+}
+
+double levenshtein_ratio(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error) {
+  const char *s = args->args[0];
+  const char *t = args->args[1];
+
+  int n = (s == NULL) ? 0 : args->lengths[0];
+  int m = (t == NULL) ? 0 : args->lengths[1];
+  double maxlen = MAX(n, m);
+  if (maxlen == 0)
+    return 0.0;
+
+  double dist = (double) levenshtein(initid, args, is_null, error);
+  return 1.0 - dist/maxlen;
+}
+
+//-------------------------------------------------------------------------
+
+my_bool levenshtein_k_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
+  if ((args->arg_count != 3) ||
+      (args->arg_type[0] != STRING_RESULT || args->arg_type[1] != STRING_RESULT || args->arg_type[2] != INT_RESULT)) {
+    strcpy(message, "Function requires 3 arguments, (string, string, int)");
+    return 1;
+  }
+
+  initid->ptr = NULL;
+  initid->max_length = LEVENSHTEIN_MAX;
+  initid->maybe_null = 0; //doesn't return null
+
+  //a constant string is compiled once for all the rows
+  if (_udf_pattern_init(initid, args, (args->args[0] != NULL) ? 0 : 1, PATTERN_COMPILE)) {
+    _udf_scratch_free(initid);
+    strcpy(message, "Not enough memory for the constant argument");
+    return 1;
+  }
+
+  return 0;
+}
+
+/**
+ *  deallocate memory, clean and close
+ */
+void levenshtein_k_deinit(UDF_INIT *initid) {
+    _udf_scratch_free(initid);
+}
+
+/*
+ * 1st observation: time O(kl)
+ * (see Algorithms on Strings, Trees, and Sequences, Dan Gusfield, pg. 263)
+ *
+ * When the levenshtein distance is limited to k the alignment path cannot be >k
+ * cells off the main diagonal, either from the left (insertions) or from the
+ * right (deletions) This means we don't have to fill the whole recurrence
+ * matrix; it suffices to fill a strip of 2k + 1 cells in a row. Also, r <= k,
+ * for r = m - n, is a necessary condition for there to be any solution.
+ *
+ *
+ * 2nd observation: exactly k + 1
+ *
+ * The number of _unpaired_ insertions/deletions (the absolute difference in the
+ * number of these operations) is as maximum k. When n == m (r == 0) any
+ * movement to the left, insertion, in the recurrence matrix is corresponded to
+ * a movement to the right, deletion, or viceversa. Analogously when m > n only
+ * a maximum of k insertions/deletions operations can be left unpaired. This
+ * makes the required strip size to be k + 1 cells.
+ *
+ * Call l = min(n, m). Place the string with length l on the y axis, and the
+ * other on the x axis. By doing this, the number of rows is equal or less than
+ * the number of columns and so the algorithm effectively runs in O(kl) Also, by
+ * this arrangement of s and t in the recurrence matrix, r indicates the forced
+ * number of unpaired deletions, i.e., since r>=0, there cannot be unpaired
+ * deletions. Observe that for there to be any insertion k must be equal or
+ * greater than 2.
+ *
+ * This arrangement leaves (k-r)/2 possible insertions (left) and (k-r)/2 + r
+ * possible deletions (right) --> (k-r)/2 + (k-r)/2 + r + 1 == k + 1
+ *
+ *
+ * 3rd observation: space O(k)
+ *
+ * As with the original levenshtein algorithm, only the current and last rows
+ * are needed (that is, when we don't do traceback because we need not the
+ * alignment path). By the previous observation, we just need 2 rows of k + 1
+ * cells. For this, considering the last row, the previous diagonal is actually
+ * in the same column (substitution) and the above cell is actually in the next
+ * column (deletion). Observe that by doing this, we're virtually creating a
+ * recurrence matrix of n * (k+1) being now the original diagonal in the middle
+ * column (-r) (matrix which could be used to do the traceback)
+ *
+ */
+longlong levenshtein_k(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error) {
+  const char *s = args->args[0];
+  const char *t = args->args[1];
+  const int k = *((int*) args->args[2]);
+
+  const int n = (s == NULL) ? 0 : args->lengths[0];
+  const int m = (t == NULL) ? 0 : args->lengths[1];
+
+  return _levenshtein_k_row(initid, s, n, t, m, k);
+}
+
+/*
+ * Row of levenshtein_k, and of the aggregates lowering k as they go: the
+ * prefilter, then the pattern compiled by the init, a value repeated across
+ * rows, or the banded kernels.
+ */
+inline longlong _levenshtein_k_row(UDF_INIT *initid, const char *s, const int n, const char *t, const int m,
+                                   const int k) {
+  UDF_SCRATCH *sc = (UDF_SCRATCH*) initid->ptr;
+  longlong dist;
+  BP_SCRATCH *bp;
+
+  //lower bounds first, most rows of a scan are far apart
+  if (_prefilter_row(initid, s, n, t, m, k, 0))
+    return k + 1;
+
+  //constant argument compiled by the init
+  if (sc != NULL && sc->compiled != NULL) {
+    dist = (sc->pattern_arg == 0)
+           ? _levenshtein_k_compiled(sc->pattern, sc->pattern_len, t, m, k, sc->compiled, &sc->trail)
+           : _levenshtein_k_compiled(sc->pattern, sc->pattern_len, s, n, k, sc->compiled, &sc->trail);
+    if (dist >= 0)
+      return dist;
+  }
+  //value repeated across rows, e.g. the outer side of a join
+  else if (k >= BP_K_CACHE_MIN_K && abs(n - m) <= k && (k + 1) * MIN(n, m) >= BP_K_CACHE_MIN_CELLS) {
+    //the scratch, and its trail, exists once a lookup succeeds
+    if ((bp = _bp_cache_lookup(initid, 0, s, n)) != NULL)
+      dist = _levenshtein_k_compiled(bp->compiled, n, t, m, k, bp, &((UDF_SCRATCH*) initid->ptr)->trail);
+    else if ((bp = _bp_cache_lookup(initid, 1, t, m)) != NULL)
+      dist = _levenshtein_k_compiled(bp->compiled, m, s, n, k, bp, &((UDF_SCRATCH*) initid->ptr)->trail);
+    else
+      dist = -1;
+    if (dist >= 0)
+      return dist;
+  }
+
+  if (MIN(n, m) < LEVENSHTEIN_K_BP_MIN_LEN || k < LEVENSHTEIN_K_BP_MIN_K)
+    return _levenshtein_k_core(s, n, t, m, k);
+
+  //long strings: banded bit-parallel kernel, scratch kept for the following rows
+  bp = _bp_scratch_for(initid, MIN(n, m));
+  if (bp == NULL)
+    return _levenshtein_k_core(s, n, t, m, k);
+
+  return _levenshtein_k_bp_core(s, n, t, m, k, bp);
+}
+
+inline longlong _levenshtein_k_core(const char *s, const int s_len, const char *t, const int t_len, const int k) {
+
+  int n = (s == NULL) ? 0 : s_len;
+  int m = (t == NULL) ? 0 : t_len;
+
+  //order the strings so that the first always has the minimum length l
+  if (n > m) {
+    int aux = n;
+    n = m;
+    m = aux;
+    const char *auxs = s;
+    s = t;
+    t = auxs;
+  }
+
+  const int ignore = k + 1; //lev dist between s and t is at least greater than k
+  const int r = m - n;
+
+  if (0 == n)
+    return (m > k) ? ignore : m;
+  if (0 == m)
+    return (n > k) ? ignore : n;
+  if (r > k)
+    return ignore;
+
+  const int lsize = (((k > m) ? m : k) - r) / 2; //left space for insertions
+  const int rsize = lsize + r; //right space for deletions, rsize >= lsize (rsize == lsize iff r == 0)
+  const int stripsize = lsize + rsize + 1; // + 1 for the diagonal cell
+  const int stripsizem1 = stripsize - 1; //see later, not to repeat calculations
+
+  int d[2 * stripsize]; //Current and last rows
+  int currentrow;
+  int lastrow;
+
+  /* Initialization */
+
+  //currentrow = 0
+  int i;
+  for (i = lsize; i < stripsize; i++) //start from diagonal cell
+    d[i] = i - lsize;
+
+  /* Recurrence */
+
+  currentrow = stripsize;
+  lastrow = 0;
+
+  //j index for virtual recurrence matrix, jv index for rows
+  //bl & br = left & right bounds for j
+  int j, jv, bl, br;
+  int im1 = 0, jm1;
+  int a, b, c, min; //for minimum function, coded directly here for maximum speed
+  for (i = 1; i <= n; i++) {
+
+    //bl = max(i - lsize, 0), br = min(i + rsize, m)
+    bl = i - lsize;
+    if (bl < 0) {
+      jv = abs(bl); //no space for all allowed insertions
+      bl = 0;
+    }
+    else
+      jv = 0;
+    br = i + rsize;
+    if (br > m)
+      br = m;
+
+    jm1 = bl - 1;
+    for (j = bl; j <= br; j++) {
+      if (0 == j) //postponed part of initialization
+        d[currentrow + jv] = i;
+      else {
+        //By observation 3, the indices change for the lastrow (always +1)
+        if (s[im1] == t[jm1]) {
+          d[currentrow + jv] = d[lastrow + jv];
+        }
+        else {
+          //get the minimum of these 3 operations
+          a = (0 == jv) ? ignore : d[currentrow + jv - 1]; //deletion
+          b = (stripsizem1 == jv) ? ignore : d[lastrow + jv + 1]; //insertion
+          c = d[lastrow + jv]; //substitution
+
+          min = a;
+          if (b < min)
+            min = b;
+          if (c < min)
+            min = c;
+
+          d[currentrow + jv] = min + 1;
+        }
+      }
+      jv++;
+      jm1 = j;
+    }
+
+    //obsv: the cost of a following diagonal never decreases
+    if (d[currentrow + lsize + r] > k)
+      return ignore;
+
+    im1 = i;
+
+    //swap
+    currentrow = currentrow ^ stripsize;
+    lastrow = lastrow ^ stripsize;
+  }
+
+  //only here if levenhstein(s, t) <= k
+  return (longlong) d[lastrow + lsize + r]; //d[n, m]
+}
+
+/*
+ * Banded bit-parallel variant of _levenshtein_k_core for long strings
+ * (see H. Hyyro, K. Fredriksson, G. Navarro, Increased bit-parallelism for
+ * approximate and multiple string matching, and the block based band of
+ * Myers' algorithm used by edlib, M. Sosic, M. Sikic, 2017)
+ *
+ * The strip of the scalar core, rows j - rsize .. j + lsize of column j, is
+ * covered by the 64 row blocks of _levenshtein_bp_blocks which intersect it:
+ * ceil((k + 1) / 64) + 1 blocks per column at most. Blocks are entered at the
+ * bottom when the strip reaches them and left at the top once it has passed.
+ *
+ * Cells outside the strip are never needed exactly. Whenever a block is
+ * entered or the block above it is left, the missing neighbour is assumed to
+ * be +1 away (vertical deltas of a new block, horizontal carry into the top
+ * block), which can only overestimate the recurrence. Any alignment with cost
+ * <= k stays inside the strip, so every cell on it is still exact.
+ *
+ * As in the scalar core, the cost of the main diagonal (-r) never decreases:
+ * once it passes k the computation stops.
+ */
+static longlong _levenshtein_k_bp_band(const unsigned char *s, const int n,
+                                       const unsigned char *t, const int m, const int k, BP_SCRATCH *bp) {
+  const int ignore = k + 1;
+  const int r = m - n;
+  const int lsize = (((k > m) ? m : k) - r) / 2; //left space for insertions
+  const int rsize = lsize + r; //right space for deletions
+
+  const int words = BP_WORDS(n);
+  const int lastb = words - 1;
+  const int lastbit = (n - 1) % BP_WORD_BITS;
+  const uint64_t high = 1ULL << (BP_WORD_BITS - 1);
+  const uint64_t last = 1ULL << lastbit;
+  uint64_t *peq = bp->peq, *pv = bp->pv, *mv = bp->mv;
+  int64_t *score = bp->score;
+  uint64_t eq, xv, xh, ph, mh, p, q, top, above;
+  longlong diag, result;
+  int i, j, b, fb = 0, lb = -1, hin, hout;
+
+  result = ignore;
+  for (j = 1; j <= m; j++) {
+    //strip of column j: rows MAX(1, j - rsize) .. MIN(n, j + lsize), row i is bit i - 1
+    const int nfb = (MAX(1, j - rsize) - 1) / BP_WORD_BITS;
+    const int nlb = (MIN(n, j + lsize) - 1) / BP_WORD_BITS;
+
+    while (lb < nlb) { //enter a block, vertical deltas all +1 below the block above
+      lb++;
+      pv[lb] = ~0ULL;
+      mv[lb] = 0;
+      score[lb] = ((lb == 0) ? 0 : score[lb - 1]) + ((lb == lastb) ? lastbit + 1 : BP_WORD_BITS);
+    }
+    fb = nfb;
+
+    const uint64_t *eqc = peq + t[j - 1] * words;
+    hin = 1; //d[0, j] = j, or the block above was left
+
+    for (b = fb; b <= lb; b++) {
+      eq = eqc[b];
+      p = pv[b];
+      q = mv[b];
+
+      xv = eq | q;
+      if (hin < 0)
+        eq |= 1;
+      xh = (((eq & p) + p) ^ p) | eq;
+      ph = q | ~(xh | p);
+      mh = p & xh;
+
+      top = (b == lastb) ? last : high;
+      hout = (ph & top) ? 1 : ((mh & top) ? -1 : 0);
+
+      ph <<= 1;
+      mh <<= 1;
+      if (hin < 0)
+        mh |= 1;
+      else if (hin > 0)
+        ph |= 1;
+
+      pv[b] = mh | ~(xv | ph);
+      mv[b] = ph & xv;
+      score[b] += hout;
+      hin = hout;
+    }
+
+    //obsv: the cost of a following diagonal never decreases, d[i, i + r] with i = j - r
+    i = j - r;
+    if (i >= 1) {
+      b = (i - 1) / BP_WORD_BITS;
+      above = ~((2ULL << ((i - 1) % BP_WORD_BITS)) - 1); //rows i + 1 .. end of block
+      if (b == lastb)
+        above &= (2ULL << lastbit) - 1;
+      diag = score[b] - __builtin_popcountll(pv[b] & above) + __builtin_popcountll(mv[b] & above);
+      if (diag > k)
+        break;
+    }
+  }
+
+  //only complete if levenshtein(s, t) <= k
+  if (j > m)
+    result = score[lastb]; //d[n, m]
+
+  return result;
+}
+
+inline longlong _levenshtein_k_bp_core(const char *s, const int s_len, const char *t, const int t_len, const int k,
+                                       BP_SCRATCH *bp) {
+  int n = (s == NULL) ? 0 : s_len;
+  int m = (t == NULL) ? 0 : t_len;
+  const int compiled = (s != NULL && s == bp->compiled);
+  longlong result;
+
+  //the band needs the shorter string as the pattern, a compiled pattern may not be
+  if (compiled && n > m)
+    return _levenshtein_k_core(s, n, t, m, k);
+
+  //order the strings so that the first always has the minimum length l
+  if (n > m) {
+    int aux = n;
+    n = m;
+    m = aux;
+    const char *auxs = s;
+    s = t;
+    t = auxs;
+  }
+
+  const int ignore = k + 1; //lev dist between s and t is at least greater than k
+  const int r = m - n;
+
+  if (0 == n)
+    return (m > k) ? ignore : m;
+  if (r > k)
+    return ignore;
+
+  if (!compiled)
+    _bp_peq_set(bp->peq, (const unsigned char *) s, n);
+  result = _levenshtein_k_bp_band((const unsigned char *) s, n, (const unsigned char *) t, m, k, bp);
+  if (!compiled)
+    _bp_peq_clear(bp->peq, (const unsigned char *) s, n);
+
+  return result;
+}
+
+/*
+ * One word variant of _levenshtein_bp_1w bounded by k, for a pattern whose
+ * masks are already set: the cost of the diagonal ending in d[n, m] never
+ * decreases, so once its cell in the current column, d[i, j] with
+ * i = j + n - m, passes k the computation stops. d[i, j] is the score of the
+ * last row minus the vertical deltas of rows i + 1 .. n.
+ *
+ * The columns do not depend on the length of t, only on its prefix: with a
+ * trail their states are kept, and the first from columns, shared with the
+ * previous row, are not computed again (from > 0 only with a trail).
+ */
+static inline longlong _levenshtein_k_bp_1w(const unsigned char *s, const int n,
+                                            const unsigned char *t, const int m, const int k, const uint64_t *peq,
+                                            BP_TRAIL *tr, const int from) {
+  const uint64_t last = 1ULL << (n - 1);
+  const uint64_t rows = last | (last - 1);
+  uint64_t pv = ~0ULL, mv = 0, eq, xv, xh, ph, mh, below;
+  longlong score = n;
+  int i, j;
+
+  if (from > 0) {
+    pv = tr->pv[from - 1];
+    mv = tr->mv[from - 1];
+    score = tr->score[from - 1];
+  }
+
+  for (j = from; j < m; j++) {
+    eq = peq[t[j]];
+    xv = eq | mv;
+    xh = (((eq & pv) + pv) ^ pv) | eq;
+    ph = mv | ~(xh | pv);
+    mh = pv & xh;
+
+    if (ph & last)
+      score++;
+    else if (mh & last)
+      score--;
+
+    ph = (ph << 1) | 1; //first row is d[0, j] = j, always +1
+    mh <<= 1;
+    pv = mh | ~(xv | ph);
+    mv = ph & xv;
+
+    if (tr != NULL) {
+      tr->text[j] = t[j];
+      tr->pv[j] = pv;
+      tr->mv[j] = mv;
+      tr->score[j] = score;
+    }
+
+    i = j + 1 + n - m;
+    if ((j & 3) == 3 && i >= 1) { //every 4 columns, popcounts cost more than the column
+      below = rows & ~((1ULL << (i - 1) << 1) - 1); //rows i + 1 .. n
+      if (score - __builtin_popcountll(pv & below) + __builtin_popcountll(mv & below) > k) {
+        if (tr != NULL)
+          tr->len = j + 1;
+        return k + 1;
+      }
+    }
+  }
+
+  if (tr != NULL)
+    tr->len = m;
+  return MIN(score, k + 1);
+}
+
+/*
+ * A compiled pattern p of up to 64 characters is scored in O(m) by the one
+ * word kernel whatever k, resuming after the prefix o shares with the previous
+ * row when given its trail; a longer one still goes through the band when it
+ * is the shorter string. -1 if neither applies.
+ */
+inline longlong _levenshtein_k_compiled(const char *p, const int p_len, const char *o, const int o_len, const int k,
+                                        BP_SCRATCH *bp, BP_TRAIL *tr) {
+  int from = 0;
+
+  if (abs(o_len - p_len) > k)
+    return k + 1;
+  if (0 == p_len || 0 == o_len)
+    return MAX(p_len, o_len);
+  if (p_len <= BP_WORD_BITS) {
+    if (tr != NULL && (from = _bp_trail_resume(tr, bp, o, o_len)) < 0) {
+      tr = NULL; //out of memory, from scratch
+      from = 0;
+    }
+    return _levenshtein_k_bp_1w((const unsigned char *) p, p_len, (const unsigned char *) o, o_len, k, bp->peq,
+                                tr, from);
+  }
+  if (p_len <= o_len && k >= LEVENSHTEIN_K_BP_MIN_K)
+    return _levenshtein_k_bp_core(p, p_len, o, o_len, k, bp);
+  return -1;
+}
+
+//-------------------------------------------------------------------------
+
+my_bool levenshtein_k_ratio_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
+  if ((args->arg_count != 3) ||
+      (args->arg_type[0] != STRING_RESULT || args->arg_type[1] != STRING_RESULT || args->arg_type[2] != INT_RESULT)) {
+    strcpy(message, "Function requires 3 arguments, (string, string, int)");
+    return 1;
+  }
+
+  initid->ptr = NULL;
+  initid->max_length = LEVENSHTEIN_MAX;
+  initid->maybe_null = 0; //doesn't return null
+
+  //a constant string is compiled once for all the rows
+  if (_udf_pattern_init(initid, args, (args->args[0] != NULL) ? 0 : 1, PATTERN_COMPILE)) {
+    _udf_scratch_free(initid);
+    strcpy(message, "Not enough memory for the constant argument");
+    return 1;
+  }
+
+  return 0;
+}
+
+void levenshtein_k_ratio_deinit(UDF_INIT *initid) {
+    _udf_scratch_free(initid);
+}
+
+double levenshtein_k_ratio(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error) {
+  const char *s = args->args[0];
+  const char *t = args->args[1];
+  const int k = *((int*) args->args[2]);
+
+  int n = (s == NULL) ? 0 : args->lengths[0];
+  int m = (t == NULL) ? 0 : args->lengths[1];
+  double maxlen = MAX(n, m);
+  if (maxlen == 0)
+    return 0.0;
+
+  double dist = (double)levenshtein_k(initid, args, is_null, error);
+  if (dist > k)
+    return 0.0;
+  else
+    return 1.0 - dist/maxlen;
+}
+
+/*
+ * Lowest distance, bounded by k as by _levenshtein_k_core, between s and the
+ * windows of length n of t, n <= m. A needle of up to 64 characters is matched
+ * against every window by the one word kernel on its masks, see
+ * _bp_needle_set (folded by ft unless NULL); a longer one goes through the
+ * scalar core, with ft on strings already folded.
+ */
+static longlong _levenshtein_substring_k_windows(const char *s, const int n, const char *t, const int m, const int k,
+                                                 BP_SCRATCH *bp, const FOLD_TABLE *ft) {
+  longlong lowest_dist = LLONG_MAX;
+  longlong dist = 0;
+
+  unsigned int index = 0;
+
+  if (bp != NULL && n > 0 && n <= BP_WORD_BITS) {
+    const int masks = _bp_needle_set(bp, s, n, ft);
+
+    while (index <= (m - n)) {
+      dist = _levenshtein_k_bp_1w((const unsigned char *) s, n, (const unsigned char *) t + index, n, k, bp->peq,
+                                  NULL, 0);
+      if (dist < lowest_dist)
+          lowest_dist = dist;
+
+      index++;
+      if (lowest_dist == 1)
+          break;
+    }
+
+    if (masks)
+      _bp_needle_clear(bp, n, ft);
+    return lowest_dist;
+  }
+
+  while (index <= (m - n)) {
+    dist = _levenshtein_k_core(s, n, t, n, k);
+    if (dist < lowest_dist)
+        lowest_dist = dist;
+
+    (void)*t++;
+    index++;
+    if (lowest_dist == 1)
+        return lowest_dist;
+  }
+
+  return lowest_dist;
+}
+
+//-------------------------------------------------------------------------
+
+my_bool levenshtein_substring_k_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
+  // sanitizing input parameters
+  if ((args->arg_count != 3) ||
+      (args->arg_type[0] != STRING_RESULT || args->arg_type[1] != STRING_RESULT || args->arg_type[2] != INT_RESULT)) {
+    strcpy(message, "Function requires 3 arguments, (string, string, int)");
+    return 1;
+  }
+
+  initid->ptr = NULL;
+  initid->max_length = LEVENSHTEIN_MAX;
+  initid->maybe_null = 0; //doesn't return null
+
+  //a constant pattern is stripped and compiled once for all the rows
+  if (_udf_pattern_init(initid, args, 0, PATTERN_STRIP | PATTERN_COMPILE)) {
+    _udf_scratch_free(initid);
+    strcpy(message, "Not enough memory for the constant argument");
+    return 1;
+  }
+
+  return 0;
+}
+
+/**
+ *  deallocate memory, clean and close
+ */
+void levenshtein_substring_k_deinit(UDF_INIT *initid) {
+    _udf_scratch_free(initid);
+}
+
+longlong levenshtein_substring_k(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error) {
+  const UDF_SCRATCH *sc = (UDF_SCRATCH*) initid->ptr;
+  const char *s = args->args[0];
+  const char *t = args->args[1];
+
+  const int k = *((int*) args->args[2]);
+
+  int n = (s == NULL) ? 0 : args->lengths[0]; /*contains pattern*/
+  int m = (t == NULL) ? 0 : args->lengths[1]; /*contains row*/
+
+  //normalized in a single pass each, in the arena of the statement
+  _arena_reset(initid);
+  const char *s_stripped;
+  if (sc != NULL && sc->pattern != NULL) {
+    s_stripped = sc->pattern;
+    n = sc->pattern_len;
+  }
+  else
+    s_stripped = _arena_normalize(initid, s, n, PATTERN_STRIP, &n);
+  const char *t_stripped = _arena_normalize(initid, t, m, PATTERN_STRIP, &m);
+  if (s_stripped == NULL || t_stripped == NULL) {
+    *error = 1;
+    return 0;
+  }
+
+  //order the strings so that the first always has the minimum length l
+  if (n > m) {
+    int aux = n;
+    n = m;
+    m = aux;
+    const char *auxs = s_stripped;
+    s_stripped = t_stripped;
+    t_stripped = auxs;
+  }
+
+  //the masks of the needle serve all the windows, compiled when it is the constant pattern
+  BP_SCRATCH *bp = NULL;
+  if (n <= BP_WORD_BITS) {
+    bp = (sc != NULL && s_stripped == sc->pattern) ? sc->compiled : _bp_scratch_for(initid, n);
+    if (bp == NULL) {
+      *error = 1;
+      return 0;
+    }
+  }
+
+  return _levenshtein_substring_k_windows(s_stripped, n, t_stripped, m, k, bp, NULL);
+}
+
+//-------------------------------------------------------------------------
+
+my_bool levenshtein_substring_ci_k_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
+  // sanitizing input parameters
+  if ((args->arg_count != 3 && args->arg_count != 4) ||
+      (args->arg_type[0] != STRING_RESULT || args->arg_type[1] != STRING_RESULT || args->arg_type[2] != INT_RESULT) ||
+      (args->arg_count == 4 && args->arg_type[3] != STRING_RESULT)) {
+    strcpy(message, "Function requires 3 or 4 arguments, (string, string, int[, collation])");
+    return 1;
+  }
+
+  initid->ptr = NULL;
+  initid->max_length = LEVENSHTEIN_MAX;
+  initid->maybe_null = 0; //doesn't return null
+
+  if (_udf_collation_init(initid, args, 3, message)) {
+    _udf_scratch_free(initid);
+    return 1;
+  }
+
+  //a constant pattern is stripped, folded and compiled once for all the rows;
+  //under utf8mb4 only its ASCII bytes are folded, the rest per code point
+  const UDF_SCRATCH *sc = (UDF_SCRATCH*) initid->ptr;
+  const int flags = (sc != NULL && sc->collation == COLLATION_UTF8MB4)
+                    ? PATTERN_STRIP | PATTERN_FOLD : PATTERN_STRIP | PATTERN_FOLD | PATTERN_COMPILE;
+  if (_udf_pattern_init(initid, args, 0, flags)) {
+    _udf_scratch_free(initid);
+    strcpy(message, "Not enough memory for the constant argument");
+    return 1;
+  }
+
+  return 0;
+}
+
+/**
+ *  deallocate memory, clean and close
+ */
+void levenshtein_substring_ci_k_deinit(UDF_INIT *initid) {
+    _udf_scratch_free(initid);
+}
+
+longlong levenshtein_substring_ci_k(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error) {
+  const UDF_SCRATCH *sc = (UDF_SCRATCH*) initid->ptr;
+  const char *s = args->args[0];
+  const char *t = args->args[1];
+
+  const int k = *((int*) args->args[2]);
+  const int collation = (sc == NULL) ? COLLATION_ASCII : sc->collation;
+  const FOLD_TABLE *ft = _fold_table(collation);
+
+  int n = (s == NULL) ? 0 : args->lengths[0]; /*contains pattern*/
+  int m = (t == NULL) ? 0 : args->lengths[1]; /*contains row*/
+
+  //stripped in a single pass each, in the arena of the statement; the case
+  //is folded by the masks of the needle, the strings are not lowercased
+  _arena_reset(initid);
+  char *s_row = NULL;
+  const char *s_stripped;
+  if (sc != NULL && sc->pattern != NULL) {
+    s_stripped = sc->pattern;
+    n = sc->pattern_len;
+  }
+  else
+    s_stripped = s_row = _arena_normalize(initid, s, n, PATTERN_STRIP, &n);
+  char *t_row = _arena_normalize(initid, t, m, PATTERN_STRIP, &m);
+  if (s_stripped == NULL || t_row == NULL) {
+    *error = 1;
+    return 0;
+  }
+
+  //multibyte characters are folded as code points, pure ASCII rows as bytes
+  if (collation == COLLATION_UTF8MB4 && !(_utf8_is_ascii(s_stripped, n) && _utf8_is_ascii(t_row, m)))
+    return _utf8_substring_core(initid, s_stripped, n, t_row, m, 0, k, error);
+
+  //only the scalar core of the longer needles compares folded copies (a constant pattern is folded by the init)
+  if (MIN(n, m) > BP_WORD_BITS) {
+    if (s_row != NULL)
+      _fold_bytes(s_row, n, ft);
+    _fold_bytes(t_row, m, ft);
+  }
+  const char *t_stripped = t_row;
+
+  //order the strings so that the first always has the minimum length l
+  if (n > m) {
+    int aux = n;
+    n = m;
+    m = aux;
+    const char *auxs = s_stripped;
+    s_stripped = t_stripped;
+    t_stripped = auxs;
+  }
+
+  //the masks of the needle serve all the windows, compiled when it is the constant pattern
+  BP_SCRATCH *bp = NULL;
+  if (n <= BP_WORD_BITS) {
+    bp = (sc != NULL && s_stripped == sc->pattern && sc->compiled != NULL) ? sc->compiled : _bp_scratch_for(initid, n);
+    if (bp == NULL) {
+      *error = 1;
+      return 0;
+    }
+  }
+
+  return _levenshtein_substring_k_windows(s_stripped, n, t_stripped, m, k, bp, ft);
+}
+
+//-------------------------------------------------------------------------
+
+my_bool levenshtein_best_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
+  unsigned int i;
+
+  if ((args->arg_count < 3) ||
+      (args->arg_type[0] != STRING_RESULT || args->arg_type[1] != INT_RESULT)) {
+    strcpy(message, "Function requires at least 3 arguments, (string, int, string, ...)");
+    return 1;
+  }
+
+  //candidates are compared as strings
+  for (i = 2; i < args->arg_count; i++)
+    args->arg_type[i] = STRING_RESULT;
+
+  initid->ptr = NULL; //candidate lengths, allocated by the first row
+  initid->max_length = LENGTH_MAX;
+  initid->maybe_null = 1; //null when no candidate is within k
+
+  //a constant pattern is compiled once for all the rows
+  if (_udf_pattern_init(initid, args, 0, PATTERN_COMPILE)) {
+    _udf_scratch_free(initid);
+    strcpy(message, "Not enough memory for the constant argument");
+    return 1;
+  }
+
+  return 0;
+}
+
+/**
+ *  deallocate memory, clean and close
+ */
+void levenshtein_best_deinit(UDF_INIT *initid) {
+    _udf_scratch_free(initid);
+}
+
+char *levenshtein_best(UDF_INIT *initid, UDF_ARGS *args, char *result,
+                       unsigned long *length, char *is_null, char *error) {
+  const UDF_SCRATCH *sc = (UDF_SCRATCH*) initid->ptr;
+  const char *s = args->args[0];
+  const int n = (s == NULL) ? 0 : args->lengths[0];
+  const int k = (args->args[1] == NULL) ? 0 : *((int*) args->args[1]);
+  const int count = args->arg_count - 2;
+  longlong best, dist;
+  int i;
+
+  _arena_reset(initid);
+  int *c_len = (int *) _arena_alloc(initid, count * sizeof(int));
+  BP_SCRATCH *bp = (sc != NULL && sc->compiled != NULL) ? sc->compiled : _bp_cache_lookup(initid, 0, s, n);
+  if (bp == NULL)
+    bp = _bp_scratch_for(initid, n);
+  if (c_len == NULL || bp == NULL) {
+    *error = 1;
+    return NULL;
+  }
+
+  for (i = 0; i < count; i++)
+    c_len[i] = args->lengths[i + 2];
+
+  if (bp->compiled != NULL)
+    s = bp->compiled;
+  best = _levenshtein_best_core(s, n, (const char **) args->args + 2, c_len, count, k, &dist, bp,
+                                _prefilter_for(initid));
+  if (best < 0) {
+    *is_null = 1;
+    return NULL;
+  }
+
+  *length = snprintf(result, LENGTH_MAX, "[%lld, %lld]", best + 1, dist);
+  return result;
+}
+
+/*
+ * Candidates are skipped when a lower bound of _prefilter_k, their length
+ * first, puts them further than k (or further than the best one so far) from
+ * s; the counts of s stay loaded for the whole list. With a pattern of at most 64
+ * characters the others are scored BP_SIMD_MAX_LANES at a time by the batch
+ * kernel, one candidate per SIMD lane; scoring stops at the first exact match.
+ */
+inline longlong _levenshtein_best_core(const char *s, const int s_len, const char **c, const int *c_len,
+                                       const int count, const int k, longlong *dist, BP_SCRATCH *bp,
+                                       PREFILTER *pf) {
+  const int n = (s == NULL) ? 0 : s_len;
+  const int compiled = (s != NULL && s == bp->compiled);
+  const unsigned char *lc[BP_SIMD_MAX_LANES];
+  int ll[BP_SIMD_MAX_LANES], li[BP_SIMD_MAX_LANES];
+  longlong ld[BP_SIMD_MAX_LANES], best = -1, d;
+  int i = 0, l, nl;
+
+  *dist = (longlong) MAX(k, 0) + 1;
+
+  if (_bp_simd.levenshtein_batch != NULL && n > 0 && n <= BP_WORD_BITS) {
+    if (!compiled)
+      _bp_peq_set(bp->peq, (const unsigned char *) s, n);
+
+    while (i < count && *dist > 0) {
+      for (nl = 0; nl < _bp_simd.lanes && i < count; i++) {
+        if (c[i] != NULL && !_prefilter_k(pf, s, n, c[i], c_len[i], (int) *dist - 1, 0, 1)) {
+          lc[nl] = (const unsigned char *) c[i];
+          ll[nl] = c_len[i];
+          li[nl++] = i;
+        }
+      }
+      if (nl == 0)
+        break;
+      for (l = nl; l < _bp_simd.lanes; l++) {
+        lc[l] = lc[0];
+        ll[l] = 0;
+      }
+
+      _bp_simd.levenshtein_batch((const unsigned char *) s, n, lc, ll, ld, bp->peq);
+      for (l = 0; l < nl; l++) {
+        if (ld[l] < *dist) {
+          *dist = ld[l];
+          best = li[l];
+        }
+      }
+    }
+
+    if (!compiled)
+      _bp_peq_clear(bp->peq, (const unsigned char *) s, n);
+    _prefilter_unload(pf);
+    return best;
+  }
+
+  for (; i < count && *dist > 0; i++) {
+    if (c[i] == NULL || _prefilter_k(pf, s, n, c[i], c_len[i], (int) *dist - 1, 0, 1))
+      continue;
+    d = _levenshtein_bp_core(s, n, c[i], c_len[i], bp);
+    if (d < *dist) {
+      *dist = d;
+      best = i;
+    }
+  }
+
+  _prefilter_unload(pf);
+  return best;
+}
+
+//-------------------------------------------------------------------------
+
+my_bool levenshtein_best_json_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
+  if ((args->arg_count != 3) ||
+      (args->arg_type[0] != STRING_RESULT || args->arg_type[1] != INT_RESULT || args->arg_type[2] != STRING_RESULT)) {
+    strcpy(message, "Function requires 3 arguments, (string, int, json array of strings)");
+    return 1;
+  }
+
+  initid->ptr = NULL; //parsed candidates, allocated by the first row
+  initid->max_length = LENGTH_MAX;
+  initid->maybe_null = 1; //null when no candidate is within k
+
+  //a constant pattern is compiled once for all the rows
+  if (_udf_pattern_init(initid, args, 0, PATTERN_COMPILE)) {
+    _udf_scratch_free(initid);
+    strcpy(message, "Not enough memory for the constant argument");
+    return 1;
+  }
+
+  return 0;
+}
+
+/**
+ *  deallocate memory, clean and close
+ */
+void levenshtein_best_json_deinit(UDF_INIT *initid) {
+    _udf_scratch_free(initid);
+}
+
+char *levenshtein_best_json(UDF_INIT *initid, UDF_ARGS *args, char *result,
+                            unsigned long *length, char *is_null, char *error) {
+  const UDF_SCRATCH *sc = (UDF_SCRATCH*) initid->ptr;
+  const char *s = args->args[0];
+  const int n = (s == NULL) ? 0 : args->lengths[0];
+  const int k = (args->args[1] == NULL) ? 0 : *((int*) args->args[1]);
+  const char *json = args->args[2];
+  const size_t len = (json == NULL) ? 0 : args->lengths[2];
+  const size_t max_items = len / 2 + 1; //every element takes at least 2 bytes, "" or null
+  longlong best, dist;
+  int count;
+
+  if (json == NULL) {
+    *is_null = 1;
+    return NULL;
+  }
+
+  //items, then the unescaped strings
+  _arena_reset(initid);
+  char *buf = (char *) _arena_alloc(initid, max_items * sizeof(char *) + len);
+  int *c_len = (int *) _arena_alloc(initid, max_items * sizeof(int));
+  BP_SCRATCH *bp = (sc != NULL && sc->compiled != NULL) ? sc->compiled : _bp_cache_lookup(initid, 0, s, n);
+  if (bp == NULL)
+    bp = _bp_scratch_for(initid, n);
+  if (buf == NULL || c_len == NULL || bp == NULL) {
+    *error = 1;
+    return NULL;
+  }
+
+  const char **items = (const char **) buf;
+  count = _json_string_array(json, len, items, c_len, buf + max_items * sizeof(char *));
+  if (count < 0) {
+    *error = 1;
+    return NULL;
+  }
+
+  if (bp->compiled != NULL)
+    s = bp->compiled;
+  best = _levenshtein_best_core(s, n, items, c_len, count, k, &dist, bp, _prefilter_for(initid));
+  if (best < 0) {
+    *is_null = 1;
+    return NULL;
+  }
+
+  *length = snprintf(result, LENGTH_MAX, "[%lld, %lld]", best + 1, dist);
+  return result;
+}
+
+/**
+ * @result value of the 4 hex digits at p, -1 if they are not hex digits
+ */
+static int _json_hex4(const char *p) {
+  int i, v = 0;
+
+  for (i = 0; i < 4; i++) {
+    const char h = p[i];
+    v <<= 4;
+    if (h >= '0' && h <= '9')
+      v |= h - '0';
+    else if (h >= 'a' && h <= 'f')
+      v |= h - 'a' + 10;
+    else if (h >= 'A' && h <= 'F')
+      v |= h - 'A' + 10;
+    else
+      return -1;
+  }
+
+  return v;
+}
+
+/*
+ * Strings are unescaped into buf, one after another; \uXXXX escapes (and
+ * surrogate pairs) become UTF-8, which is never longer than the escape, so len
+ * bytes of buf are always enough.
+ */
+inline int _json_string_array(const char *json, const size_t len, const char **items, int *items_len, char *buf) {
+  const char *p = json, *end = json + len;
+  int count = 0, cp, lo;
+
+  while (p < end && isspace((unsigned char) *p))
+    p++;
+  if (p == end || *p++ != '[')
+    return -1;
+  while (p < end && isspace((unsigned char) *p))
+    p++;
+
+  if (p < end && *p == ']')
+    p++;
+  else {
+    for (;;) {
+      while (p < end && isspace((unsigned char) *p))
+        p++;
+      if (p == end)
+        return -1;
+
+      if (*p == '"') {
+        char *o = buf;
+        for (p++; p < end && *p != '"'; ) {
+          if (*p != '\\') {
+            *o++ = *p++;
+            continue;
+          }
+          if (++p == end)
+            return -1;
+          switch (*p++) {
+            case '"':  *o++ = '"';  break;
+            case '\\': *o++ = '\\'; break;
+            case '/':  *o++ = '/';  break;
+            case 'b':  *o++ = '\b'; break;
+            case 'f':  *o++ = '\f'; break;
+            case 'n':  *o++ = '\n'; break;
+            case 'r':  *o++ = '\r'; break;
+            case 't':  *o++ = '\t'; break;
+            case 'u':
+              if (end - p < 4 || (cp = _json_hex4(p)) < 0)
+                return -1;
+              p += 4;
+              if (cp >= 0xD800 && cp <= 0xDBFF && end - p >= 6 && p[0] == '\\' && p[1] == 'u' &&
+                  (lo = _json_hex4(p + 2)) >= 0xDC00 && lo <= 0xDFFF) {
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                p += 6;
+              }
+              if (cp < 0x80)
+                *o++ = (char) cp;
+              else if (cp < 0x800) {
+                *o++ = (char) (0xC0 | (cp >> 6));
+                *o++ = (char) (0x80 | (cp & 0x3F));
+              }
+              else if (cp < 0x10000) {
+                *o++ = (char) (0xE0 | (cp >> 12));
+                *o++ = (char) (0x80 | ((cp >> 6) & 0x3F));
+                *o++ = (char) (0x80 | (cp & 0x3F));
+              }
+              else {
+                *o++ = (char) (0xF0 | (cp >> 18));
+                *o++ = (char) (0x80 | ((cp >> 12) & 0x3F));
+                *o++ = (char) (0x80 | ((cp >> 6) & 0x3F));
+                *o++ = (char) (0x80 | (cp & 0x3F));
+              }
+              break;
+            default:
+              return -1;
+          }
+        }
+        if (p == end)
+          return -1;
+        p++;
+
+        items[count] = buf;
+        items_len[count++] = o - buf;
+        buf = o;
+      }
+      else if (end - p >= 4 && memcmp(p, "null", 4) == 0) {
+        items[count] = NULL;
+        items_len[count++] = 0;
+        p += 4;
+      }
+      else
+        return -1;
+
+      while (p < end && isspace((unsigned char) *p))
+        p++;
+      if (p < end && *p == ',') {
+        p++;
+        continue;
+      }
+      if (p < end && *p == ']') {
+        p++;
+        break;
+      }
+      return -1;
+    }
+  }
+
+  while (p < end && isspace((unsigned char) *p))
+    p++;
+
+  return (p == end) ? count : -1;
+}
+
+/*
+ * Writes str escaped as inside a JSON string: '"' and '\\' as \" and \\, the
+ * control characters, and with ascii the bytes from 0x80 on as well, as \u00XX,
+ * so that any bytes, even a UTF-8 character cut in two, make valid JSON. out
+ * needs 6 * len bytes.
+ */
+inline char *_json_escape_to(char *out, const char *str, const int len, const int ascii) {
+  static const char hex[] = "0123456789abcdef";
+  int i;
+
+  for (i = 0; i < len; i++) {
+    const unsigned char c = (unsigned char) str[i];
+    if (c == '"' || c == '\\') {
+      *out++ = '\\';
+      *out++ = (char) c;
+    }
+    else if (c < 0x20 || (ascii && c >= 0x80)) {
+      memcpy(out, "\\u00", 4);
+      out[4] = hex[c >> 4];
+      out[5] = hex[c & 15];
+      out += 6;
+    }
+    else
+      *out++ = (char) c;
+  }
+
+  return out;
+}
+
+//-------------------------------------------------------------------------
+
+//! check parameters and allocate memory for MySql
+my_bool damerau_init(UDF_INIT *init, UDF_ARGS *args, char *message) {
+
+    // make sure user has provided three arguments
+    if (args->arg_count != 2) {
+        strncpy(message, "DAMERAU() requires three arguments", 80);
+        return 1;
+    } else {
+        // sanitize parameters
+        if ( args->arg_type[0] != STRING_RESULT ||
+            args->arg_type[1] != STRING_RESULT) {
+            strncpy(message, "DAMERAU() requires arguments (string, string", 80);
+            return 1;
+        }
+    }
+
+    init->ptr = NULL; //scratch, allocated by the first row
+
+    //a constant string is compiled once for all the rows
+    if (_udf_pattern_init(init, args, (args->args[0] != NULL) ? 0 : 1, PATTERN_COMPILE)) {
+        _udf_scratch_free(init);
+        strcpy(message, "Not enough memory for the constant argument");
+        return 1;
+    }
+
+    return 0;
+}
+
+//! check parameters akkd allocate memory for MySql
+longlong damerau(UDF_INIT *init, UDF_ARGS *args, char *is_null, char *error) {
+
+    // s is the first user-supplied argument; t is the second
+    const char *str1 = args->args[0];
+    const char *str2 = args->args[1];
+
+    const int len1 = (str1 == NULL) ? 0 : args->lengths[0];
+    const int len2 = (str2 == NULL) ? 0 : args->lengths[1];
+
+    //constant argument, its masks were compiled by the init
+    const UDF_SCRATCH *sc = (UDF_SCRATCH*) init->ptr;
+    if (sc != NULL && sc->compiled != NULL) {
+        if (sc->pattern_arg == 0)
+            return _damerau_bp_core(sc->pattern, sc->pattern_len, str2, len2, sc->compiled);
+        return _damerau_bp_core(sc->pattern, sc->pattern_len, str1, len1, sc->compiled);
+    }
+
+    //value repeated across rows, e.g. the outer side of a join
+    BP_SCRATCH *bp = _bp_cache_lookup(init, 0, str1, len1);
+    if (bp != NULL)
+        return _damerau_bp_core(bp->compiled, len1, str2, len2, bp);
+    bp = _bp_cache_lookup(init, 1, str2, len2);
+    if (bp != NULL)
+        return _damerau_bp_core(bp->compiled, len2, str1, len1, bp);
+
+    //unit costs: the bit-parallel kernel, no rows needed
+    bp = _bp_scratch_for(init, MIN(len1, len2));
+    if (bp == NULL) {
+        *error = 1;
+        return 0;
+    }
+
+    return _damerau_core(
+         str1, len1,
+         str2, len2,
+        /* swap */              1,
+        /* substitution */	    1,
+        /* insertion */         1,
+        /* deletion */          1,
+        NULL, bp
+    );
+}
+
+/**
+ *  deallocate memory, clean and close
+ */
+void damerau_deinit(UDF_INIT *initid) {
+    _udf_scratch_free(initid);
+}
+
+/**
+ * core levenshtein damerau_core function
+ *
+ * Optimal string alignment recurrence. With unit costs and a bit-parallel
+ * scratch it is computed by _damerau_bp_core. Otherwise only the rows i, i-1
+ * and i-2 (swap) of the matrix are alive at any time, so they are rolled
+ * through three rows of the shorter string's length + 1 (the strings are
+ * exchanged if needed, which exchanges the insert and delete costs).
+ *
+ * @param string str1 to compare
+ * @param int length1
+ * @param string str2 to compare, length s_len2
+ * @param int length2
+ * @param int costs to swap
+ * @param int costs to substitute
+ * @param int costs to insert
+ * @param int costs to delete
+ * @param int* scratch of at least 3 * (min(length1, length2) + 1) ints, may be NULL for unit costs
+ * @param BP_SCRATCH* bit-parallel scratch, may be NULL
+ *
+ * @time O(nm), quadratic
+ * @space O(min(n, m))
+ */
+inline longlong _damerau_core(const char *str1,int s_len1,
+                       const char * str2, int s_len2,
+                       const int swap_costs, const int substitute_costs, const int insert_costs, const int delete_costs,
+                       int *rows, BP_SCRATCH *bp) {
+
+    if (bp != NULL && swap_costs == 1 && substitute_costs == 1 && insert_costs == 1 && delete_costs == 1)
+        return _damerau_bp_core(str1, s_len1, str2, s_len2, bp);
+
+    int ins_costs = insert_costs, del_costs = delete_costs;
+    int *d2, *d1, *d0, *aux; //rows i-2, i-1 and i
+    int i, j, l_cost, v;
+
+    //keep the rows as short as possible
+    if (s_len2 > s_len1) {
+        const char *auxs = str1;
+        str1 = str2;
+        str2 = auxs;
+        i = s_len1;
+        s_len1 = s_len2;
+        s_len2 = i;
+        ins_costs = delete_costs;
+        del_costs = insert_costs;
+    }
+
+    d2 = rows;
+    d1 = d2 + s_len2 + 1;
+    d0 = d1 + s_len2 + 1;
+
+    for(j = 0; j<= s_len2; j++) {
+        d1[j] = j;
+    }
+    for (i = 1;i <= s_len1;i++) {
+        d0[0] = i;
+        for(j = 1; j<= s_len2; j++) {
+            if( str1[i-1] == str2[j-1] )
+                l_cost = 0;
+            else
+                l_cost = 1;
+
+            v = MIN(
+                d1[j] + del_costs,                   // delete
+                MIN(d0[j-1] + ins_costs,             // insert
+                    d1[j-1] + l_cost*substitute_costs)  // substitution
+            );
+            if( (i > 1) && (j > 1) &&
+                (str1[i-1] == str2[j-2]) && (str1[i-2] == str2[j-1])) {
+
+                v = MIN(
+                    v,
+                    d2[j-2] + l_cost*swap_costs         // swap
+                );
+            }
+            d0[j] = v;
+        }
+
+        aux = d2;
+        d2 = d1;
+        d1 = d0;
+        d0 = aux;
+    }
+    return d1[s_len2];
+}
+
+/*
+ * Bit-parallel optimal string alignment distance
+ * (see H. Hyyro, A bit-vector algorithm for computing Levenshtein and Damerau
+ * edit distances, Nordic Journal of Computing 10, 2003)
+ *
+ * Same column vectors as _levenshtein_bp_core, written with the diagonal
+ * zero deltas d0 (d[i, j] == d[i-1, j-1]). A transposition makes d[i, j] equal
+ * to d[i-2, j-2] + 1 = d[i-1, j-1] exactly when s[i-1] == t[j-2],
+ * s[i-2] == t[j-1] and the diagonal step into d[i-1, j-1] was not zero, which
+ * is one extra term of d0 built from the previous column's d0 and match mask:
+ *
+ *   tr = ((~d0' & eq) << 1) & eq'
+ *
+ * In the blocked variant the shift carries the top bit of the block above.
+ */
+static inline longlong _damerau_bp_1w(const unsigned char *s, const int n,
+                                      const unsigned char *t, const int m, uint64_t *peq) {
+  const uint64_t last = 1ULL << (n - 1);
+  uint64_t pv = ~0ULL, mv = 0, d0 = 0, eqold = 0, eq, tr, ph, mh;
+  longlong score = n;
+  int j;
+
+  for (j = 0; j < m; j++) {
+    eq = peq[t[j]];
+    tr = (((~d0) & eq) << 1) & eqold;
+    d0 = (((eq & pv) + pv) ^ pv) | eq | mv | tr;
+    ph = mv | ~(d0 | pv);
+    mh = pv & d0;
+
+    if (ph & last)
+      score++;
+    else if (mh & last)
+      score--;
+
+    ph = (ph << 1) | 1; //first row is d[0, j] = j, always +1
+    mh <<= 1;
+    pv = mh | ~(d0 | ph);
+    mv = ph & d0;
+    eqold = eq;
+  }
+
+  return score;
+}
+
+static inline longlong _damerau_bp_blocks(const unsigned char *s, const int n,
+                                          const unsigned char *t, const int m, BP_SCRATCH *bp) {
+  const int words = BP_WORDS(n);
+  const uint64_t last = 1ULL << ((n - 1) % BP_WORD_BITS);
+  uint64_t *peq = bp->peq, *pv = bp->pv, *mv = bp->mv, *d0 = bp->d0, *eqold = bp->eq;
+  uint64_t eq, x, tr, trc, dd, ph, mh, p, q, top;
+  longlong score = n;
+  int j, b, hin, hout;
+
+  for (b = 0; b < words; b++) {
+    pv[b] = ~0ULL;
+    mv[b] = 0;
+    d0[b] = 0;
+    eqold[b] = 0;
+  }
+
+  for (j = 0; j < m; j++) {
+    const uint64_t *eqc = peq + t[j] * words;
+    hin = 1; //first row is d[0, j] = j, always +1
+    trc = 0;
+
+    for (b = 0; b < words; b++) {
+      eq = eqc[b];
+      p = pv[b];
+      q = mv[b];
+
+      x = (~d0[b]) & eq;
+      tr = ((x << 1) | trc) & eqold[b];
+      trc = x >> (BP_WORD_BITS - 1);
+      eqold[b] = eq;
+
+      if (hin < 0)
+        eq |= 1;
+      dd = (((eq & p) + p) ^ p) | eq | q | tr;
+      ph = q | ~(dd | p);
+      mh = p & dd;
+
+      top = (b == words - 1) ? last : 1ULL << (BP_WORD_BITS - 1);
+      hout = (ph & top) ? 1 : ((mh & top) ? -1 : 0);
+
+      ph <<= 1;
+      mh <<= 1;
+      if (hin < 0)
+        mh |= 1;
+      else if (hin > 0)
+        ph |= 1;
+
+      pv[b] = mh | ~(dd | ph);
+      mv[b] = ph & dd;
+      d0[b] = dd;
+      hin = hout;
+    }
+
+    score += hin;
+  }
+
+  return score;
+}
+
+inline longlong _damerau_bp_core(const char *s, const int s_len, const char *t, const int t_len, BP_SCRATCH *bp) {
+  int n = (s == NULL) ? 0 : s_len;
+  int m = (t == NULL) ? 0 : t_len;
+  const int compiled = (s != NULL && s == bp->compiled);
+  longlong score = -1;
+
+  //order the strings so that the pattern (bit-vector side) is the shorter one, unless its masks are compiled
+  if (n > m && !compiled) {
+    int aux = n;
+    n = m;
+    m = aux;
+    const char *auxs = s;
+    s = t;
+    t = auxs;
+  }
+
+  if (0 == n)
+    return m;
+
+  if (!compiled)
+    _bp_peq_set(bp->peq, (const unsigned char *) s, n);
+
+  if (n <= BP_WORD_BITS)
+    score = _damerau_bp_1w((const unsigned char *) s, n, (const unsigned char *) t, m, bp->peq);
+  else if (_bp_simd.damerau != NULL && BP_WORDS(n) >= BP_SIMD_MIN_WORDS)
+    score = _bp_simd.damerau((const unsigned char *) s, n, (const unsigned char *) t, m, bp);
+  if (score < 0)
+    score = _damerau_bp_blocks((const unsigned char *) s, n, (const unsigned char *) t, m, bp);
+
+  if (!compiled)
+    _bp_peq_clear(bp->peq, (const unsigned char *) s, n);
+
+  return score;
+}
+
+//-------------------------------------------------------------------------
+
+my_bool damerau_k_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
+  if ((args->arg_count != 3) ||
+      (args->arg_type[0] != STRING_RESULT || args->arg_type[1] != STRING_RESULT || args->arg_type[2] != INT_RESULT)) {
+    strcpy(message, "Function requires 3 arguments, (string, string, int)");
+    return 1;
+  }
+
+  initid->ptr = NULL; //strip rows, allocated by the first row
+  initid->max_length = LEVENSHTEIN_MAX;
+  initid->maybe_null = 0; //doesn't return null
+
+  //a constant string is compiled once for all the rows
+  if (_udf_pattern_init(initid, args, (args->args[0] != NULL) ? 0 : 1, PATTERN_COMPILE)) {
+    _udf_scratch_free(initid);
+    strcpy(message, "Not enough memory for the constant argument");
+    return 1;
+  }
+
+  return 0;
+}
+
+/**
+ *  deallocate memory, clean and close
+ */
+void damerau_k_deinit(UDF_INIT *initid) {
+    _udf_scratch_free(initid);
+}
+
+longlong damerau_k(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error) {
+  UDF_SCRATCH *sc = (UDF_SCRATCH*) initid->ptr;
+  const char *s = args->args[0];
+  const char *t = args->args[1];
+  const int k = *((int*) args->args[2]);
+
+  const int n = (s == NULL) ? 0 : args->lengths[0];
+  const int m = (t == NULL) ? 0 : args->lengths[1];
+
+  longlong dist;
+  BP_SCRATCH *bp;
+
+  //lower bounds first, most rows of a scan are far apart
+  if (_prefilter_row(initid, s, n, t, m, k, 1))
+    return k + 1;
+
+  //constant argument compiled by the init
+  if (sc != NULL && sc->compiled != NULL) {
+    dist = (sc->pattern_arg == 0)
+           ? _damerau_k_compiled(sc->pattern, sc->pattern_len, t, m, k, sc->compiled, &sc->trail)
+           : _damerau_k_compiled(sc->pattern, sc->pattern_len, s, n, k, sc->compiled, &sc->trail);
+    if (dist >= 0)
+      return dist;
+  }
+  //value repeated across rows, e.g. the outer side of a join
+  else if (k >= BP_K_CACHE_MIN_K && abs(n - m) <= k && (k + 1) * MIN(n, m) >= BP_K_CACHE_MIN_CELLS) {
+    //the scratch, and its trail, exists once a lookup succeeds
+    if ((bp = _bp_cache_lookup(initid, 0, s, n)) != NULL)
+      dist = _damerau_k_compiled(bp->compiled, n, t, m, k, bp, &((UDF_SCRATCH*) initid->ptr)->trail);
+    else if ((bp = _bp_cache_lookup(initid, 1, t, m)) != NULL)
+      dist = _damerau_k_compiled(bp->compiled, m, s, n, k, bp, &((UDF_SCRATCH*) initid->ptr)->trail);
+    else
+      dist = -1;
+    if (dist >= 0)
+      return dist;
+  }
+
+  //three strip rows of at most min(k, max(n, m)) + 1 cells
+  _arena_reset(initid);
+  int *rows = (int *) _arena_alloc(initid, 3 * (MIN(MAX(k, 0), MAX(n, m)) + 1) * sizeof(int));
+  if (rows == NULL) {
+    *error = 1;
+    return 0;
+  }
+
+  return _damerau_k_core(s, n, t, m, k, rows);
+}
+
+/*
+ * Same strip as _levenshtein_k_core (see the observations there), extended
+ * with the transposition of the optimal string alignment. A transposition
+ * moves two cells along the diagonal, d[i, j] <- d[i-2, j-2], so in the virtual
+ * strip matrix it reads the same column jv two rows back. That cell is always
+ * inside the strip of row i-2 when i, j > 1, hence three rolling rows of
+ * stripsize cells suffice. Transpositions keep the alignment on its diagonal:
+ * the strip and the early exit on the main diagonal stay valid.
+ */
+inline longlong _damerau_k_core(const char *s, const int s_len, const char *t, const int t_len, const int k, int *rows) {
+
+  int n = (s == NULL) ? 0 : s_len;
+  int m = (t == NULL) ? 0 : t_len;
+
+  //order the strings so that the first always has the minimum length l
+  if (n > m) {
+    int aux = n;
+    n = m;
+    m = aux;
+    const char *auxs = s;
+    s = t;
+    t = auxs;
+  }
+
+  const int ignore = k + 1; //dist between s and t is at least greater than k
+  const int r = m - n;
+
+  if (0 == n)
+    return (m > k) ? ignore : m;
+  if (r > k)
+    return ignore;
+
+  const int lsize = (((k > m) ? m : k) - r) / 2; //left space for insertions
+  const int rsize = lsize + r; //right space for deletions
+  const int stripsize = lsize + rsize + 1; // + 1 for the diagonal cell
+  const int stripsizem1 = stripsize - 1;
+
+  int *d = rows; //current, last and second to last rows
+  int currentrow;
+  int lastrow;
+  int last2row;
+  int aux;
+
+  /* Initialization */
+
+  //currentrow = 0
+  int i;
+  for (i = lsize; i < stripsize; i++) //start from diagonal cell
+    d[i] = i - lsize;
+
+  /* Recurrence */
+
+  currentrow = stripsize;
+  lastrow = 0;
+  last2row = 2 * stripsize;
+
+  int j, jv, bl, br;
+  int im1 = 0, jm1;
+  int a, b, c, min;
+  for (i = 1; i <= n; i++) {
+
+    bl = i - lsize;
+    if (bl < 0) {
+      jv = abs(bl);
+      bl = 0;
+    }
+    else
+      jv = 0;
+    br = i + rsize;
+    if (br > m)
+      br = m;
+
+    jm1 = bl - 1;
+    for (j = bl; j <= br; j++) {
+      if (0 == j)
+        d[currentrow + jv] = i;
+      else {
+        if (s[im1] == t[jm1]) {
+          d[currentrow + jv] = d[lastrow + jv];
+        }
+        else {
+          a = (0 == jv) ? ignore : d[currentrow + jv - 1]; //deletion
+          b = (stripsizem1 == jv) ? ignore : d[lastrow + jv + 1]; //insertion
+          c = d[lastrow + jv]; //substitution
+
+          min = a;
+          if (b < min)
+            min = b;
+          if (c < min)
+            min = c;
+
+          //transposition, d[i-2, j-2] is the same strip column two rows back
+          if (i > 1 && j > 1 && s[im1] == t[jm1 - 1] && s[im1 - 1] == t[jm1]) {
+            c = d[last2row + jv];
+            if (c < min)
+              min = c;
+          }
+
+          d[currentrow + jv] = min + 1;
+        }
+      }
+      jv++;
+      jm1 = j;
+    }
+
+    //obsv: the cost of a following diagonal never decreases
+    if (d[currentrow + lsize + r] > k)
+      return ignore;
+
+    im1 = i;
+
+    //rotate
+    aux = last2row;
+    last2row = lastrow;
+    lastrow = currentrow;
+    currentrow = aux;
+  }
+
+  //only here if damerau(s, t) <= k
+  return (longlong) d[lastrow + lsize + r]; //d[n, m]
+}
+
+
+/*
+ * One word OSA kernel bounded by k, see _damerau_bp_1w and
+ * _levenshtein_k_bp_1w: transpositions keep the alignment on its diagonal,
+ * so the same early exit and trail apply. eqold is the mask of the previous
+ * text character, read back from peq when resuming.
+ */
+static inline longlong _damerau_k_bp_1w(const unsigned char *s, const int n,
+                                        const unsigned char *t, const int m, const int k, const uint64_t *peq,
+                                        BP_TRAIL *tr, const int from) {
+  const uint64_t last = 1ULL << (n - 1);
+  const uint64_t rows = last | (last - 1);
+  uint64_t pv = ~0ULL, mv = 0, d0 = 0, eqold = 0, eq, trn, ph, mh, below;
+  longlong score = n;
+  int i, j;
+
+  if (from > 0) {
+    pv = tr->pv[from - 1];
+    mv = tr->mv[from - 1];
+    d0 = tr->d0[from - 1];
+    score = tr->score[from - 1];
+    eqold = peq[t[from - 1]];
+  }
+
+  for (j = from; j < m; j++) {
+    eq = peq[t[j]];
+    trn = (((~d0) & eq) << 1) & eqold;
+    d0 = (((eq & pv) + pv) ^ pv) | eq | mv | trn;
+    ph = mv | ~(d0 | pv);
+    mh = pv & d0;
+
+    if (ph & last)
+      score++;
+    else if (mh & last)
+      score--;
+
+    ph = (ph << 1) | 1; //first row is d[0, j] = j, always +1
+    mh <<= 1;
+    pv = mh | ~(d0 | ph);
+    mv = ph & d0;
+    eqold = eq;
+
+    if (tr != NULL) {
+      tr->text[j] = t[j];
+      tr->pv[j] = pv;
+      tr->mv[j] = mv;
+      tr->d0[j] = d0;
+      tr->score[j] = score;
+    }
+
+    i = j + 1 + n - m;
+    if ((j & 3) == 3 && i >= 1) {
+      below = rows & ~((1ULL << (i - 1) << 1) - 1); //rows i + 1 .. n
+      if (score - __builtin_popcountll(pv & below) + __builtin_popcountll(mv & below) > k) {
+        if (tr != NULL)
+          tr->len = j + 1;
+        return k + 1;
+      }
+    }
+  }
+
+  if (tr != NULL)
+    tr->len = m;
+  return MIN(score, k + 1);
+}
+
+/*
+ * A compiled pattern p of up to 64 characters is scored by the one word
+ * kernel, resuming after the prefix o shares with the previous row when given
+ * its trail. -1 for longer patterns.
+ */
+inline longlong _damerau_k_compiled(const char *p, const int p_len, const char *o, const int o_len, const int k,
+                                    BP_SCRATCH *bp, BP_TRAIL *tr) {
+  int from = 0;
+
+  if (abs(o_len - p_len) > k)
+    return k + 1;
+  if (0 == p_len || 0 == o_len)
+    return MAX(p_len, o_len);
+  if (p_len > BP_WORD_BITS)
+    return -1;
+
+  if (tr != NULL && (from = _bp_trail_resume(tr, bp, o, o_len)) < 0) {
+    tr = NULL; //out of memory, from scratch
+    from = 0;
+  }
+  return _damerau_k_bp_1w((const unsigned char *) p, p_len, (const unsigned char *) o, o_len, k, bp->peq, tr, from);
+}
+
+//-------------------------------------------------------------------------
+
+my_bool damerau_k_ratio_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
+  if ((args->arg_count != 3) ||
+      (args->arg_type[0] != STRING_RESULT || args->arg_type[1] != STRING_RESULT || args->arg_type[2] != INT_RESULT)) {
+    strcpy(message, "Function requires 3 arguments, (string, string, int)");
+    return 1;
+  }
+
+  initid->ptr = NULL;
+  initid->max_length = LEVENSHTEIN_MAX;
+  initid->maybe_null = 0; //doesn't return null
+
+  //a constant string is compiled once for all the rows
+  if (_udf_pattern_init(initid, args, (args->args[0] != NULL) ? 0 : 1, PATTERN_COMPILE)) {
+    _udf_scratch_free(initid);
+    strcpy(message, "Not enough memory for the constant argument");
+    return 1;
+  }
+
+  return 0;
+}
+
+void damerau_k_ratio_deinit(UDF_INIT *initid) {
+    _udf_scratch_free(initid);
+}
+
+double damerau_k_ratio(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error) {
+  const char *s = args->args[0];
+  const char *t = args->args[1];
+  const int k = *((int*) args->args[2]);
+
+  int n = (s == NULL) ? 0 : args->lengths[0];
+  int m = (t == NULL) ? 0 : args->lengths[1];
+  double maxlen = MAX(n, m);
+  if (maxlen == 0)
+    return 0.0;
+
+  double dist = (double)damerau_k(initid, args, is_null, error);
+  if (dist > k)
+    return 0.0;
+  else
+    return 1.0 - dist/maxlen;
+}
+
+//-------------------------------------------------------------------------
+
+my_bool damerau_full_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
+  if ((args->arg_count != 2) ||
+      (args->arg_type[0] != STRING_RESULT || args->arg_type[1] != STRING_RESULT)) {
+    strcpy(message, "Function requires 2 arguments, (string, string)");
+    return 1;
+  }
+
+  initid->ptr = NULL; //rows, allocated by the first row
+  initid->max_length = LEVENSHTEIN_MAX;
+  initid->maybe_null = 0; //doesn't return null
+
+  return 0;
+}
+
+/**
+ *  deallocate memory, clean and close
+ */
+void damerau_full_deinit(UDF_INIT *initid) {
+    _udf_scratch_free(initid);
+}
+
+longlong damerau_full(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error) {
+  const char *s = args->args[0];
+  const char *t = args->args[1];
+
+  const int n = (s == NULL) ? 0 : args->lengths[0];
+  const int m = (t == NULL) ? 0 : args->lengths[1];
+
+  _arena_reset(initid);
+  int *rows = (int *) _arena_alloc(initid, _damerau_full_rows(s, n, t, m) * sizeof(int));
+  if (rows == NULL) {
+    *error = 1;
+    return 0;
+  }
+
+  return _damerau_full_core(s, n, t, m, rows);
+}
+
+/*
+ * Lowrance-Wagner recurrence
+ * (see R. Lowrance, R. A. Wagner, An extension of the string-to-string
+ * correction problem, J. ACM 22(2), 1975)
+ *
+ * Besides the levenshtein operations, d[i, j] may come from the last pair
+ * (k, l) with s[k] == t[j] and t[l] == s[i]: everything in between is deleted
+ * resp. inserted and the two characters are transposed,
+ *
+ *   d[k-1, l-1] + (i-k-1) + 1 + (j-l-1)
+ *
+ * k is the last row of t[j] (da[], one entry per byte), l the last matching
+ * column in the current row. Row k-1 can be arbitrarily far above, but only one
+ * such row per character is ever referenced: the row before its last
+ * occurrence. So instead of the full matrix we keep the current and previous
+ * row plus one row per distinct character of s. When row i is done, the
+ * previous row becomes the saved row of s[i] and the row it replaces is
+ * recycled, no row is ever copied.
+ *
+ * The longer string is placed on the rows, so rows are min(n, m) + 1 long.
+ */
+static inline void _damerau_full_order(const char **s, int *n, const char **t, int *m) {
+  if (*n < *m) {
+    int aux = *n;
+    *n = *m;
+    *m = aux;
+    const char *auxs = *s;
+    *s = *t;
+    *t = auxs;
+  }
+}
+
+/**
+ * @result number of ints _damerau_full_core needs for s and t
+ */
+size_t _damerau_full_rows(const char *s, const int s_len, const char *t, const int t_len) {
+  int n = (s == NULL) ? 0 : s_len;
+  int m = (t == NULL) ? 0 : t_len;
+  unsigned char seen[BP_ALPHABET] = {0};
+  size_t distinct = 0;
+  int i;
+
+  _damerau_full_order(&s, &n, &t, &m);
+
+  for (i = 0; i < n && distinct < BP_ALPHABET; i++) {
+    if (!seen[(unsigned char) s[i]]) {
+      seen[(unsigned char) s[i]] = 1;
+      distinct++;
+    }
+  }
+
+  return (2 + distinct) * (size_t) (m + 1);
+}
+
+inline longlong _damerau_full_core(const char *s, const int s_len, const char *t, const int t_len, int *rows) {
+  int n = (s == NULL) ? 0 : s_len;
+  int m = (t == NULL) ? 0 : t_len;
+
+  _damerau_full_order(&s, &n, &t, &m);
+
+  if (0 == m)
+    return n;
+
+  int da[BP_ALPHABET] = {0}; //last row of each character in s, 0 = none yet
+  int *saved[BP_ALPHABET] = {NULL}; //row da[c] - 1 of each character
+  int *prev = rows;
+  int *cur = prev + m + 1;
+  int *fresh = cur + m + 1; //never used rows
+  int *old;
+  int i, j, k, l, db, v, tr;
+  unsigned char a, b;
+
+  for (j = 0; j <= m; j++)
+    prev[j] = j;
+
+  for (i = 1; i <= n; i++) {
+    a = (unsigned char) s[i-1];
+    db = 0;
+    cur[0] = i;
+
+    for (j = 1; j <= m; j++) {
+      b = (unsigned char) t[j-1];
+      k = da[b];
+      l = db;
+
+      if (a == b) {
+        v = prev[j-1]; //no operation required
+        db = j;
+      }
+      else
+        v = prev[j-1] + 1; //substitution
+
+      if (prev[j] + 1 < v) //deletion
+        v = prev[j] + 1;
+      if (cur[j-1] + 1 < v) //insertion
+        v = cur[j-1] + 1;
+
+      if (k > 0 && l > 0) { //transposition
+        tr = saved[b][l-1] + (i-k-1) + 1 + (j-l-1);
+        if (tr < v)
+          v = tr;
+      }
+
+      cur[j] = v;
+    }
+
+    //the previous row becomes the saved row of a, its old saved row is recycled
+    old = saved[a];
+    saved[a] = prev;
+    prev = cur;
+    if (old != NULL)
+      cur = old;
+    else {
+      cur = fresh;
+      fresh += m + 1;
+    }
+    da[a] = i;
+  }
+
+  return (longlong) prev[m];
+}
+
+//-------------------------------------------------------------------------
+
+/*
+ * Lowest optimal string alignment distance between s and the windows of
+ * length n of t, n <= m, on the masks of the needle, see _bp_needle_set
+ * (folded by ft unless NULL).
+ */
+static longlong _damerau_substring_windows(const char *s, const int n, const char *t, const int m, BP_SCRATCH *bp,
+                                           const FOLD_TABLE *ft) {
+  longlong lowest_dist = LLONG_MAX;
+  longlong dist = 0;
+
+  unsigned int index = 0;
+
+  const int masks = _bp_needle_set(bp, s, n, ft);
+
+  while (index <= (m - n)) {
+    dist = _damerau_core(
+                s, n,
+                t, n,
+                /* swap */              1,
+                /* substitution */	    1,
+                /* insertion */         1,
+                /* deletion */          1,
+                NULL, bp
+    );
+    if (dist < lowest_dist)
+        lowest_dist = dist;
+
+    (void)*t++;
+    index++;
+    if (lowest_dist == 1)
+        break;
+  }
+
+  if (masks)
+    _bp_needle_clear(bp, n, ft);
+  return lowest_dist;
+}
+
+//-------------------------------------------------------------------------
+
+my_bool damerau_substring_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
+  // sanitizing input parameters
+  if ((args->arg_count != 2) ||
+      (args->arg_type[0] != STRING_RESULT || args->arg_type[1] != STRING_RESULT)) {
+    strcpy(message, "Function requires 2 arguments, (string, string)");
+    return 1;
+  }
+
+  initid->ptr = NULL;
+  initid->max_length = LEVENSHTEIN_MAX;
+  initid->maybe_null = 0; //doesn't return null
+
+  //a constant pattern is stripped and compiled once for all the rows
+  if (_udf_pattern_init(initid, args, 0, PATTERN_STRIP | PATTERN_COMPILE)) {
+    _udf_scratch_free(initid);
+    strcpy(message, "Not enough memory for the constant argument");
+    return 1;
+  }
+
+  return 0;
+}
+
+/**
+ *  deallocate memory, clean and close
+ */
+void damerau_substring_deinit(UDF_INIT *initid) {
+    _udf_scratch_free(initid);
+}
+
+longlong damerau_substring(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error) {
+  const UDF_SCRATCH *sc = (UDF_SCRATCH*) initid->ptr;
+  const char *s = args->args[0];
+  const char *t = args->args[1];
+
+  int n = (s == NULL) ? 0 : args->lengths[0]; /*contains pattern*/
+  int m = (t == NULL) ? 0 : args->lengths[1]; /*contains row*/
+
+  //normalized in a single pass each, in the arena of the statement
+  _arena_reset(initid);
+  const char *s_stripped;
+  if (sc != NULL && sc->pattern != NULL) {
+    s_stripped = sc->pattern;
+    n = sc->pattern_len;
+  }
+  else
+    s_stripped = _arena_normalize(initid, s, n, PATTERN_STRIP, &n);
+  const char *t_stripped = _arena_normalize(initid, t, m, PATTERN_STRIP, &m);
+  if (s_stripped == NULL || t_stripped == NULL) {
+    *error = 1;
+    return 0;
+  }
+
+  //order the strings so that the first always has the minimum length l
+  if (n > m) {
+    int aux = n;
+    n = m;
+    m = aux;
+    const char *auxs = s_stripped;
+    s_stripped = t_stripped;
+    t_stripped = auxs;
+  }
+
+  //the masks of the needle serve all the windows, compiled when it is the constant pattern
+  BP_SCRATCH *bp = (sc != NULL && s_stripped == sc->pattern && sc->compiled != NULL)
+                   ? sc->compiled : _bp_scratch_for(initid, n);
+  if (bp == NULL) {
+    *error = 1;
+    return 0;
+  }
+
+  return _damerau_substring_windows(s_stripped, n, t_stripped, m, bp, NULL);
+}
+
+//-------------------------------------------------------------------------
+
+my_bool damerau_substring_ci_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
+  // sanitizing input parameters
+  if ((args->arg_count != 2 && args->arg_count != 3) ||
+      (args->arg_type[0] != STRING_RESULT || args->arg_type[1] != STRING_RESULT) ||
+      (args->arg_count == 3 && args->arg_type[2] != STRING_RESULT)) {
+    strcpy(message, "Function requires 2 or 3 arguments, (string, string[, collation])");
+    return 1;
+  }
+
+  initid->ptr = NULL;
+  initid->max_length = LEVENSHTEIN_MAX;
+  initid->maybe_null = 0; //doesn't return null
+
+  if (_udf_collation_init(initid, args, 2, message)) {
+    _udf_scratch_free(initid);
+    return 1;
+  }
+
+  //a constant pattern is stripped and compiled, case insensitive, once for all the rows;
+  //under utf8mb4 only its ASCII bytes are folded, the rest per code point
+  const UDF_SCRATCH *sc = (UDF_SCRATCH*) initid->ptr;
+  const int flags = (sc != NULL && sc->collation == COLLATION_UTF8MB4)
+                    ? PATTERN_STRIP | PATTERN_FOLD : PATTERN_STRIP | PATTERN_FOLD | PATTERN_COMPILE;
+  if (_udf_pattern_init(initid, args, 0, flags)) {
+    _udf_scratch_free(initid);
+    strcpy(message, "Not enough memory for the constant argument");
+    return 1;
+  }
+
+  return 0;
+}
+
+/**
+ *  deallocate memory, clean and close
+ */
+void damerau_substring_ci_deinit(UDF_INIT *initid) {
+    _udf_scratch_free(initid);
+}
+
+longlong damerau_substring_ci(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error) {
+  const UDF_SCRATCH *sc = (UDF_SCRATCH*) initid->ptr;
+  const char *s = args->args[0];
+  const char *t = args->args[1];
+
+  const int collation = (sc == NULL) ? COLLATION_ASCII : sc->collation;
+
+  int n = (s == NULL) ? 0 : args->lengths[0]; /*contains pattern*/
+  int m = (t == NULL) ? 0 : args->lengths[1]; /*contains row*/
+
+  //stripped in a single pass each, in the arena of the statement; the case
+  //is folded by the masks of the needle, the strings are not lowercased
+  _arena_reset(initid);
+  const char *s_stripped;
+  if (sc != NULL && sc->pattern != NULL) {
+    s_stripped = sc->pattern;
+    n = sc->pattern_len;
+  }
+  else
+    s_stripped = _arena_normalize(initid, s, n, PATTERN_STRIP, &n);
+  const char *t_stripped = _arena_normalize(initid, t, m, PATTERN_STRIP, &m);
+  if (s_stripped == NULL || t_stripped == NULL) {
+    *error = 1;
+    return 0;
+  }
+
+  //multibyte characters are folded as code points, pure ASCII rows as bytes
+  if (collation == COLLATION_UTF8MB4 && !(_utf8_is_ascii(s_stripped, n) && _utf8_is_ascii(t_stripped, m)))
+    return _utf8_substring_core(initid, s_stripped, n, t_stripped, m, 1, 0, error);
+
+  //order the strings so that the first always has the minimum length l
+  if (n > m) {
+    int aux = n;
+    n = m;
+    m = aux;
+    const char *auxs = s_stripped;
+    s_stripped = t_stripped;
+    t_stripped = auxs;
+  }
+
+  //the masks of the needle serve all the windows, compiled when it is the constant pattern
+  BP_SCRATCH *bp = (sc != NULL && s_stripped == sc->pattern && sc->compiled != NULL)
+                   ? sc->compiled : _bp_scratch_for(initid, n);
+  if (bp == NULL) {
+    *error = 1;
+    return 0;
+  }
+
+  return _damerau_substring_windows(s_stripped, n, t_stripped, m, bp, _fold_table(collation));
+}
+
+
+//-------------------------------------------------------------------------
+
+/*
+ * UTF-8 variants: edits are counted per code point instead of per byte.
+ *
+ * Rows of pure ASCII go straight to the byte kernels. Otherwise both strings
+ * are decoded once into code point buffers of the arena, and the non-ASCII
+ * characters of one of them are renumbered 128 .. 254 in order of appearance:
+ * ASCII stays as it is, the characters of the other string not in that
+ * alphabet become 255. The distances only compare characters of one string
+ * with characters of the other, so they are the same over these byte strings,
+ * which run through the unchanged bit-parallel kernels. Rows where both
+ * strings have more than 127 distinct non-ASCII characters fall back to the
+ * scalar recurrence over the code points.
+ */
+#define UTF8_INVALID 0x110000 //invalid bytes decode to UTF8_INVALID + byte, one character each
+#define UTF8_REMAP_MAX 127 //distinct non-ASCII characters renumbered 128 .. 254
+#define UTF8_REMAP_OTHER 255 //characters outside of the renumbered alphabet
+#define UTF8_REMAP_SLOTS 256
+
+/**
+ * Non-ASCII alphabet of a string, open addressing on the code point
+ */
+typedef struct {
+  uint32_t      cp[UTF8_REMAP_SLOTS]; //0 if empty, never a non-ASCII code point
+  unsigned char id[UTF8_REMAP_SLOTS];
+  int           count;
+} UTF8_ALPHABET;
+
+/**
+ * @param s string, length n
+ * @result 1 if s only holds ASCII bytes; the bytes are ORed 8 at a time, a loop
+ *         the compiler vectorizes, and tested once
+ */
+inline int _utf8_is_ascii(const char *s, const int n) {
+  uint64_t acc = 0, w;
+  int i;
+
+  for (i = 0; i + 8 <= n; i += 8) {
+    memcpy(&w, s + i, 8);
+    acc |= w;
+  }
+  for (; i < n; i++)
+    acc |= (unsigned char) s[i];
+
+  return (acc & 0x8080808080808080ULL) == 0;
+}
+
+/**
+ * @param str UTF-8 string, length len
+ * @param out buffer of at least len code points
+ * @result number of code points decoded into out
+ */
+inline int _utf8_decode(const char *str, const int len, uint32_t *out) {
+  const unsigned char *s = (const unsigned char *) str;
+  int i = 0, x = 0, size, j;
+  uint32_t c, min;
+
+  while (i < len) {
+    c = s[i];
+    if (c < 0x80) {
+      out[x++] = c;
+      i++;
+      continue;
+    }
+
+    if (c >= 0xC2 && c <= 0xDF) {
+      size = 2;
+      c &= 0x1F;
+      min = 0x80;
+    }
+    else if ((c & 0xF0) == 0xE0) {
+      size = 3;
+      c &= 0x0F;
+      min = 0x800;
+    }
+    else if (c >= 0xF0 && c <= 0xF4) {
+      size = 4;
+      c &= 0x07;
+      min = 0x10000;
+    }
+    else {
+      size = 0;
+      min = 0;
+    }
+
+    for (j = 1; j < size && i + j < len && (s[i + j] & 0xC0) == 0x80; j++)
+      c = (c << 6) | (s[i + j] & 0x3F);
+
+    //truncated, overlong or out of range sequences: the lead byte alone
+    if (0 == size || j < size || c < min || c > 0x10FFFF) {
+      out[x++] = UTF8_INVALID + s[i];
+      i++;
+    }
+    else {
+      out[x++] = c;
+      i += size;
+    }
+  }
+
+  return x;
+}
+
+static inline int _utf8_slot(const UTF8_ALPHABET *a, const uint32_t c) {
+  int h = (int) ((c * 2654435761u) >> 24);
+
+  while (a->cp[h] != 0 && a->cp[h] != c)
+    h = (h + 1) & (UTF8_REMAP_SLOTS - 1);
+  return h;
+}
+
+/**
+ * @result 1 if the non-ASCII characters of s, length n, fit the alphabet a, 0 otherwise
+ */
+static inline int _utf8_alphabet(UTF8_ALPHABET *a, const uint32_t *s, const int n) {
+  int i, h;
+
+  memset(a, 0, sizeof(UTF8_ALPHABET));
+  for (i = 0; i < n; i++) {
+    if (s[i] < 0x80)
+      continue;
+    h = _utf8_slot(a, s[i]);
+    if (a->cp[h] == 0) {
+      if (a->count == UTF8_REMAP_MAX)
+        return 0;
+      a->cp[h] = s[i];
+      a->id[h] = 0x80 + a->count++;
+    }
+  }
+  return 1;
+}
+
+static inline void _utf8_bytes(const UTF8_ALPHABET *a, const uint32_t *s, const int n, char *out) {
+  int i, h;
+
+  for (i = 0; i < n; i++) {
+    if (s[i] < 0x80)
+      out[i] = (char) s[i];
+    else {
+      h = _utf8_slot(a, s[i]);
+      out[i] = (char) ((a->cp[h] == 0) ? UTF8_REMAP_OTHER : a->id[h]);
+    }
+  }
+  out[n] = '\0';
+}
+
+/**
+ * Bring the strings of a row to a byte alphabet, see above; all the buffers
+ * are in the arena of the row.
+ *
+ * @param s, t strings, lengths n and m in bytes
+ * @param s_cp, t_cp code points of s and t when they do not fit a byte alphabet
+ * @result 1 if s, t, n and m now hold byte strings with one byte per code point,
+ *         0 if s_cp and t_cp, of n and m code points, are to be compared instead,
+ *         -1 if out of memory
+ */
+int _utf8_remap(UDF_INIT *initid, const char **s, int *n, const char **t, int *m, uint32_t **s_cp, uint32_t **t_cp) {
+  if (_utf8_is_ascii(*s, *n) && _utf8_is_ascii(*t, *m))
+    return 1;
+
+  *s_cp = (uint32_t *) _arena_alloc(initid, (*n + 1) * sizeof(uint32_t));
+  *t_cp = (uint32_t *) _arena_alloc(initid, (*m + 1) * sizeof(uint32_t));
+  if (*s_cp == NULL || *t_cp == NULL)
+    return -1;
+
+  *n = _utf8_decode(*s, *n, *s_cp);
+  *m = _utf8_decode(*t, *m, *t_cp);
+
+  return _utf8_remap_cp(initid, *s_cp, *n, *t_cp, *m, s, t);
+}
+
+/**
+ * Second half of _utf8_remap, for code points already decoded
+ *
+ * @param s_cp, t_cp code points, lengths n and m
+ * @param s_bytes, t_bytes byte strings of n and m bytes, set when the result is 1
+ * @result as _utf8_remap
+ */
+int _utf8_remap_cp(UDF_INIT *initid, const uint32_t *s_cp, const int n, const uint32_t *t_cp, const int m,
+                   const char **s_bytes, const char **t_bytes) {
+  UTF8_ALPHABET *a = (UTF8_ALPHABET *) _arena_alloc(initid, sizeof(UTF8_ALPHABET));
+  char *s_out, *t_out;
+
+  if (a == NULL)
+    return -1;
+
+  //the alphabet of the shorter string, of the other one if it has too many characters
+  if (!((n <= m) ? _utf8_alphabet(a, s_cp, n) || _utf8_alphabet(a, t_cp, m)
+                 : _utf8_alphabet(a, t_cp, m) || _utf8_alphabet(a, s_cp, n)))
+    return 0;
+
+  s_out = (char *) _arena_alloc(initid, n + 1);
+  t_out = (char *) _arena_alloc(initid, m + 1);
+  if (s_out == NULL || t_out == NULL)
+    return -1;
+
+  _utf8_bytes(a, s_cp, n, s_out);
+  _utf8_bytes(a, t_cp, m, t_out);
+  *s_bytes = s_out;
+  *t_bytes = t_out;
+  return 1;
+}
+
+/**
+ * Levenshtein, or optimal string alignment with osa, of code point strings:
+ * the scalar recurrence, for rows whose characters do not fit a byte alphabet
+ *
+ * @param rows scratch of at least 3 * (m + 1) ints
+ */
+inline longlong _utf8_edit_core(const uint32_t *s, const int n, const uint32_t *t, const int m, const int osa,
+                                int *rows) {
+  int *d2 = rows, *d1 = rows + m + 1, *d0 = rows + 2 * (m + 1), *aux;
+  int i, j, v;
+
+  for (j = 0; j <= m; j++)
+    d1[j] = j;
+
+  for (i = 1; i <= n; i++) {
+    d0[0] = i;
+    for (j = 1; j <= m; j++) {
+      v = d1[j - 1] + (s[i - 1] != t[j - 1]);
+      if (d1[j] + 1 < v)
+        v = d1[j] + 1;
+      if (d0[j - 1] + 1 < v)
+        v = d0[j - 1] + 1;
+      if (osa && i > 1 && j > 1 && s[i - 1] == t[j - 2] && s[i - 2] == t[j - 1] && d2[j - 2] + 1 < v)
+        v = d2[j - 2] + 1;
+      d0[j] = v;
+    }
+    aux = d2;
+    d2 = d1;
+    d1 = d0;
+    d0 = aux;
+  }
+
+  return d1[m];
+}
+
+/**
+ * @result _utf8_edit_core of the code points of a row, rows in its arena; -1 if out of memory
+ */
+static longlong _utf8_edit_row(UDF_INIT *initid, const uint32_t *s, const int n, const uint32_t *t, const int m,
+                               const int osa) {
+  //rows as long as the shorter string, both distances are symmetric
+  if (n < m)
+    return _utf8_edit_row(initid, t, m, s, n, osa);
+
+  int *rows = (int *) _arena_alloc(initid, 3 * (m + 1) * sizeof(int));
+  if (rows == NULL)
+    return -1;
+
+  return _utf8_edit_core(s, n, t, m, osa, rows);
+}
+
+/**
+ * Case insensitive substring distances of UTF-8 rows, for the utf8mb4
+ * collation of the _ci functions: the code points are folded by _fold_cp,
+ * then brought to a byte alphabet for the window loops of the byte functions.
+ *
+ * @param s, t stripped strings, lengths s_len and t_len in bytes
+ * @param osa 1 for damerau_substring_ci, 0 for levenshtein_substring_ci_k
+ * @param k bound of levenshtein_substring_ci_k
+ * @param error set if out of memory
+ */
+longlong _utf8_substring_core(UDF_INIT *initid, const char *s, const int s_len, const char *t, const int t_len,
+                              const int osa, const int k, char *error) {
+  uint32_t *s_cp = (uint32_t *) _arena_alloc(initid, (s_len + 1) * sizeof(uint32_t));
+  uint32_t *t_cp = (uint32_t *) _arena_alloc(initid, (t_len + 1) * sizeof(uint32_t));
+  const char *s_bytes, *t_bytes;
+  int n, m, i, remap;
+
+  if (s_cp == NULL || t_cp == NULL) {
+    *error = 1;
+    return 0;
+  }
+
+  n = _utf8_decode(s, s_len, s_cp);
+  m = _utf8_decode(t, t_len, t_cp);
+  for (i = 0; i < n; i++)
+    s_cp[i] = _fold_cp(s_cp[i]);
+  for (i = 0; i < m; i++)
+    t_cp[i] = _fold_cp(t_cp[i]);
+
+  //order the strings so that the first always has the minimum length l
+  if (n > m) {
+    uint32_t *aux = s_cp;
+    s_cp = t_cp;
+    t_cp = aux;
+    i = n;
+    n = m;
+    m = i;
+  }
+
+  remap = _utf8_remap_cp(initid, s_cp, n, t_cp, m, &s_bytes, &t_bytes);
+  if (remap == 1) {
+    BP_SCRATCH *bp = (osa || n <= BP_WORD_BITS) ? _bp_scratch_for(initid, n) : NULL;
+    if ((osa || n <= BP_WORD_BITS) && bp == NULL) {
+      *error = 1;
+      return 0;
+    }
+    if (osa)
+      return _damerau_substring_windows(s_bytes, n, t_bytes, m, bp, NULL);
+    return _levenshtein_substring_k_windows(s_bytes, n, t_bytes, m, k, bp, NULL);
+  }
+
+  //too many distinct characters: the scalar recurrence per window
+  int *rows = (remap == 0) ? (int *) _arena_alloc(initid, 3 * (n + 1) * sizeof(int)) : NULL;
+  if (rows == NULL) {
+    *error = 1;
+    return 0;
+  }
+
+  longlong lowest_dist = LLONG_MAX;
+  longlong dist;
+
+  for (i = 0; i <= m - n; i++) {
+    dist = _utf8_edit_core(t_cp + i, n, s_cp, n, osa, rows);
+    if (!osa && dist > k)
+      dist = k + 1;
+    if (dist < lowest_dist)
+      lowest_dist = dist;
+    if (lowest_dist == 1)
+      break;
+  }
+
+  return lowest_dist;
+}
+
+//-------------------------------------------------------------------------
+
+my_bool levenshtein_utf8_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
+  if ((args->arg_count != 2) ||
+      (args->arg_type[0] != STRING_RESULT || args->arg_type[1] != STRING_RESULT)) {
+    strcpy(message, "Function requires 2 arguments, (string, string)");
+    return 1;
+  }
+
+  //code points and bit-parallel scratch, allocated by the first row
+  initid->ptr = NULL;
+  initid->max_length = LEVENSHTEIN_MAX;
+  initid->maybe_null = 0; //doesn't return null
+
+  return 0;
+}
+
+void levenshtein_utf8_deinit(UDF_INIT *initid) {
+  _udf_scratch_free(initid);
+}
+
+longlong levenshtein_utf8(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error) {
+  const char *s = args->args[0];
+  const char *t = args->args[1];
+
+  int n = (s == NULL) ? 0 : args->lengths[0];
+  int m = (t == NULL) ? 0 : args->lengths[1];
+
+  uint32_t *s_cp, *t_cp;
+  longlong dist;
+
+  _arena_reset(initid);
+  switch (_utf8_remap(initid, &s, &n, &t, &m, &s_cp, &t_cp)) {
+  case 1:
+    break;
+  case 0:
+    if ((dist = _utf8_edit_row(initid, s_cp, n, t_cp, m, 0)) >= 0)
+      return dist;
+    /* fall through */
+  default:
+    *error = 1;
+    return 0;
+  }
+
+  if (0 == n)
+    return m;
+  if (0 == m)
+    return n;
+
+  BP_SCRATCH *bp = _bp_scratch_for(initid, MIN(n, m));
+  if (bp == NULL) {
+    *error = 1;
+    return 0;
+  }
+
+  return _levenshtein_bp_core(s, n, t, m, bp);
+}
+
+//-------------------------------------------------------------------------
+
+my_bool levenshtein_k_utf8_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
+  if ((args->arg_count != 3) ||
+      (args->arg_type[0] != STRING_RESULT || args->arg_type[1] != STRING_RESULT || args->arg_type[2] != INT_RESULT)) {
+    strcpy(message, "Function requires 3 arguments, (string, string, int)");
+    return 1;
+  }
+
+  initid->ptr = NULL;
+  initid->max_length = LEVENSHTEIN_MAX;
+  initid->maybe_null = 0; //doesn't return null
+
+  return 0;
+}
+
+void levenshtein_k_utf8_deinit(UDF_INIT *initid) {
+  _udf_scratch_free(initid);
+}
+
+longlong levenshtein_k_utf8(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error) {
+  const char *s = args->args[0];
+  const char *t = args->args[1];
+  const int k = *((int*) args->args[2]);
+
+  int n = (s == NULL) ? 0 : args->lengths[0];
+  int m = (t == NULL) ? 0 : args->lengths[1];
+
+  uint32_t *s_cp, *t_cp;
+  longlong dist;
+
+  _arena_reset(initid);
+  switch (_utf8_remap(initid, &s, &n, &t, &m, &s_cp, &t_cp)) {
+  case 1:
+    break;
+  case 0:
+    if (abs(n - m) > k)
+      return k + 1;
+    if ((dist = _utf8_edit_row(initid, s_cp, n, t_cp, m, 0)) >= 0)
+      return MIN(dist, k + 1);
+    /* fall through */
+  default:
+    *error = 1;
+    return 0;
+  }
+
+  //lower bounds of the byte strings, one byte per code point
+  if (_prefilter_row(initid, s, n, t, m, k, 0))
+    return k + 1;
+
+  if (MIN(n, m) < LEVENSHTEIN_K_BP_MIN_LEN || k < LEVENSHTEIN_K_BP_MIN_K)
+    return _levenshtein_k_core(s, n, t, m, k);
+
+  //long strings: banded bit-parallel kernel, scratch kept for the following rows
+  BP_SCRATCH *bp = _bp_scratch_for(initid, MIN(n, m));
+  if (bp == NULL)
+    return _levenshtein_k_core(s, n, t, m, k);
+
+  return _levenshtein_k_bp_core(s, n, t, m, k, bp);
+}
+
+//-------------------------------------------------------------------------
+
+my_bool damerau_utf8_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
+    if ((args->arg_count != 2) ||
+        (args->arg_type[0] != STRING_RESULT || args->arg_type[1] != STRING_RESULT)) {
+        strcpy(message, "Function requires 2 arguments, (string, string)");
+        return 1;
+    }
+
+    initid->ptr = NULL;
+    initid->max_length = LEVENSHTEIN_MAX;
+    initid->maybe_null = 0; //doesn't return null
+
+    return 0;
+}
+
+void damerau_utf8_deinit(UDF_INIT *initid) {
+    _udf_scratch_free(initid);
+}
+
+longlong damerau_utf8(UDF_INIT *init, UDF_ARGS *args, char *is_null, char *error) {
+    const char *str1 = args->args[0];
+    const char *str2 = args->args[1];
+
+    int len1 = (str1 == NULL) ? 0 : args->lengths[0];
+    int len2 = (str2 == NULL) ? 0 : args->lengths[1];
+
+    uint32_t *cp1, *cp2;
+    longlong dist;
+
+    _arena_reset(init);
+    switch (_utf8_remap(init, &str1, &len1, &str2, &len2, &cp1, &cp2)) {
+    case 1:
+        break;
+    case 0:
+        if ((dist = _utf8_edit_row(init, cp1, len1, cp2, len2, 1)) >= 0)
+            return dist;
+        /* fall through */
+    default:
+        *error = 1;
+        return 0;
+    }
+
+    BP_SCRATCH *bp = _bp_scratch_for(init, MIN(len1, len2));
+    if (bp == NULL) {
+        *error = 1;
+        return 0;
+    }
+
+    return _damerau_bp_core(str1, len1, str2, len2, bp);
+}
+
+//-------------------------------------------------------------------------
+
+/*
+ * Fingerprints of levenshtein_signature
+ *
+ * Three lower bounds of the distance, that hold for every pair of strings
+ * the fingerprints come from:
+ * - the difference of the lengths;
+ * - the byte classes present in one string only: every byte of such a class
+ *   is deleted or substituted, one edit each, so a distance of at most k leaves
+ *   at most k classes of s absent from t, and the other way round;
+ * - the 2-grams present in one string only: an edit destroys at most 2 of
+ *   them, a transposition 3, so a distance of at most k leaves at most 2k (3k)
+ *   hashed 2-grams of s absent from t. A collision can only hide a missing one.
+ *
+ * The fingerprint is little endian whatever the byte order of the server, so
+ * that stored ones stay valid across replicas.
+ */
+#define SIGNATURE_CLASS(c) ((c) & 63)
+#define SIGNATURE_GRAM(a, b) ((((unsigned int) (a) << 3) ^ (b) ^ ((unsigned int) (a) >> 5)) & 127)
+
+static inline void _signature_put64(unsigned char *out, uint64_t v) {
+  int i;
+
+  for (i = 0; i < 8; i++, v >>= 8)
+    out[i] = (unsigned char) v;
+}
+
+static inline uint64_t _signature_get64(const unsigned char *in) {
+  uint64_t v = 0;
+  int i;
+
+  for (i = 7; i >= 0; i--)
+    v = (v << 8) | in[i];
+  return v;
+}
+
+/**
+ * @param s string, length n
+ * @param sig fingerprint of s
+ */
+inline void _signature_of(const char *s, const int n, SIGNATURE *sig) {
+  const unsigned char *u = (const unsigned char *) s;
+  int i, g;
+
+  memset(sig, 0, sizeof(SIGNATURE));
+  sig->len = (uint32_t) MAX(n, 0);
+  for (i = 0; i < n; i++) {
+    sig->classes |= (uint64_t) 1 << SIGNATURE_CLASS(u[i]);
+    if (i > 0) {
+      g = SIGNATURE_GRAM(u[i - 1], u[i]);
+      sig->grams[g >> 6] |= (uint64_t) 1 << (g & 63);
+    }
+  }
+}
+
+/**
+ * @param sig fingerprint
+ * @param out SIGNATURE_SIZE bytes
+ */
+inline void _signature_store(const SIGNATURE *sig, unsigned char *out) {
+  int i;
+
+  out[0] = SIGNATURE_VERSION;
+  out[1] = out[2] = out[3] = 0;
+  for (i = 0; i < 4; i++)
+    out[4 + i] = (unsigned char) (sig->len >> (8 * i));
+  _signature_put64(out + 8, sig->classes);
+  for (i = 0; i < SIGNATURE_GRAM_WORDS; i++)
+    _signature_put64(out + 16 + 8 * i, sig->grams[i]);
+}
+
+/**
+ * @param buf stored fingerprint, length len
+ * @param sig decoded fingerprint
+ * @result 1 if buf is a fingerprint of this version, 0 otherwise
+ */
+inline int _signature_load(const char *buf, const unsigned long len, SIGNATURE *sig) {
+  const unsigned char *u = (const unsigned char *) buf;
+  int i;
+
+  if (buf == NULL || len != SIGNATURE_SIZE || u[0] != SIGNATURE_VERSION)
+    return 0;
+  sig->len = (uint32_t) u[4] | ((uint32_t) u[5] << 8) | ((uint32_t) u[6] << 16) | ((uint32_t) u[7] << 24);
+  sig->classes = _signature_get64(u + 8);
+  for (i = 0; i < SIGNATURE_GRAM_WORDS; i++)
+    sig->grams[i] = _signature_get64(u + 16 + 8 * i);
+  return 1;
+}
+
+/**
+ * @param a fingerprint of string 1
+ * @param b fingerprint of string 2
+ * @param k maximum threshold
+ * @param transpositions 1 for the damerau distances, 0 for levenshtein
+ * @result 0 if the distance is certainly greater than k, 1 otherwise
+ */
+inline int _signature_may_match(const SIGNATURE *a, const SIGNATURE *b, const int k, const int transpositions) {
+  const longlong per_edit = transpositions ? 3 : 2;
+  int only_a = 0, only_b = 0;
+  int i;
+
+  if (k < 0)
+    return 0;
+  if ((a->len > b->len ? a->len - b->len : b->len - a->len) > (uint32_t) k)
+    return 0;
+  if (__builtin_popcountll(a->classes & ~b->classes) > k || __builtin_popcountll(b->classes & ~a->classes) > k)
+    return 0;
+  for (i = 0; i < SIGNATURE_GRAM_WORDS; i++) {
+    only_a += __builtin_popcountll(a->grams[i] & ~b->grams[i]);
+    only_b += __builtin_popcountll(b->grams[i] & ~a->grams[i]);
+  }
+  return MAX(only_a, only_b) <= per_edit * k;
+}
+
+my_bool levenshtein_signature_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
+  if ((args->arg_count != 1) || (args->arg_type[0] != STRING_RESULT)) {
+    strcpy(message, "Function requires 1 argument, (string)");
+    return 1;
+  }
+
+  initid->ptr = NULL;
+  initid->max_length = SIGNATURE_SIZE;
+  initid->maybe_null = 0; //doesn't return null
+
+  return 0;
+}
+
+void levenshtein_signature_deinit(UDF_INIT *initid) {
+}
+
+char *levenshtein_signature(UDF_INIT *initid, UDF_ARGS *args, char *result,
+                            unsigned long *length, char *is_null, char *error) {
+  const char *s = args->args[0];
+  const int n = (s == NULL) ? 0 : args->lengths[0];
+  SIGNATURE sig;
+
+  _signature_of(s, n, &sig);
+  _signature_store(&sig, (unsigned char *) result);
+  *length = SIGNATURE_SIZE;
+
+  return result;
+}
+
+my_bool levenshtein_sig_may_match_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
+  if ((args->arg_count != 3 && args->arg_count != 4) ||
+      (args->arg_type[0] != STRING_RESULT || args->arg_type[1] != STRING_RESULT || args->arg_type[2] != INT_RESULT) ||
+      (args->arg_count == 4 && args->arg_type[3] != INT_RESULT)) {
+    strcpy(message, "Function requires 3 or 4 arguments, (string, string, int [, int])");
+    return 1;
+  }
+
+  initid->ptr = NULL;
+  initid->max_length = 1;
+  initid->maybe_null = 0; //doesn't return null
+
+  return 0;
+}
+
+void levenshtein_sig_may_match_deinit(UDF_INIT *initid) {
+}
+
+longlong levenshtein_sig_may_match(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error) {
+  const int transpositions = (args->arg_count == 4 && args->args[3] != NULL && *((int*) args->args[3]) != 0);
+  SIGNATURE a, b;
+
+  //nothing is proven about a NULL or foreign value
+  if (args->args[2] == NULL ||
+      !_signature_load(args->args[0], args->lengths[0], &a) || !_signature_load(args->args[1], args->lengths[1], &b))
+    return 1;
+
+  return _signature_may_match(&a, &b, *((int*) args->args[2]), transpositions);
+}
+
+//-------------------------------------------------------------------------
+
+/*
+ * Partition keys of the fuzzy joins
+ *
+ * Take an optimal alignment of r, cut into k + 1 segments, with s, and the
+ * first segment i that no edit touches: each of the segments before it takes
+ * at least one edit, so with delta the shift of segment i in s and D = |s| - |r|,
+ * max(i, |delta|) edits come before it and at least |D - delta| after it.
+ * Segment i of r is then the substring of s at its position plus delta, for a
+ * delta with max(i, |delta|) + |D - delta| <= k: the probes of s are all those
+ * substrings, for every length |r| within k of |s|. A string no longer than k
+ * has an empty first segment, whose key every probe of that length has too:
+ * it is the one key and the one probe of the lengths up to k.
+ */
+#define PARTITION_KEY_MAX 26 //bytes of a key besides its segment: quotes, "l:i:" and a comma
+
+/**
+ * @param l length of the string
+ * @param k maximum threshold, the string has k + 1 segments
+ * @param i segment
+ * @param start offset of segment i
+ * @param len length of segment i, the last l % (k + 1) segments are one longer
+ */
+inline void _partition_segment(const int l, const int k, const int i, int *start, int *len) {
+  const int parts = k + 1;
+  const int shorter = parts - l % parts;
+
+  *start = i * (l / parts) + MAX(0, i - shorter);
+  *len = l / parts + (i >= shorter);
+}
+
+/**
+ * @param out buffer of PARTITION_KEY_MAX + 6 * len bytes
+ * @result end of the key "l:i:seg", written as a JSON string
+ */
+inline char *_partition_key_to(char *out, const int l, const int i, const char *seg, const int len) {
+  *out++ = '"';
+  out += sprintf(out, "%d:%d:", l, i);
+  out = _json_escape_to(out, seg, len, 1);
+  *out++ = '"';
+
+  return out;
+}
+
+my_bool levenshtein_partition_keys_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
+  if ((args->arg_count != 2) || (args->arg_type[0] != STRING_RESULT || args->arg_type[1] != INT_RESULT)) {
+    strcpy(message, "Function requires 2 arguments, (string, int)");
+    return 1;
+  }
+
+  initid->ptr = NULL; //arena of the result
+  initid->max_length = 65535; //a JSON array, as long as it takes
+  initid->maybe_null = 1; //null for a negative k
+
+  return 0;
+}
+
+void levenshtein_partition_keys_deinit(UDF_INIT *initid) {
+  _udf_scratch_free(initid);
+}
+
+char *levenshtein_partition_keys(UDF_INIT *initid, UDF_ARGS *args, char *result,
+                                 unsigned long *length, char *is_null, char *error) {
+  const char *s = args->args[0];
+  const int n = (s == NULL) ? 0 : args->lengths[0];
+  const int k = (args->args[1] == NULL) ? -1 : *((int*) args->args[1]);
+  int i, start, len;
+
+  if (k < 0) {
+    *is_null = 1;
+    return NULL;
+  }
+
+  _arena_reset(initid);
+  char *out = (char *) _arena_alloc(initid, (size_t) (MIN(k, n) + 1) * PARTITION_KEY_MAX + 6 * (size_t) n + 2);
+  if (out == NULL) {
+    *error = 1;
+    return NULL;
+  }
+
+  char *o = out;
+  *o++ = '[';
+  for (i = 0; i <= ((n <= k) ? 0 : k); i++) {
+    _partition_segment(n, k, i, &start, &len);
+    if (i > 0)
+      *o++ = ',';
+    o = _partition_key_to(o, n, i, s + start, len);
+  }
+  *o++ = ']';
+
+  *length = o - out;
+  return out;
+}
+
+my_bool levenshtein_partition_probes_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
+  if ((args->arg_count != 2) || (args->arg_type[0] != STRING_RESULT || args->arg_type[1] != INT_RESULT)) {
+    strcpy(message, "Function requires 2 arguments, (string, int)");
+    return 1;
+  }
+
+  initid->ptr = NULL; //arena of the result
+  initid->max_length = 65535; //a JSON array, as long as it takes
+  initid->maybe_null = 1; //null for a negative k
+
+  return 0;
+}
+
+void levenshtein_partition_probes_deinit(UDF_INIT *initid) {
+  _udf_scratch_free(initid);
+}
+
+char *levenshtein_partition_probes(UDF_INIT *initid, UDF_ARGS *args, char *result,
+                                   unsigned long *length, char *is_null, char *error) {
+  const char *s = args->args[0];
+  const int n = (s == NULL) ? 0 : args->lengths[0];
+  const int k = (args->args[1] == NULL) ? -1 : *((int*) args->args[1]);
+  int l, i, delta, start, len, prev;
+  size_t x;
+
+  if (k < 0) {
+    *is_null = 1;
+    return NULL;
+  }
+
+  //the lengths up to k have their one key "l:0:"; the min(n, 2k + 1) longer ones k + 1 segments of at least a
+  //byte, each at no more than min(2k + 1, n) positions of s and of at most (n + k) / (k + 1) + 1 bytes. Sized
+  //in size_t: lengths over INT_MAX or a size over size_t are out of memory
+  _arena_reset(initid);
+  const size_t short_lengths = (n - k <= k) ? (size_t) k - MAX(0, n - k) + 1 : 0;
+  const size_t long_lengths = MIN((size_t) n, 2 * (size_t) k + 1);
+  const size_t shifts = MIN(2 * (size_t) k + 1, (size_t) n);
+  const size_t probe_max = PARTITION_KEY_MAX + 6 * (((size_t) n + k) / ((size_t) k + 1) + 1);
+  if ((n > 0 && (size_t) n + k > INT_MAX) ||
+      (n > 0 && long_lengths * ((size_t) k + 1) > SIZE_MAX / 2 / probe_max / shifts)) {
+    *error = 1;
+    return NULL;
+  }
+  char *out = (char *) _arena_alloc(initid, short_lengths * PARTITION_KEY_MAX +
+                                            long_lengths * ((size_t) k + 1) * shifts * probe_max + 2);
+  if (out == NULL) {
+    *error = 1;
+    return NULL;
+  }
+
+  char *o = out;
+  *o++ = '[';
+  for (x = 0; x < short_lengths; x++) {
+    if (x > 0)
+      *o++ = ',';
+    o = _partition_key_to(o, MAX(0, n - k) + (int) x, 0, s, 0);
+  }
+  for (x = 0; x < long_lengths; x++) {
+    l = MAX(n - k, k + 1) + (int) x;
+    const int d = n - l;
+    for (i = 0; i <= k; i++) {
+      _partition_segment(l, k, i, &start, &len);
+      prev = -1; //position of the last probe of this segment
+      //only the shifts that keep the segment within s
+      for (delta = MAX(-k, -start); delta <= MIN(k, n - len - start); delta++) {
+        const int pos = start + delta;
+        if (MAX(i, abs(delta)) + abs(d - delta) > k)
+          continue;
+        //the same substring at the next shift, e.g. in a run of one byte, is one probe
+        if (prev >= 0 && memcmp(s + prev, s + pos, len) == 0)
+          continue;
+        if (o > out + 1)
+          *o++ = ',';
+        o = _partition_key_to(o, l, i, s + pos, len);
+        prev = pos;
+      }
+    }
+  }
+  *o++ = ']';
+
+  *length = o - out;
+  return out;
+}
+
+//-------------------------------------------------------------------------
+
+/**
+ * @param value copied into the buffer of e, grown as needed
+ * @result 0, 1 if out of memory
+ */
+static int _group_best_set(GROUP_BEST *e, const char *value, const int len, const longlong dist,
+                           const ulonglong row) {
+  if ((size_t) len > e->size) {
+    char *buf = (char *) realloc(e->value, len);
+    if (buf == NULL)
+      return 1;
+    e->value = buf;
+    e->size = len;
+  }
+  memcpy(e->value, value, len);
+  e->len = len;
+  e->dist = dist;
+  e->row = row;
+  e->found = 1;
+
+  return 0;
+}
+
+my_bool levenshtein_argmin_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
+  if ((args->arg_count != 3) ||
+      (args->arg_type[0] != STRING_RESULT || args->arg_type[1] != STRING_RESULT || args->arg_type[2] != INT_RESULT)) {
+    strcpy(message, "Function requires 3 arguments, (string, string, int)");
+    return 1;
+  }
+
+  initid->ptr = NULL;
+  initid->max_length = args->lengths[1]; //the longest value
+  initid->maybe_null = 1; //null when no value of the group is within k
+
+  //the group state lives in the scratch, which a constant pattern also needs
+  if (_udf_scratch(initid) == NULL || _udf_pattern_init(initid, args, 0, PATTERN_COMPILE)) {
+    _udf_scratch_free(initid);
+    strcpy(message, "Not enough memory for the group state");
+    return 1;
+  }
+
+  return 0;
+}
+
+void levenshtein_argmin_deinit(UDF_INIT *initid) {
+  _udf_scratch_free(initid);
+}
+
+void levenshtein_argmin_clear(UDF_INIT *initid, char *is_null, char *error) {
+  UDF_SCRATCH *sc = (UDF_SCRATCH*) initid->ptr;
+
+  sc->best.found = 0;
+}
+
+void levenshtein_argmin_add(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error) {
+  UDF_SCRATCH *sc = (UDF_SCRATCH*) initid->ptr;
+  const char *s = args->args[0];
+  const char *t = args->args[1];
+  const int n = (s == NULL) ? 0 : args->lengths[0];
+  const int m = (t == NULL) ? 0 : args->lengths[1];
+  int k = (args->args[2] == NULL) ? -1 : *((int*) args->args[2]);
+  longlong dist;
+
+  //only a strictly closer value replaces the best one, ties keep the first
+  if (sc->best.found)
+    k = MIN(k, sc->best.dist - 1);
+  if (t == NULL || k < 0)
+    return;
+
+  dist = _levenshtein_k_row(initid, s, n, t, m, k);
+  if (dist <= k && _group_best_set(&sc->best, t, m, dist, 0))
+    *error = 1;
+}
+
+void levenshtein_argmin_reset(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error) {
+  levenshtein_argmin_clear(initid, is_null, error);
+  levenshtein_argmin_add(initid, args, is_null, error);
+}
+
+char *levenshtein_argmin(UDF_INIT *initid, UDF_ARGS *args, char *result,
+                         unsigned long *length, char *is_null, char *error) {
+  const UDF_SCRATCH *sc = (UDF_SCRATCH*) initid->ptr;
+
+  if (!sc->best.found) {
+    *is_null = 1;
+    return NULL;
+  }
+
+  *length = sc->best.len;
+  return (sc->best.len > 0) ? sc->best.value : result;
+}
+
+//-------------------------------------------------------------------------
+
+//the value given up first: the farthest, of those the last to arrive
+static inline int _topn_after(const GROUP_BEST *a, const GROUP_BEST *b) {
+  return a->dist > b->dist || (a->dist == b->dist && a->row > b->row);
+}
+
+static int _topn_order(const void *a, const void *b) {
+  return _topn_after(*(const GROUP_BEST **) a, *(const GROUP_BEST **) b)
+         - _topn_after(*(const GROUP_BEST **) b, *(const GROUP_BEST **) a);
+}
+
+static void _topn_swap(GROUP_TOPN *tn, const int i, const int j) {
+  const GROUP_BEST e = tn->heap[i];
+
+  tn->heap[i] = tn->heap[j];
+  tn->heap[j] = e;
+}
+
+static void _topn_sift_up(GROUP_TOPN *tn, int i) {
+  while (i > 0 && _topn_after(&tn->heap[i], &tn->heap[(i - 1) / 2])) {
+    _topn_swap(tn, i, (i - 1) / 2);
+    i = (i - 1) / 2;
+  }
+}
+
+static void _topn_sift_down(GROUP_TOPN *tn, int i) {
+  int child;
+
+  while ((child = 2 * i + 1) < tn->count) {
+    if (child + 1 < tn->count && _topn_after(&tn->heap[child + 1], &tn->heap[child]))
+      child++;
+    if (!_topn_after(&tn->heap[child], &tn->heap[i]))
+      break;
+    _topn_swap(tn, i, child);
+    i = child;
+  }
+}
+
+my_bool levenshtein_topn_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
+  if ((args->arg_count != 4) ||
+      (args->arg_type[0] != STRING_RESULT || args->arg_type[1] != STRING_RESULT ||
+       args->arg_type[2] != INT_RESULT || args->arg_type[3] != INT_RESULT)) {
+    strcpy(message, "Function requires 4 arguments, (string, string, int, int)");
+    return 1;
+  }
+
+  initid->ptr = NULL;
+  initid->max_length = 65535; //a JSON array, as long as it takes
+  initid->maybe_null = 1; //null when no value of the group is within k
+
+  //the group state lives in the scratch, which a constant pattern also needs
+  if (_udf_scratch(initid) == NULL || _udf_pattern_init(initid, args, 0, PATTERN_COMPILE)) {
+    _udf_scratch_free(initid);
+    strcpy(message, "Not enough memory for the group state");
+    return 1;
+  }
+
+  return 0;
+}
+
+void levenshtein_topn_deinit(UDF_INIT *initid) {
+  _udf_scratch_free(initid);
+}
+
+void levenshtein_topn_clear(UDF_INIT *initid, char *is_null, char *error) {
+  UDF_SCRATCH *sc = (UDF_SCRATCH*) initid->ptr;
+
+  sc->topn.count = 0;
+  sc->topn.rows = 0;
+}
+
+void levenshtein_topn_add(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error) {
+  UDF_SCRATCH *sc = (UDF_SCRATCH*) initid->ptr;
+  GROUP_TOPN *tn = &sc->topn;
+  const char *s = args->args[0];
+  const char *t = args->args[1];
+  const int n = (s == NULL) ? 0 : args->lengths[0];
+  const int m = (t == NULL) ? 0 : args->lengths[1];
+  const int top = (args->args[2] == NULL) ? 0 : *((int*) args->args[2]);
+  int k = (args->args[3] == NULL) ? -1 : *((int*) args->args[3]);
+  longlong dist;
+
+  //a smaller n than on the previous rows gives up the farthest values
+  while (tn->count > MAX(top, 0)) {
+    _topn_swap(tn, 0, --tn->count);
+    _topn_sift_down(tn, 0);
+  }
+
+  //once full, only a value strictly closer than the farthest kept one gets in
+  if (tn->count > 0 && tn->count == top)
+    k = MIN(k, tn->heap[0].dist - 1);
+  if (t == NULL || k < 0 || top <= 0)
+    return;
+
+  tn->rows++;
+  dist = _levenshtein_k_row(initid, s, n, t, m, k);
+  if (dist > k)
+    return;
+
+  if (tn->count == top) {
+    if (_group_best_set(&tn->heap[0], t, m, dist, tn->rows)) {
+      *error = 1;
+      return;
+    }
+    _topn_sift_down(tn, 0);
+    return;
+  }
+
+  if (tn->count == tn->capacity) {
+    const int capacity = MAX(2 * tn->capacity, 8);
+    GROUP_BEST *heap = (GROUP_BEST *) realloc(tn->heap, capacity * sizeof(GROUP_BEST));
+    if (heap == NULL) {
+      *error = 1;
+      return;
+    }
+    memset(heap + tn->capacity, 0, (capacity - tn->capacity) * sizeof(GROUP_BEST));
+    tn->heap = heap;
+    tn->capacity = capacity;
+  }
+  if (_group_best_set(&tn->heap[tn->count], t, m, dist, tn->rows)) {
+    *error = 1;
+    return;
+  }
+  _topn_sift_up(tn, tn->count++);
+}
+
+void levenshtein_topn_reset(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error) {
+  levenshtein_topn_clear(initid, is_null, error);
+  levenshtein_topn_add(initid, args, is_null, error);
+}
+
+char *levenshtein_topn(UDF_INIT *initid, UDF_ARGS *args, char *result,
+                       unsigned long *length, char *is_null, char *error) {
+  UDF_SCRATCH *sc = (UDF_SCRATCH*) initid->ptr;
+  const GROUP_TOPN *tn = &sc->topn;
+  size_t size = 2;
+  int i;
+
+  if (tn->count == 0) {
+    *is_null = 1;
+    return NULL;
+  }
+
+  //values closest first, the heap stays as it is
+  for (i = 0; i < tn->count; i++)
+    size += 6 * (size_t) tn->heap[i].len + 32;
+  _arena_reset(initid);
+  const GROUP_BEST **order = (const GROUP_BEST **) _arena_alloc(initid, tn->count * sizeof(GROUP_BEST *));
+  char *out = (char *) _arena_alloc(initid, size);
+  if (order == NULL || out == NULL) {
+    *error = 1;
+    return NULL;
+  }
+  for (i = 0; i < tn->count; i++)
+    order[i] = &tn->heap[i];
+  qsort(order, tn->count, sizeof(GROUP_BEST *), _topn_order);
+
+  char *o = out;
+  *o++ = '[';
+  for (i = 0; i < tn->count; i++) {
+    if (i > 0) {
+      *o++ = ',';
+      *o++ = ' ';
+    }
+    *o++ = '[';
+    *o++ = '"';
+    o = _json_escape_to(o, order[i]->value, order[i]->len, 0);
+    o += sprintf(o, "\", %lld]", order[i]->dist);
+  }
+  *o++ = ']';
+
+  *length = o - out;
+  return out;
+}
+
+//-------------------------------------------------------------------------
+
+/*
+ * Files of the dictionary directory
  *
+ * Only mysqld's own configuration names the directory: the paths given to the
+ * functions are relative to it and may not leave it.
  */
-longlong levenshtein_k(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error) {
-  char *s = args->args[0];
-  char *t = args->args[1];
-  const int k = *((int*) args->args[2]);
 
-  return _levenshtein_k_core(s,args->lengths[0], t, args->lengths[1], k);
+/**
+ * @result 0 with the full path of path in full, 1 if it is not a path of the dictionary directory
+ */
+static int _dict_path(const char *path, const int path_len, char *full, const size_t full_size) {
+  const char *dir = getenv(DICT_DIR_ENV);
+  int i;
+
+  if (dir == NULL || *dir == '\0' || path == NULL || path_len == 0 || memchr(path, '\0', path_len) != NULL ||
+      path[0] == '/' || (path_len == 2 && memcmp(path, "..", 2) == 0) ||
+      (path_len >= 3 && (memcmp(path, "../", 3) == 0 || memcmp(path + path_len - 3, "/..", 3) == 0)))
+    return 1;
+  for (i = 0; i + 4 <= path_len; i++) {
+    if (memcmp(path + i, "/../", 4) == 0)
+      return 1;
+  }
+  return snprintf(full, full_size, "%s/%.*s", dir, path_len, path) >= (int) full_size;
 }
 
-inline longlong _levenshtein_k_core(const char *s, const int s_len, const char *t, const int t_len, const int k) {
+/**
+ * @result content of path, NULL if it is not a file of the dictionary directory
+ */
+static char *_dict_read(const char *path, const int path_len, size_t *size) {
+  char full[4096];
+  char *buf = NULL;
+  FILE *f;
+  long len;
+
+  if (_dict_path(path, path_len, full, sizeof(full)))
+    return NULL;
+
+  if ((f = fopen(full, "rb")) == NULL)
+    return NULL;
+  if (fseek(f, 0, SEEK_END) == 0 && (len = ftell(f)) >= 0 && len < (long) UINT32_MAX &&
+      fseek(f, 0, SEEK_SET) == 0 && (buf = (char *) malloc(len + 1)) != NULL) {
+    if (fread(buf, 1, len, f) != (size_t) len) {
+      free(buf);
+      buf = NULL;
+    }
+    *size = len;
+  }
+  fclose(f);
 
-  int n = (s == NULL) ? 0 : s_len;
-  int m = (t == NULL) ? 0 : t_len;
+  return buf;
+}
 
-  //order the strings so that the first always has the minimum length l
-  if (n > m) {
-    int aux = n;
-    n = m;
-    m = aux;
-    const char *auxs = s;
-    s = t;
-    t = auxs;
+//-------------------------------------------------------------------------
+
+/*
+ * Dictionaries of bktree_load and trie_load
+ *
+ * A dictionary never changes once built: searches of every connection share
+ * it without locking, holding a reference. Loading a name again replaces its
+ * dictionary in the registry, the last search still holding the old one
+ * frees it.
+ */
+static pthread_mutex_t _dict_lock = PTHREAD_MUTEX_INITIALIZER;
+static DICT *_dicts; //registry, guarded by _dict_lock
+
+static void _dict_free(DICT *dict) {
+  if (dict->kind == DICT_BKTREE)
+    _bktree_free((BKTREE *) dict);
+  else
+    _trie_free((TRIE *) dict);
+}
+
+/**
+ * @result the dictionary of the kind loaded under name, with a reference for the caller, NULL if none
+ */
+DICT *_dict_acquire(const int kind, const char *name, const int len) {
+  DICT *dict;
+
+  pthread_mutex_lock(&_dict_lock);
+  for (dict = _dicts; dict != NULL; dict = dict->next) {
+    if (dict->kind == kind && (int) strlen(dict->name) == len && memcmp(dict->name, name, len) == 0) {
+      dict->refs++;
+      break;
+    }
   }
+  pthread_mutex_unlock(&_dict_lock);
 
-  const int ignore = k + 1; //lev dist between s and t is at least greater than k
-  const int r = m - n;
+  return dict;
+}
 
-  if (0 == n)
-    return (m > k) ? ignore : m;
-  if (0 == m)
-    return (n > k) ? ignore : n;
-  if (r > k)
-    return ignore;
+void _dict_release(DICT *dict) {
+  int refs;
 
-  const int lsize = (((k > m) ? m : k) - r) / 2; //left space for insertions
-  const int rsize = lsize + r; //right space for deletions, rsize >= lsize (rsize == lsize iff r == 0)
-  const int stripsize = lsize + rsize + 1; // + 1 for the diagonal cell
-  const int stripsizem1 = stripsize - 1; //see later, not to repeat calculations
+  if (dict == NULL)
+    return;
+  pthread_mutex_lock(&_dict_lock);
+  refs = --dict->refs;
+  pthread_mutex_unlock(&_dict_lock);
+  if (refs == 0)
+    _dict_free(dict);
+}
 
-  int d[2 * stripsize]; //Current and last rows
-  int currentrow;
-  int lastrow;
+//registers dict, replacing the one of the same kind and name
+static void _dict_publish(DICT *dict) {
+  DICT **link, *old = NULL;
+
+  dict->refs = 1;
+  pthread_mutex_lock(&_dict_lock);
+  for (link = &_dicts; *link != NULL; link = &(*link)->next) {
+    if ((*link)->kind == dict->kind && strcmp((*link)->name, dict->name) == 0) {
+      old = *link;
+      *link = old->next;
+      break;
+    }
+  }
+  dict->next = _dicts;
+  _dicts = dict;
+  pthread_mutex_unlock(&_dict_lock);
 
-  /* Initialization */
+  _dict_release(old);
+}
 
-  //currentrow = 0
-  int i;
-  for (i = lsize; i < stripsize; i++) //start from diagonal cell
-    d[i] = i - lsize;
+//the UDFs are dropped before the plugin is unloaded, no search is running
+__attribute__((destructor)) static void _dict_fini(void) {
+  DICT *dict, *next;
 
-  /* Recurrence */
+  for (dict = _dicts; dict != NULL; dict = next) {
+    next = dict->next;
+    _dict_free(dict);
+  }
+  _dicts = NULL;
+}
 
-  currentrow = stripsize;
-  lastrow = 0;
+/**
+ * @result the dictionary of the previous row of the statement, or the one loaded under name if it
+ *         changed; NULL if none
+ */
+static const DICT *_dict_for(UDF_SCRATCH *sc, const int kind, const char *name, const int len) {
+  if (sc->dict == NULL || (int) strlen(sc->dict->name) != len || memcmp(sc->dict->name, name, len) != 0) {
+    _dict_release(sc->dict);
+    sc->dict = _dict_acquire(kind, name, len);
+  }
+  return sc->dict;
+}
 
-  //j index for virtual recurrence matrix, jv index for rows
-  //bl & br = left & right bounds for j
-  int j, jv, bl, br;
-  int im1 = 0, jm1;
-  int a, b, c, min; //for minimum function, coded directly here for maximum speed
-  for (i = 1; i <= n; i++) {
+//of the words found, {distance, rank, node}: by distance then rank, the line of bktree_search
+static int _dict_match_order(const void *a, const void *b) {
+  const uint32_t *x = (const uint32_t *) a, *y = (const uint32_t *) b;
 
-    //bl = max(i - lsize, 0), br = min(i + rsize, m)
-    bl = i - lsize;
-    if (bl < 0) {
-      jv = abs(bl); //no space for all allowed insertions
-      bl = 0;
-    }
-    else
-      jv = 0;
-    br = i + rsize;
-    if (br > m)
-      br = m;
+  if (x[0] != y[0])
+    return (x[0] < y[0]) ? -1 : 1;
+  return (x[1] < y[1]) ? -1 : (x[1] > y[1]);
+}
 
-    jm1 = bl - 1;
-    for (j = bl; j <= br; j++) {
-      if (0 == j) //postponed part of initialization
-        d[currentrow + jv] = i;
-      else {
-        //By observation 3, the indices change for the lastrow (always +1)
-        if (s[im1] == t[jm1]) {
-          d[currentrow + jv] = d[lastrow + jv];
-        }
-        else {
-          //get the minimum of these 3 operations
-          a = (0 == jv) ? ignore : d[currentrow + jv - 1]; //deletion
-          b = (stripsizem1 == jv) ? ignore : d[lastrow + jv + 1]; //insertion
-          c = d[lastrow + jv]; //substitution
+//-------------------------------------------------------------------------
 
-          min = a;
-          if (b < min)
-            min = b;
-          if (c < min)
-            min = c;
+/*
+ * BK-trees of the dictionaries of bktree_load
+ *
+ * The children of a node are words at distance 1, 2, ... of its word, one per
+ * distance (the edge). A search for q within k only goes down to the children
+ * whose edge e has |d(q, node) - e| <= k, by the triangle inequality. So the
+ * distance to a node is needed exactly only up to k plus its largest edge,
+ * past that neither the node nor any child is in reach, and the k-bounded
+ * kernels stop there.
+ *
+ * The nodes are laid out breadth first in one array, the children of a node
+ * next to each other by edge; the words stay in the content of the file. A
+ * tree never changes once built, see _dict_for.
+ */
+void _bktree_free(BKTREE *tree) {
+  free(tree->words);
+  free(tree->line);
+  free(tree->nodes);
+  free(tree);
+}
 
-          d[currentrow + jv] = min + 1;
-        }
-      }
-      jv++;
-      jm1 = j;
-    }
+static int _bktree_edge_order(const void *a, const void *b) {
+  return (int) ((const BKTREE_NODE *) a)->edge - (int) ((const BKTREE_NODE *) b)->edge;
+}
 
-    //obsv: the cost of a following diagonal never decreases
-    if (d[currentrow + lsize + r] > k)
-      return ignore;
+/*
+ * The words are inserted as usual, with the child lists linked, then the
+ * nodes are copied breadth first and their words in the same order, so that
+ * the words of siblings, compared one after another, are next to each other.
+ * The content of the file, pool, is freed.
+ */
+BKTREE *_bktree_build(char *pool, const size_t size) {
+  BKTREE *tree = (BKTREE *) calloc(1, sizeof(BKTREE));
+  BKTREE_NODE *tmp = NULL;
+  uint32_t *head = NULL, *next = NULL, *queue = NULL;
+  BP_SCRATCH *bp = NULL;
+  uint32_t count = 0, words = 0, i, j, cur, child, out;
+  size_t p, q;
+  int max_len = 0, d;
+
+  if (tree == NULL)
+    goto fail;
+  tree->dict.kind = DICT_BKTREE;
+
+  for (p = 0; p < size; p = q + 1) {
+    for (q = p; q < size && pool[q] != '\n'; q++);
+    words++;
+  }
+  tmp = (BKTREE_NODE *) malloc(MAX(words, 1) * sizeof(BKTREE_NODE));
+  head = (uint32_t *) malloc(MAX(words, 1) * sizeof(uint32_t));
+  next = (uint32_t *) malloc(MAX(words, 1) * sizeof(uint32_t));
+  if (tmp == NULL || head == NULL || next == NULL)
+    goto fail;
+
+  for (p = 0; p < size; p = q + 1) {
+    for (q = p; q < size && pool[q] != '\n'; q++);
+    const int len = (int) (q - p) - (q > p && pool[q - 1] == '\r');
+    if (len == 0 || len > DICT_WORD_MAX)
+      continue;
+    if (len > max_len && (bp = _bp_scratch_reserve(bp, len)) == NULL)
+      goto fail;
+    max_len = MAX(max_len, len);
+
+    const char *w = pool + p;
+    tmp[count].word = (uint32_t) p;
+    tmp[count].len = (uint16_t) len;
+    tmp[count].children = 0;
+    tmp[count].max_edge = 0;
+    head[count] = UINT32_MAX;
+    if (count == 0) {
+      tmp[count++].edge = 0;
+      continue;
+    }
 
-    im1 = i;
+    _bp_needle_set(bp, w, len, NULL);
+    for (cur = 0; ; cur = child) {
+      d = (int) _levenshtein_bp_core(w, len, pool + tmp[cur].word, tmp[cur].len, bp);
+      if (d == 0) //already in the tree
+        break;
+      for (child = head[cur]; child != UINT32_MAX && tmp[child].edge != d; child = next[child]);
+      if (child == UINT32_MAX) {
+        tmp[count].edge = (uint16_t) d;
+        next[count] = head[cur];
+        head[cur] = count;
+        tmp[cur].children++;
+        tmp[cur].max_edge = (uint16_t) MAX(tmp[cur].max_edge, d);
+        count++;
+        break;
+      }
+    }
+    _bp_needle_clear(bp, len, NULL);
+  }
 
-    //swap
-    currentrow = currentrow ^ stripsize;
-    lastrow = lastrow ^ stripsize;
+  //breadth first: queue[i] is the node of the building tree copied to nodes[i]
+  tree->nodes = (BKTREE_NODE *) malloc(MAX(count, 1) * sizeof(BKTREE_NODE));
+  queue = (uint32_t *) malloc(MAX(count, 1) * sizeof(uint32_t));
+  if (tree->nodes == NULL || queue == NULL)
+    goto fail;
+  if (count > 0) {
+    queue[0] = 0;
+    tree->nodes[0] = tmp[0];
+  }
+  for (i = 0, out = 1; i < count; i++) {
+    BKTREE_NODE *node = &tree->nodes[i];
+    node->first_child = out;
+    for (child = head[queue[i]], j = out; child != UINT32_MAX; child = next[child], j++) {
+      tree->nodes[j] = tmp[child];
+      tree->nodes[j].first_child = child; //building index until sorted
+    }
+    qsort(tree->nodes + out, node->children, sizeof(BKTREE_NODE), _bktree_edge_order);
+    for (j = out; j < out + node->children; j++)
+      queue[j] = tree->nodes[j].first_child;
+    out += node->children;
+  }
+  tree->count = count;
+
+  //the words, in the order of the nodes
+  for (i = 0, p = 0; i < count; i++)
+    p += tree->nodes[i].len;
+  tree->words = (char *) malloc(MAX(p, 1));
+  tree->line = (uint32_t *) malloc(MAX(count, 1) * sizeof(uint32_t));
+  if (tree->words == NULL || tree->line == NULL)
+    goto fail;
+  for (i = 0, p = 0; i < count; i++) {
+    memcpy(tree->words + p, pool + tree->nodes[i].word, tree->nodes[i].len);
+    tree->line[i] = tree->nodes[i].word;
+    tree->nodes[i].word = (uint32_t) p;
+    p += tree->nodes[i].len;
   }
 
-  //only here if levenhstein(s, t) <= k
-  return (longlong) d[lastrow + lsize + r]; //d[n, m]
+  free(tmp);
+  free(head);
+  free(next);
+  free(queue);
+  free(pool);
+  _bp_scratch_free(bp);
+  return tree;
+
+fail:
+  free(tmp);
+  free(head);
+  free(next);
+  free(queue);
+  _bp_scratch_free(bp);
+  if (tree != NULL)
+    _bktree_free(tree);
+  free(pool);
+  return NULL;
 }
 
-//-------------------------------------------------------------------------
-
-my_bool levenshtein_k_ratio_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
-  if ((args->arg_count != 3) ||
-      (args->arg_type[0] != STRING_RESULT || args->arg_type[1] != STRING_RESULT || args->arg_type[2] != INT_RESULT)) {
-    strcpy(message, "Function requires 3 arguments, (string, string, int)");
+my_bool bktree_load_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
+  if ((args->arg_count != 2) || (args->arg_type[0] != STRING_RESULT || args->arg_type[1] != STRING_RESULT)) {
+    strcpy(message, "Function requires 2 arguments, (string, string)");
     return 1;
   }
 
   initid->ptr = NULL;
-  initid->max_length = LEVENSHTEIN_MAX;
-  initid->maybe_null = 0; //doesn't return null
+  initid->max_length = 10;
+  initid->maybe_null = 1; //null when the file cannot be loaded
 
   return 0;
 }
 
-void levenshtein_k_ratio_deinit(UDF_INIT *initid) {
-    if (initid->ptr != NULL)
-        free(initid->ptr);
+void bktree_load_deinit(UDF_INIT *initid) {
 }
 
-double levenshtein_k_ratio(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error) {
-  const char *s = args->args[0];
-  const char *t = args->args[1];
-  const int k = *((int*) args->args[2]);
+longlong bktree_load(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error) {
+  const char *name = args->args[0];
+  const char *path = args->args[1];
+  BKTREE *tree;
+  size_t size = 0;
+  uint32_t count;
+  char *pool;
+
+  if (name == NULL || path == NULL || args->lengths[0] == 0 || args->lengths[0] > DICT_NAME_MAX ||
+      (pool = _dict_read(path, args->lengths[1], &size)) == NULL ||
+      (tree = _bktree_build(pool, size)) == NULL) {
+    *is_null = 1;
+    return 0;
+  }
 
-  int n = (s == NULL) ? 0 : args->lengths[0];
-  int m = (t == NULL) ? 0 : args->lengths[1];
-  double maxlen = MAX(n, m);
-  if (maxlen == 0)
-    return 0.0;
+  //the tree belongs to the registry once published, and may be replaced right away
+  count = tree->count;
+  memcpy(tree->dict.name, name, args->lengths[0]);
+  tree->dict.name[args->lengths[0]] = '\0';
+  _dict_publish(&tree->dict);
 
-  double dist = (double)levenshtein_k(initid, args, is_null, error);
-  if (dist > k)
-    return 0.0;
-  else
-    return 1.0 - dist/maxlen;
+  return count;
 }
 
-//-------------------------------------------------------------------------
-
-my_bool levenshtein_substring_k_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
-  // sanitizing input parameters
+my_bool bktree_search_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
   if ((args->arg_count != 3) ||
       (args->arg_type[0] != STRING_RESULT || args->arg_type[1] != STRING_RESULT || args->arg_type[2] != INT_RESULT)) {
     strcpy(message, "Function requires 3 arguments, (string, string, int)");
@@ -593,68 +6152,384 @@ my_bool levenshtein_substring_k_init(UDF_INIT *initid, UDF_ARGS *args, char *mes
   }
 
   initid->ptr = NULL;
-  initid->max_length = LEVENSHTEIN_MAX;
-  initid->maybe_null = 0; //doesn't return null
+  initid->max_length = 65535; //a JSON array, as long as it takes
+  initid->maybe_null = 1; //null when no word is within k
+
+  //a constant query is compiled once for all the rows
+  if (_udf_pattern_init(initid, args, 1, PATTERN_COMPILE)) {
+    _udf_scratch_free(initid);
+    strcpy(message, "Not enough memory for the constant argument");
+    return 1;
+  }
 
   return 0;
 }
 
-/**
- *  deallocate memory, clean and close
- */
-void levenshtein_substring_k_deinit(UDF_INIT *initid) {
-    if (initid->ptr != NULL)
-        free(initid->ptr);
+void bktree_search_deinit(UDF_INIT *initid) {
+  _udf_scratch_free(initid);
 }
 
-longlong levenshtein_substring_k(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error) {
-  const char *s = args->args[0];
-  const char *t = args->args[1];
+char *bktree_search(UDF_INIT *initid, UDF_ARGS *args, char *result,
+                    unsigned long *length, char *is_null, char *error) {
+  UDF_SCRATCH *sc = _udf_scratch(initid);
+  const char *name = args->args[0];
+  const int name_len = (name == NULL) ? 0 : args->lengths[0];
+  const char *q = args->args[1];
+  const int n = (q == NULL) ? 0 : args->lengths[1];
+  //no distance is over n plus the longest word, bounds past k stay in range
+  const int k = (args->args[2] == NULL) ? -1 : MIN(*((int*) args->args[2]), n + DICT_WORD_MAX);
+  uint32_t top = 0, found = 0, i;
+  size_t size = 2;
+  int needle;
+
+  if (sc == NULL) {
+    *error = 1;
+    return NULL;
+  }
+  const BKTREE *tree = (const BKTREE *) _dict_for(sc, DICT_BKTREE, name, name_len);
+  if (tree == NULL || tree->count == 0 || k < 0) {
+    *is_null = 1;
+    return NULL;
+  }
 
-  const int k = *((int*) args->args[2]);
+  BP_SCRATCH *bp = (sc->compiled != NULL) ? sc->compiled : _bp_scratch_for(initid, n);
+  if (bp == NULL) {
+    *error = 1;
+    return NULL;
+  }
+  if (sc->compiled != NULL)
+    q = sc->pattern;
+  needle = _bp_needle_set(bp, q, n, NULL);
+
+  //stack of the nodes to visit, a node is pushed once, and the words found
+  _arena_reset(initid);
+  uint32_t *stack = (uint32_t *) _arena_alloc(initid, tree->count * sizeof(uint32_t));
+  uint32_t *match = (uint32_t *) _arena_alloc(initid, 3 * tree->count * sizeof(uint32_t));
+  if (stack == NULL || match == NULL) {
+    if (needle)
+      _bp_needle_clear(bp, n, NULL);
+    *error = 1;
+    return NULL;
+  }
 
-  int n = (s == NULL) ? 0 : args->lengths[0]; /*contains pattern*/
-  int m = (t == NULL) ? 0 : args->lengths[1]; /*contains row*/
+  stack[top++] = 0;
+  while (top > 0) {
+    const BKTREE_NODE *node = &tree->nodes[stack[--top]];
+    const char *w = tree->words + node->word;
+    const int bound = k + ((node->children > 0) ? node->max_edge : 0);
+    longlong d = _levenshtein_k_compiled(q, n, w, node->len, bound, bp, NULL);
+    if (d < 0)
+      d = _levenshtein_k_core(q, n, w, node->len, bound);
+
+    if (d <= k) {
+      match[3 * found] = (uint32_t) d;
+      match[3 * found + 1] = tree->line[node - tree->nodes];
+      match[3 * found + 2] = (uint32_t) (node - tree->nodes);
+      found++;
+      size += 6 * (size_t) node->len + 32;
+    }
+    if (d > bound)
+      continue;
+    for (i = node->first_child; i < node->first_child + node->children; i++) {
+      if (tree->nodes[i].edge > d + k)
+        break;
+      if (tree->nodes[i].edge >= d - k)
+        stack[top++] = i;
+    }
+  }
+  if (needle)
+    _bp_needle_clear(bp, n, NULL);
 
-  const char *s_stripped = _strip_w(s, n);
-  const char *t_stripped = _strip_w(t, m);
+  if (found == 0) {
+    *is_null = 1;
+    return NULL;
+  }
 
-  n = strlen(s_stripped);
-  m = strlen(t_stripped);
+  char *out = (char *) _arena_alloc(initid, size);
+  if (out == NULL) {
+    *error = 1;
+    return NULL;
+  }
+  qsort(match, found, 3 * sizeof(uint32_t), _dict_match_order);
+
+  char *o = out;
+  *o++ = '[';
+  for (i = 0; i < found; i++) {
+    if (i > 0) {
+      *o++ = ',';
+      *o++ = ' ';
+    }
+    *o++ = '[';
+    *o++ = '"';
+    const BKTREE_NODE *node = &tree->nodes[match[3 * i + 2]];
+    o = _json_escape_to(o, tree->words + node->word, node->len, 0);
+    o += sprintf(o, "\", %u]", match[3 * i]);
+  }
+  *o++ = ']';
 
-  //order the strings so that the first always has the minimum length l
-  if (n > m) {
-    int aux = n;
-    n = m;
-    m = aux;
-    const char *auxs = s_stripped;
-    s_stripped = t_stripped;
-    t_stripped = auxs;
+  *length = o - out;
+  return out;
+}
+
+//-------------------------------------------------------------------------
+
+/*
+ * SymSpell indexes of symspell_build
+ *
+ * If d(a, b) <= k, deleting at most k bytes of a and at most k of b gives the
+ * same string: the bytes of each side the alignment does not match, a
+ * substitution or a transposition costing a deletion on both sides. A query
+ * thus only compares against the words sharing one of its deletions. This
+ * holds as well for the prefixes of a and b of the same length p: the bytes
+ * of a[0, p) matched past b[0, p), and the other way round, are as many as
+ * the edits of the alignment they force. So only the deletions of the first
+ * SYMSPELL_PREFIX bytes are indexed, at most 2^SYMSPELL_PREFIX per word
+ * however long, and the lookups verify what the shorter prefix lets in.
+ */
+
+//FNV-1a
+static inline uint64_t _symspell_hash(const char *s, const int n) {
+  uint64_t h = 0xCBF29CE484222325ULL;
+  int i;
+
+  for (i = 0; i < n; i++)
+    h = (h ^ (unsigned char) s[i]) * 0x100000001B3ULL;
+  return h;
+}
+
+static inline uint64_t _symspell_slot(const uint64_t h, const uint64_t slots) {
+  return (h ^ (h >> 32)) & (slots - 1);
+}
+
+/**
+ * @param prefix at most SYMSPELL_PREFIX
+ * @result number of the hashes of the deletions of at most k of the first prefix bytes of w, in out
+ *         sorted and distinct; out has room for 2^prefix
+ */
+int _symspell_variants(const char *w, const int len, const int k, const int prefix, uint64_t *out) {
+  const int l = MIN(len, prefix);
+  char v[SYMSPELL_PREFIX];
+  int mask, i, j, count = 0;
+
+  //the bits of mask are the bytes deleted
+  for (mask = 0; mask < (1 << l); mask++) {
+    if (__builtin_popcount(mask) > k)
+      continue;
+    for (i = 0, j = 0; i < l; i++) {
+      if (!(mask & (1 << i)))
+        v[j++] = w[i];
+    }
+    const uint64_t h = _symspell_hash(v, j);
+
+    //insertion, a few dozen hashes
+    for (i = count; i > 0 && out[i - 1] > h; i--);
+    if (i > 0 && out[i - 1] == h)
+      continue;
+    memmove(out + i + 1, out + i, (count - i) * sizeof(uint64_t));
+    out[i] = h;
+    count++;
   }
 
-  longlong lowest_dist = LLONG_MAX;
-  longlong dist = 0;
+  return count;
+}
 
-  unsigned int index = 0;
+/*
+ * The index is the header, then
+ *   words:    {offset in text, length} per word, in the order of the dictionary
+ *   table:    slots + 1 offsets, the words of slot s are postings[table[s]] up to postings[table[s + 1]]
+ *   postings: numbers of words, ascending in each slot
+ *   text:     the words
+ * in the byte order of the machine. A slot holds the words of every deletion
+ * hashed to it, and there are at least as many slots as postings: lookups
+ * verify every word anyway, the few foreign ones cost less than storing the
+ * hashes. The table is counted first, then filled from the end of each slot,
+ * the words in reverse, leaving table[s] at the start of slot s.
+ *
+ * The index is written next to full, then renamed over it: a lookup that has
+ * the previous one mapped keeps reading it, never a truncated file.
+ *
+ * @result number of words, -1 on error
+ */
+longlong _symspell_build(const char *pool, const size_t size, const int k, const char *full) {
+  uint32_t *word = NULL, *seen = NULL, *table = NULL, *postings = NULL;
+  uint64_t variants[1 << SYMSPELL_PREFIX];
+  uint64_t set = 1, bound = 0, text = 0, slots = 1, total = 0, s, c;
+  uint32_t lines = 0, words = 0, i, pair[2];
+  SYMSPELL_HEADER h;
+  char tmp[4096 + 8];
+  longlong result = -1;
+  size_t p, q;
+  FILE *f = NULL;
+  int v, j, d, l;
+
+  for (p = 0; p < size; p = q + 1) {
+    for (q = p; q < size && pool[q] != '\n'; q++);
+    lines++;
+  }
 
-  while (index <= (m - n)) {
-    dist = _levenshtein_k_core(s_stripped, n, t_stripped, n, k);
-    if (dist < lowest_dist)
-        lowest_dist = dist;
+  //{offset in pool, length} of the distinct words; seen is an open addressing set of their numbers plus one
+  while (set < 2 * (uint64_t) lines)
+    set <<= 1;
+  word = (uint32_t *) malloc(2 * MAX(lines, 1) * sizeof(uint32_t));
+  seen = (uint32_t *) calloc(set, sizeof(uint32_t));
+  if (word == NULL || seen == NULL)
+    goto done;
+  for (p = 0; p < size; p = q + 1) {
+    for (q = p; q < size && pool[q] != '\n'; q++);
+    const int len = (int) (q - p) - (q > p && pool[q - 1] == '\r');
+    if (len == 0 || len > DICT_WORD_MAX)
+      continue;
+
+    for (s = _symspell_hash(pool + p, len) & (set - 1); seen[s] != 0; s = (s + 1) & (set - 1)) {
+      const uint32_t *o = &word[2 * (seen[s] - 1)];
+      if ((int) o[1] == len && memcmp(pool + o[0], pool + p, len) == 0)
+        break;
+    }
+    if (seen[s] != 0)
+      continue;
+    word[2 * words] = (uint32_t) p;
+    word[2 * words + 1] = (uint32_t) len;
+    seen[s] = ++words;
+    text += len;
+
+    //deletions of at most k of l bytes, sum of the binomials
+    l = MIN(len, SYMSPELL_PREFIX);
+    for (d = 0, c = 1; d <= k && d <= l; d++) {
+      bound += c;
+      c = c * (l - d) / (d + 1);
+    }
+  }
+  if (bound > UINT32_MAX)
+    goto done;
+
+  while (slots < bound)
+    slots <<= 1;
+  table = (uint32_t *) calloc(slots + 1, sizeof(uint32_t));
+  if (table == NULL)
+    goto done;
+  for (i = 0; i < words; i++) {
+    v = _symspell_variants(pool + word[2 * i], word[2 * i + 1], k, SYMSPELL_PREFIX, variants);
+    for (j = 0; j < v; j++)
+      table[_symspell_slot(variants[j], slots)]++;
+    total += v;
+  }
+  for (s = 0, c = 0; s < slots; s++) {
+    c += table[s];
+    table[s] = (uint32_t) c; //end of the slot
+  }
+  table[slots] = (uint32_t) total;
+
+  postings = (uint32_t *) malloc(MAX(total, 1) * sizeof(uint32_t));
+  if (postings == NULL)
+    goto done;
+  for (i = words; i-- > 0;) {
+    v = _symspell_variants(pool + word[2 * i], word[2 * i + 1], k, SYMSPELL_PREFIX, variants);
+    for (j = 0; j < v; j++)
+      postings[--table[_symspell_slot(variants[j], slots)]] = i;
+  }
 
-    (void)*t_stripped++;
-    index++;
-    if (lowest_dist == 1)
-        return lowest_dist;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, SYMSPELL_MAGIC, sizeof(h.magic));
+  h.order = SYMSPELL_ORDER;
+  h.k = (uint32_t) k;
+  h.prefix = SYMSPELL_PREFIX;
+  h.words = words;
+  h.slots = slots;
+  h.postings = total;
+  h.size = sizeof(h) + 2 * sizeof(uint32_t) * (uint64_t) words + sizeof(uint32_t) * (slots + 1 + total) + text;
+
+  if (snprintf(tmp, sizeof(tmp), "%s.XXXXXX", full) >= (int) sizeof(tmp) || (j = mkstemp(tmp)) < 0)
+    goto done;
+  if ((f = fdopen(j, "wb")) == NULL) {
+    close(j);
+    unlink(tmp);
+    goto done;
+  }
+  fwrite(&h, sizeof(h), 1, f);
+  for (i = 0, c = 0; i < words; i++) {
+    pair[0] = (uint32_t) c;
+    pair[1] = word[2 * i + 1];
+    fwrite(pair, sizeof(pair), 1, f);
+    c += pair[1];
+  }
+  fwrite(table, sizeof(uint32_t), slots + 1, f);
+  fwrite(postings, sizeof(uint32_t), total, f);
+  for (i = 0; i < words; i++)
+    fwrite(pool + word[2 * i], 1, word[2 * i + 1], f);
+  if (fflush(f) != 0 || ferror(f) || fsync(fileno(f)) != 0) {
+    fclose(f);
+    unlink(tmp);
+    goto done;
+  }
+  if (fclose(f) != 0 || rename(tmp, full) != 0) {
+    unlink(tmp);
+    goto done;
+  }
+  result = words;
+
+done:
+  free(word);
+  free(seen);
+  free(table);
+  free(postings);
+  return result;
+}
+
+void _symspell_unmap(SYMSPELL_MAP *map) {
+  if (map->base != NULL)
+    munmap((void *) map->base, map->size);
+  free(map->path);
+  memset(map, 0, sizeof(SYMSPELL_MAP));
+}
+
+/**
+ * @result 0 with the index of path mapped into map, 1 if it is not an index of the dictionary directory
+ */
+static int _symspell_map(SYMSPELL_MAP *map, const char *path, const int path_len) {
+  char full[4096];
+  struct stat st;
+  SYMSPELL_HEADER h;
+  uint64_t text;
+  void *base;
+  int fd;
+
+  _symspell_unmap(map);
+  if (_dict_path(path, path_len, full, sizeof(full)) || (fd = open(full, O_RDONLY)) < 0)
+    return 1;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(h) ||
+      (base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+    close(fd);
+    return 1;
+  }
+  close(fd); //the mapping holds the file
+
+  memcpy(&h, base, sizeof(h));
+  text = sizeof(h) + 2 * sizeof(uint32_t) * (uint64_t) h.words;
+  if (memcmp(h.magic, SYMSPELL_MAGIC, sizeof(h.magic)) != 0 || h.order != SYMSPELL_ORDER ||
+      h.k > SYMSPELL_K_MAX || h.prefix == 0 || h.prefix > SYMSPELL_PREFIX || h.size != (uint64_t) st.st_size ||
+      h.slots == 0 || h.slots > ((uint64_t) 1 << 32) || (h.slots & (h.slots - 1)) != 0 || h.postings > UINT32_MAX ||
+      (text += sizeof(uint32_t) * (h.slots + 1 + h.postings)) > h.size ||
+      (map->path = (char *) malloc(path_len)) == NULL) {
+    munmap(base, st.st_size);
+    return 1;
   }
+  //lookups read a few slots and words each, the read ahead would be wasted
+  madvise(base, st.st_size, MADV_RANDOM);
+
+  memcpy(map->path, path, path_len);
+  map->path_len = path_len;
+  map->base = (const char *) base;
+  map->size = st.st_size;
+  map->words = (const uint32_t *) (map->base + sizeof(h));
+  map->table = map->words + 2 * (uint64_t) h.words;
+  map->postings = map->table + h.slots + 1;
+  map->text = map->base + text;
+  map->text_size = h.size - text;
 
-  return lowest_dist;
+  return 0;
 }
 
-//-------------------------------------------------------------------------
-
-my_bool levenshtein_substring_ci_k_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
-  // sanitizing input parameters
+my_bool symspell_build_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
   if ((args->arg_count != 3) ||
       (args->arg_type[0] != STRING_RESULT || args->arg_type[1] != STRING_RESULT || args->arg_type[2] != INT_RESULT)) {
     strcpy(message, "Function requires 3 arguments, (string, string, int)");
@@ -662,308 +6537,598 @@ my_bool levenshtein_substring_ci_k_init(UDF_INIT *initid, UDF_ARGS *args, char *
   }
 
   initid->ptr = NULL;
-  initid->max_length = LEVENSHTEIN_MAX;
-  initid->maybe_null = 0; //doesn't return null
+  initid->max_length = 10;
+  initid->maybe_null = 1; //null when the index cannot be written
 
   return 0;
 }
 
-/**
- *  deallocate memory, clean and close
- */
-void levenshtein_substring_ci_k_deinit(UDF_INIT *initid) {
-    if (initid->ptr != NULL)
-        free(initid->ptr);
+void symspell_build_deinit(UDF_INIT *initid) {
 }
 
-longlong levenshtein_substring_ci_k(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error) {
-  const char *s = args->args[0];
-  const char *t = args->args[1];
-
-  const int k = *((int*) args->args[2]);
+longlong symspell_build(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error) {
+  const int k = (args->args[2] == NULL) ? -1 : *((int*) args->args[2]);
+  longlong words = -1;
+  char full[4096];
+  size_t size = 0;
+  char *pool;
+
+  if (k >= 0 && k <= SYMSPELL_K_MAX && !_dict_path(args->args[1], args->lengths[1], full, sizeof(full)) &&
+      (pool = _dict_read(args->args[0], args->lengths[0], &size)) != NULL) {
+    words = _symspell_build(pool, size, k, full);
+    free(pool);
+  }
+  if (words < 0) {
+    *is_null = 1;
+    return 0;
+  }
 
-  int n = (s == NULL) ? 0 : args->lengths[0]; /*contains pattern*/
-  int m = (t == NULL) ? 0 : args->lengths[1]; /*contains row*/
+  return words;
+}
 
-  const char *s_stripped = _tolowercase(_strip_w(s, n));
-  const char *t_stripped = _tolowercase(_strip_w(t, m));
+static int _symspell_word_order(const void *a, const void *b) {
+  const uint32_t x = *((const uint32_t *) a), y = *((const uint32_t *) b);
 
-  n = strlen(s_stripped);
-  m = strlen(t_stripped);
+  return (x < y) ? -1 : (x > y);
+}
 
-  //order the strings so that the first always has the minimum length l
-  if (n > m) {
-    int aux = n;
-    n = m;
-    m = aux;
-    const char *auxs = s_stripped;
-    s_stripped = t_stripped;
-    t_stripped = auxs;
-  }
+//of the words found, distance << 32 | word: by distance then in the order of the dictionary
+static int _symspell_match_order(const void *a, const void *b) {
+  const uint64_t x = *((const uint64_t *) a), y = *((const uint64_t *) b);
 
-  longlong lowest_dist = LLONG_MAX;
-  longlong dist = 0;
+  return (x < y) ? -1 : (x > y);
+}
 
-  unsigned int index = 0;
+my_bool symspell_lookup_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
+  if ((args->arg_count != 3 && args->arg_count != 4) ||
+      (args->arg_type[0] != STRING_RESULT || args->arg_type[1] != STRING_RESULT || args->arg_type[2] != INT_RESULT) ||
+      (args->arg_count == 4 && args->arg_type[3] != INT_RESULT)) {
+    strcpy(message, "Function requires 3 or 4 arguments, (string, string, int [, int])");
+    return 1;
+  }
 
-  while (index <= (m - n)) {
-    dist = _levenshtein_k_core(s_stripped, n, t_stripped, n, k);
-    if (dist < lowest_dist)
-        lowest_dist = dist;
+  initid->ptr = NULL;
+  initid->max_length = 65535; //a JSON array, as long as it takes
+  initid->maybe_null = 1; //null when no word is within k
 
-    (void)*t_stripped++;
-    index++;
-    if (lowest_dist == 1)
-        return lowest_dist;
+  //a constant query is compiled once for all the rows
+  if (_udf_pattern_init(initid, args, 1, PATTERN_COMPILE)) {
+    _udf_scratch_free(initid);
+    strcpy(message, "Not enough memory for the constant argument");
+    return 1;
   }
 
-  return lowest_dist;
+  return 0;
 }
 
-//-------------------------------------------------------------------------
+void symspell_lookup_deinit(UDF_INIT *initid) {
+  _udf_scratch_free(initid);
+}
 
-//! check parameters and allocate memory for MySql
-my_bool damerau_init(UDF_INIT *init, UDF_ARGS *args, char *message) {
+char *symspell_lookup(UDF_INIT *initid, UDF_ARGS *args, char *result,
+                      unsigned long *length, char *is_null, char *error) {
+  UDF_SCRATCH *sc = _udf_scratch(initid);
+  const char *path = args->args[0];
+  const int path_len = (path == NULL) ? 0 : args->lengths[0];
+  const char *q = args->args[1];
+  const int n = (q == NULL) ? 0 : args->lengths[1];
+  const int k = (args->args[2] == NULL) ? -1 : *((int*) args->args[2]);
+  const int transpositions = (args->arg_count == 4 && args->args[3] != NULL && *((int*) args->args[3]) != 0);
+  uint64_t variants[1 << SYMSPELL_PREFIX];
+  uint64_t s, count = 0;
+  uint32_t found = 0, i, c;
+  size_t size = 2;
+  int v, j, needle;
+
+  if (sc == NULL) {
+    *error = 1;
+    return NULL;
+  }
+  //the index of the previous row, unless the path changed
+  SYMSPELL_MAP *map = &sc->symspell;
+  if ((map->base == NULL || map->path_len != path_len || memcmp(map->path, path, path_len) != 0) &&
+      _symspell_map(map, path, path_len)) {
+    *is_null = 1;
+    return NULL;
+  }
+  const SYMSPELL_HEADER *h = (const SYMSPELL_HEADER *) map->base;
+  if (k < 0 || k > (int) h->k) {
+    *is_null = 1;
+    return NULL;
+  }
 
-    // make sure user has provided three arguments
-    if (args->arg_count != 2) {
-        strncpy(message, "DAMERAU() requires three arguments", 80);
-        return 1;
-    } else {
-        // sanitize parameters
-        if ( args->arg_type[0] != STRING_RESULT ||
-            args->arg_type[1] != STRING_RESULT) {
-            strncpy(message, "DAMERAU() requires arguments (string, string", 80);
-            return 1;
-        }
+  BP_SCRATCH *bp = (sc->compiled != NULL) ? sc->compiled : _bp_scratch_for(initid, n);
+  if (bp == NULL) {
+    *error = 1;
+    return NULL;
+  }
+  if (sc->compiled != NULL)
+    q = sc->pattern;
+
+  //the words of the slots of the deletions of q, each once
+  v = _symspell_variants(q, n, k, h->prefix, variants);
+  for (j = 0; j < v; j++) {
+    s = _symspell_slot(variants[j], h->slots);
+    if (map->table[s] <= map->table[s + 1] && map->table[s + 1] <= h->postings)
+      count += map->table[s + 1] - map->table[s];
+  }
+  _arena_reset(initid);
+  uint32_t *word = (uint32_t *) _arena_alloc(initid, MAX(count, 1) * sizeof(uint32_t));
+  uint64_t *match = (uint64_t *) _arena_alloc(initid, MAX(count, 1) * sizeof(uint64_t));
+  int *rows = (int *) _arena_alloc(initid, 3 * (k + 1) * sizeof(int));
+  if (word == NULL || match == NULL || rows == NULL) {
+    *error = 1;
+    return NULL;
+  }
+  for (j = 0, count = 0; j < v; j++) {
+    s = _symspell_slot(variants[j], h->slots);
+    if (map->table[s] <= map->table[s + 1] && map->table[s + 1] <= h->postings) {
+      memcpy(word + count, map->postings + map->table[s], (map->table[s + 1] - map->table[s]) * sizeof(uint32_t));
+      count += map->table[s + 1] - map->table[s];
     }
+  }
+  qsort(word, count, sizeof(uint32_t), _symspell_word_order);
+
+  needle = _bp_needle_set(bp, q, n, NULL);
+  for (i = 0, c = UINT32_MAX; i < count; i++) {
+    if (word[i] == c || word[i] >= h->words)
+      continue;
+    c = word[i];
+    const uint32_t *e = &map->words[2 * c];
+    if (e[1] > DICT_WORD_MAX || e[0] + (uint64_t) e[1] > map->text_size || abs((int) e[1] - n) > k)
+      continue;
+
+    const char *w = map->text + e[0];
+    longlong d = transpositions ? _damerau_k_compiled(q, n, w, e[1], k, bp, NULL)
+                                : _levenshtein_k_compiled(q, n, w, e[1], k, bp, NULL);
+    if (d < 0)
+      d = transpositions ? _damerau_k_core(q, n, w, e[1], k, rows) : _levenshtein_k_core(q, n, w, e[1], k);
+    if (d <= k) {
+      match[found++] = ((uint64_t) d << 32) | c;
+      size += 6 * (size_t) e[1] + 32;
+    }
+  }
+  if (needle)
+    _bp_needle_clear(bp, n, NULL);
 
-    return 0;
-}
-
-//! check parameters akkd allocate memory for MySql
-longlong damerau(UDF_INIT *init, UDF_ARGS *args, char *is_null, char *error) {
-
-    // s is the first user-supplied argument; t is the second
-    const char *str1 = args->args[0];
-    const char *str2 = args->args[1];
+  if (found == 0) {
+    *is_null = 1;
+    return NULL;
+  }
 
-    const int len1 = (str1 == NULL) ? 0 : args->lengths[0];
-    const int len2 = (str2 == NULL) ? 0 : args->lengths[1];
+  char *out = (char *) _arena_alloc(initid, size);
+  if (out == NULL) {
+    *error = 1;
+    return NULL;
+  }
+  qsort(match, found, sizeof(uint64_t), _symspell_match_order);
+
+  char *o = out;
+  *o++ = '[';
+  for (i = 0; i < found; i++) {
+    if (i > 0) {
+      *o++ = ',';
+      *o++ = ' ';
+    }
+    const uint32_t *e = &map->words[2 * (uint32_t) match[i]];
+    *o++ = '[';
+    *o++ = '"';
+    o = _json_escape_to(o, map->text + e[0], e[1], 0);
+    o += sprintf(o, "\", %u]", (uint32_t) (match[i] >> 32));
+  }
+  *o++ = ']';
 
-    return _damerau_core(
-         str1, len1,
-         str2, len2,
-        /* swap */              1,
-        /* substitution */	    1,
-        /* insertion */         1,
-        /* deletion */          1
-    );
+  *length = o - out;
+  return out;
 }
 
-/**
- *  deallocate memory, clean and close
- */
-void damerau_deinit(UDF_INIT *initid) {
-    if (initid->ptr != NULL)
-        free(initid->ptr);
-}
+//-------------------------------------------------------------------------
 
-/**
- * core levenshtein damerau_core function
- * @param string str1 to compare
- * @param int length1
- * @param string str2 to compare, length s_len2
- * @param int length2
- * @param int costs to swap
- * @param int costs to substitute
- * @param int costs to insert
- * @param int costs to delete
+/*
+ * Tries of the dictionaries of trie_load
+ *
+ * A search runs the recurrence of levenshtein_k with the words along the
+ * rows, but a row only depends on the bytes of the word up to it: the row of
+ * a node, one step from the row of its parent, serves every word below. Rows
+ * are the strip of _levenshtein_k_core, the cells of row d farther than k
+ * from column d are over k: a row is the 2k + 1 cells around it, with a cell
+ * of k + 1 on each side, and values are capped at k + 1. The minimum of the
+ * rows never decreases going down, a subtree is left once it is over k.
  */
-inline longlong _damerau_core(const char *str1,int s_len1,
-                       const char * str2, int s_len2,
-                       const int swap_costs, const int substitute_costs, const int insert_costs, const int delete_costs) {
+void _trie_free(TRIE *trie) {
+  free(trie->first);
+  free(trie->label);
+  free(trie->terminal);
+  free(trie);
+}
 
-    int d[s_len1+1][s_len2+1];
+//by bytes, a prefix first
+static int _trie_word_order(const void *a, const void *b) {
+  const DICT_WORD *x = (const DICT_WORD *) a, *y = (const DICT_WORD *) b;
+  const int c = memcmp(x->word, y->word, MIN(x->len, y->len));
 
-    int i, j, l_cost;
+  return (c != 0) ? c : (int) x->len - (int) y->len;
+}
 
-    for (i = 0;i <= s_len1;i++) {
-        d[i][0] = i;
+/*
+ * The words are sorted, then the nodes numbered breadth first: node i stands
+ * for the range of the sorted words sharing its first depth[i] bytes, split
+ * into its children by the next byte. The words end up in the labels alone,
+ * the content of the file, pool, is freed.
+ */
+TRIE *_trie_build(char *pool, const size_t size) {
+  TRIE *trie = (TRIE *) calloc(1, sizeof(TRIE));
+  DICT_WORD *words = NULL;
+  uint32_t *lo = NULL, *hi = NULL;
+  uint16_t *depth = NULL;
+  uint32_t lines = 0, n = 0, count, nodes, i, j, a, e;
+  size_t p, q, chars = 0;
+  void *shrunk;
+
+  if (trie == NULL)
+    goto fail;
+  trie->dict.kind = DICT_TRIE;
+
+  for (p = 0; p < size; p = q + 1) {
+    for (q = p; q < size && pool[q] != '\n'; q++);
+    lines++;
+  }
+  words = (DICT_WORD *) malloc(MAX(lines, 1) * sizeof(DICT_WORD));
+  if (words == NULL)
+    goto fail;
+  for (p = 0; p < size; p = q + 1) {
+    for (q = p; q < size && pool[q] != '\n'; q++);
+    const int len = (int) (q - p) - (q > p && pool[q - 1] == '\r');
+    if (len == 0 || len > DICT_WORD_MAX)
+      continue;
+    words[n].word = pool + p;
+    words[n++].len = (uint32_t) len;
+  }
+  qsort(words, n, sizeof(DICT_WORD), _trie_word_order);
+  for (i = 0, j = 0; i < n; i++) {
+    if (j > 0 && _trie_word_order(&words[j - 1], &words[i]) == 0)
+      continue;
+    words[j++] = words[i];
+    chars += words[i].len;
+    trie->max_len = MAX(trie->max_len, (int) words[i].len);
+  }
+  n = j;
+
+  //at most a node per byte, and the root
+  nodes = (uint32_t) chars + 1;
+  trie->first = (uint32_t *) malloc(((size_t) nodes + 1) * sizeof(uint32_t));
+  trie->label = (uint8_t *) malloc(nodes);
+  trie->terminal = (uint8_t *) calloc((nodes + 7) / 8, 1);
+  lo = (uint32_t *) malloc(nodes * sizeof(uint32_t));
+  hi = (uint32_t *) malloc(nodes * sizeof(uint32_t));
+  depth = (uint16_t *) malloc(nodes * sizeof(uint16_t));
+  if (trie->first == NULL || trie->label == NULL || trie->terminal == NULL || lo == NULL || hi == NULL ||
+      depth == NULL)
+    goto fail;
+
+  lo[0] = 0;
+  hi[0] = n;
+  depth[0] = 0;
+  trie->label[0] = 0;
+  for (i = 0, count = 1; i < count; i++) {
+    const int d = depth[i];
+    a = lo[i];
+    //a word ending at this node sorts first
+    if (a < hi[i] && (int) words[a].len == d) {
+      trie->terminal[i >> 3] |= (uint8_t) (1 << (i & 7));
+      a++;
     }
-    for(j = 0; j<= s_len2; j++) {
-        d[0][j] = j;
+    trie->first[i] = count;
+    for (; a < hi[i]; a = e) {
+      const char c = words[a].word[d];
+      for (e = a + 1; e < hi[i] && words[e].word[d] == c; e++);
+      trie->label[count] = (uint8_t) c;
+      lo[count] = a;
+      hi[count] = e;
+      depth[count++] = (uint16_t) (d + 1);
     }
-    for (i = 1;i <= s_len1;i++) {
-        for(j = 1; j<= s_len2; j++) {
-            if( str1[i-1] == str2[j-1] )
-                l_cost = 0;
-            else
-                l_cost = 1;
+  }
+  trie->first[count] = count;
+  trie->count = count;
+  trie->words = n;
+
+  //the prefixes shared, fewer nodes than bytes
+  if ((shrunk = realloc(trie->first, ((size_t) count + 1) * sizeof(uint32_t))) != NULL)
+    trie->first = (uint32_t *) shrunk;
+  if ((shrunk = realloc(trie->label, count)) != NULL)
+    trie->label = (uint8_t *) shrunk;
+  if ((shrunk = realloc(trie->terminal, (count + 7) / 8)) != NULL)
+    trie->terminal = (uint8_t *) shrunk;
+
+  free(words);
+  free(lo);
+  free(hi);
+  free(depth);
+  free(pool);
+  return trie;
+
+fail:
+  free(words);
+  free(lo);
+  free(hi);
+  free(depth);
+  if (trie != NULL)
+    _trie_free(trie);
+  free(pool);
+  return NULL;
+}
 
-            d[i][j] = MIN(
-                d[i-1][j] + delete_costs,                   // delete
-                MIN(d[i][j-1] + insert_costs,               // insert
-                    d[i-1][j-1] + l_cost*substitute_costs)  // substitution
-            );
-            if( (i > 1) && (j > 1) &&
-                (str1[i-1] == str2[j-2]) && (str1[i-2] == str2[j-1])) {
+//the nodes are breadth first: the parent of node is the last one whose children start at or before it
+static inline uint32_t _trie_parent(const TRIE *trie, const uint32_t node) {
+  uint32_t lo = 0, hi = node, mid;
 
-                d[i][j] = MIN(
-                    d[i][j],
-                    d[i-2][j-2] + l_cost*swap_costs         // swap
-                );
-            }
-        }
-    }
-    return d[s_len1][s_len2];
+  while (hi - lo > 1) {
+    mid = lo + (hi - lo) / 2;
+    if (trie->first[mid] <= node)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return lo;
 }
 
-//-------------------------------------------------------------------------
-
-my_bool damerau_substring_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
-  // sanitizing input parameters
-  if ((args->arg_count != 2) ||
-      (args->arg_type[0] != STRING_RESULT || args->arg_type[1] != STRING_RESULT)) {
+my_bool trie_load_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
+  if ((args->arg_count != 2) || (args->arg_type[0] != STRING_RESULT || args->arg_type[1] != STRING_RESULT)) {
     strcpy(message, "Function requires 2 arguments, (string, string)");
     return 1;
   }
 
   initid->ptr = NULL;
-  initid->max_length = LEVENSHTEIN_MAX;
-  initid->maybe_null = 0; //doesn't return null
+  initid->max_length = 10;
+  initid->maybe_null = 1; //null when the file cannot be loaded
 
   return 0;
 }
 
-/**
- *  deallocate memory, clean and close
- */
-void damerau_substring_deinit(UDF_INIT *initid) {
-    if (initid->ptr != NULL)
-        free(initid->ptr);
+void trie_load_deinit(UDF_INIT *initid) {
 }
 
-longlong damerau_substring(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error) {
-  const char *s = args->args[0];
-  const char *t = args->args[1];
+longlong trie_load(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error) {
+  const char *name = args->args[0];
+  const char *path = args->args[1];
+  TRIE *trie;
+  size_t size = 0;
+  uint32_t words;
+  char *pool;
+
+  if (name == NULL || path == NULL || args->lengths[0] == 0 || args->lengths[0] > DICT_NAME_MAX ||
+      (pool = _dict_read(path, args->lengths[1], &size)) == NULL ||
+      (trie = _trie_build(pool, size)) == NULL) {
+    *is_null = 1;
+    return 0;
+  }
 
-  int n = (s == NULL) ? 0 : args->lengths[0]; /*contains pattern*/
-  int m = (t == NULL) ? 0 : args->lengths[1]; /*contains row*/
+  //the trie belongs to the registry once published, and may be replaced right away
+  words = trie->words;
+  memcpy(trie->dict.name, name, args->lengths[0]);
+  trie->dict.name[args->lengths[0]] = '\0';
+  _dict_publish(&trie->dict);
 
-  const char *s_stripped = _strip_w(s, n);
-  const char *t_stripped = _strip_w(t, m);
+  return words;
+}
 
-  n = strlen(s_stripped);
-  m = strlen(t_stripped);
+my_bool trie_search_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
+  if ((args->arg_count != 3 && args->arg_count != 4) ||
+      (args->arg_type[0] != STRING_RESULT || args->arg_type[1] != STRING_RESULT || args->arg_type[2] != INT_RESULT) ||
+      (args->arg_count == 4 && args->arg_type[3] != INT_RESULT)) {
+    strcpy(message, "Function requires 3 or 4 arguments, (string, string, int [, int])");
+    return 1;
+  }
 
-  //order the strings so that the first always has the minimum length l
-  if (n > m) {
-    int aux = n;
-    n = m;
-    m = aux;
-    const char *auxs = s_stripped;
-    s_stripped = t_stripped;
-    t_stripped = auxs;
+  initid->ptr = NULL;
+  initid->max_length = 65535; //a JSON array, as long as it takes
+  initid->maybe_null = 1; //null when no word is within k
+
+  return 0;
+}
+
+void trie_search_deinit(UDF_INIT *initid) {
+  _udf_scratch_free(initid);
+}
+
+char *trie_search(UDF_INIT *initid, UDF_ARGS *args, char *result,
+                  unsigned long *length, char *is_null, char *error) {
+  UDF_SCRATCH *sc = _udf_scratch(initid);
+  const char *name = args->args[0];
+  const int name_len = (name == NULL) ? 0 : args->lengths[0];
+  const char *q = args->args[1];
+  const int n = (q == NULL) ? 0 : args->lengths[1];
+  const int transpositions = (args->arg_count == 4 && args->args[3] != NULL && *((int*) args->args[3]) != 0);
+  uint32_t top = 0, found = 0, node, x;
+  size_t size = 2;
+  int k, width, rows_max, d, i, j;
+
+  if (sc == NULL) {
+    *error = 1;
+    return NULL;
+  }
+  const TRIE *trie = (const TRIE *) _dict_for(sc, DICT_TRIE, name, name_len);
+  if (trie == NULL || trie->words == 0 || args->args[2] == NULL || *((int*) args->args[2]) < 0) {
+    *is_null = 1;
+    return NULL;
+  }
+  //a query longer than every word by more than k matches none of them
+  if (n - trie->max_len > *((int*) args->args[2])) {
+    *is_null = 1;
+    return NULL;
+  }
+  //no distance is over the longer of q and the words
+  k = MIN(*((int*) args->args[2]), MAX(n, trie->max_len));
+  width = 2 * k + 3;
+  rows_max = MIN(trie->max_len, n + k); //deeper rows are over k
+
+  //a row per depth of the path, a node is pushed with its depth, up to 256 children per depth
+  _arena_reset(initid);
+  int *rows = (int *) _arena_alloc(initid, (size_t) (rows_max + 1) * width * sizeof(int));
+  uint32_t *stack = (uint32_t *) _arena_alloc(initid, 2 * ((size_t) rows_max * 256 + 1) * sizeof(uint32_t));
+  uint32_t *match = (uint32_t *) _arena_alloc(initid, 3 * (size_t) trie->words * sizeof(uint32_t));
+  char *path = (char *) _arena_alloc(initid, trie->max_len + 1);
+  if (rows == NULL || stack == NULL || match == NULL || path == NULL) {
+    *error = 1;
+    return NULL;
   }
 
-  longlong lowest_dist = LLONG_MAX;
-  longlong dist = 0;
+  //row 0, cell j at j + k + 1
+  for (i = 0; i < width; i++) {
+    j = i - k - 1;
+    rows[i] = (j >= 0 && j <= n) ? MIN(j, k + 1) : k + 1;
+  }
+  for (x = trie->first[1]; rows_max > 0 && x-- > trie->first[0];) {
+    stack[top++] = x;
+    stack[top++] = 1;
+  }
 
-  unsigned int index = 0;
+  //depth first, the children by byte: the words come in byte order
+  while (top > 0) {
+    d = (int) stack[--top];
+    node = stack[--top];
+    const char c = (char) trie->label[node];
+    const int *up = rows + (d - 1) * width; //cell j of row d at j - d + k + 1, of row d - 1 one further
+    const int *up2 = (d >= 2) ? up - width : NULL;
+    int *row = rows + d * width;
+    int best = k + 1;
+
+    path[d - 1] = c;
+    row[0] = k + 1;
+    for (i = 1; i < width - 1; i++) {
+      j = d - k - 1 + i;
+      if (j <= 0 || j > n) {
+        row[i] = (j == 0) ? MIN(d, k + 1) : k + 1;
+        best = MIN(best, row[i]);
+        continue;
+      }
+      int v = MIN(up[i + 1], row[i - 1]) + 1;
+      v = MIN(v, up[i] + (q[j - 1] != c));
+      if (transpositions && d >= 2 && j >= 2 && c == q[j - 2] && path[d - 2] == q[j - 1])
+        v = MIN(v, up2[i] + 1);
+      row[i] = MIN(v, k + 1);
+      best = MIN(best, row[i]);
+    }
+    row[width - 1] = k + 1;
+
+    i = n - d + k + 1;
+    if ((trie->terminal[node >> 3] & (1 << (node & 7))) && i > 0 && i < width - 1 && row[i] <= k) {
+      match[3 * found] = (uint32_t) row[i];
+      match[3 * found + 1] = found;
+      match[3 * found + 2] = node;
+      found++;
+      size += 6 * (size_t) d + 32;
+    }
+    if (best > k || d >= rows_max)
+      continue;
+    for (x = trie->first[node + 1]; x-- > trie->first[node];) {
+      stack[top++] = x;
+      stack[top++] = (uint32_t) (d + 1);
+    }
+  }
 
-  while (index <= (m - n)) {
-    dist = _damerau_core(
-                s_stripped, n,
-                t_stripped, n,
-                /* swap */              1,
-                /* substitution */	    1,
-                /* insertion */         1,
-                /* deletion */          1
-    );
-    if (dist < lowest_dist)
-        lowest_dist = dist;
+  if (found == 0) {
+    *is_null = 1;
+    return NULL;
+  }
 
-    (void)*t_stripped++;
-    index++;
-    if (lowest_dist == 1)
-        return lowest_dist;
+  char *out = (char *) _arena_alloc(initid, size);
+  if (out == NULL) {
+    *error = 1;
+    return NULL;
+  }
+  qsort(match, found, 3 * sizeof(uint32_t), _dict_match_order);
+
+  char *o = out;
+  *o++ = '[';
+  for (x = 0; x < found; x++) {
+    if (x > 0) {
+      *o++ = ',';
+      *o++ = ' ';
+    }
+    //the word, from its node up to the root
+    for (node = match[3 * x + 2], j = trie->max_len; node != 0; node = _trie_parent(trie, node))
+      path[--j] = (char) trie->label[node];
+    *o++ = '[';
+    *o++ = '"';
+    o = _json_escape_to(o, path + j, trie->max_len - j, 0);
+    o += sprintf(o, "\", %u]", match[3 * x]);
   }
+  *o++ = ']';
 
-  return lowest_dist;
+  *length = o - out;
+  return out;
 }
 
 //-------------------------------------------------------------------------
 
-my_bool damerau_substring_ci_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
-  // sanitizing input parameters
-  if ((args->arg_count != 2) ||
-      (args->arg_type[0] != STRING_RESULT || args->arg_type[1] != STRING_RESULT)) {
-    strcpy(message, "Function requires 2 arguments, (string, string)");
+my_bool similarities_cpu_features_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
+  if (args->arg_count != 0) {
+    strcpy(message, "Function requires no arguments");
     return 1;
   }
 
-  initid->max_length = LEVENSHTEIN_MAX;
+  initid->max_length = LENGTH_MAX;
   initid->maybe_null = 0; //doesn't return null
+  initid->const_item = 1;
 
   return 0;
 }
 
-/**
- *  deallocate memory, clean and close
- */
-void damerau_substring_ci_deinit(UDF_INIT *initid) {
-    if (initid->ptr != NULL)
-        free(initid->ptr);
+void similarities_cpu_features_deinit(UDF_INIT *initid) {
 }
 
-longlong damerau_substring_ci(UDF_INIT *initid, UDF_ARGS *args, char *is_null, char *error) {
-  const char *s = args->args[0];
-  const char *t = args->args[1];
+char *similarities_cpu_features(UDF_INIT *initid, UDF_ARGS *args, char *result,
+                                unsigned long *length, char *is_null, char *error) {
+  int len = snprintf(result, LENGTH_MAX, "%s (", _bp_simd_path());
 
-  int n = (s == NULL) ? 0 : args->lengths[0]; /*contains pattern*/
-  int m = (t == NULL) ? 0 : args->lengths[1]; /*contains row*/
+#ifdef BP_SIMD
+  const char *sep = "";
 
-  const char *s_stripped = _tolowercase(_strip_w(s, n));
-  const char *t_stripped = _tolowercase(_strip_w(t, m));
+  if (__builtin_cpu_supports("sse4.1")) {
+    len += snprintf(result + len, LENGTH_MAX - len, "%ssse4.1", sep);
+    sep = " ";
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    len += snprintf(result + len, LENGTH_MAX - len, "%savx2", sep);
+    sep = " ";
+  }
+  if (__builtin_cpu_supports("avx512f"))
+    len += snprintf(result + len, LENGTH_MAX - len, "%savx512f", sep);
+#endif
 
-  n = strlen(s_stripped);
-  m = strlen(t_stripped);
+  len += snprintf(result + len, LENGTH_MAX - len, ")");
+  *length = len;
 
-  //order the strings so that the first always has the minimum length l
-  if (n > m) {
-    int aux = n;
-    n = m;
-    m = aux;
-    const char *auxs = s_stripped;
-    s_stripped = t_stripped;
-    t_stripped = auxs;
+  return result;
+}
+
+//-------------------------------------------------------------------------
+
+my_bool similarities_prefilter_stats_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
+  if (args->arg_count != 0) {
+    strcpy(message, "Function requires no arguments");
+    return 1;
   }
 
-  longlong lowest_dist = LLONG_MAX;
-  longlong dist = 0;
+  initid->max_length = LENGTH_MAX;
+  initid->maybe_null = 0; //doesn't return null
 
-  unsigned int index = 0;
+  return 0;
+}
 
-  while (index <= (m - n)) {
-    dist = _damerau_core(
-                s_stripped, n,
-                t_stripped, n,
-                /* swap */              1,
-                /* substitution */	    1,
-                /* insertion */         1,
-                /* deletion */          1
-    );
-    if (dist < lowest_dist)
-        lowest_dist = dist;
+void similarities_prefilter_stats_deinit(UDF_INIT *initid) {
+}
 
-    (void)*t_stripped++;
-    index++;
-    if (lowest_dist == 1)
-        return lowest_dist;
-  }
+char *similarities_prefilter_stats(UDF_INIT *initid, UDF_ARGS *args, char *result,
+                                   unsigned long *length, char *is_null, char *error) {
+  *length = snprintf(result, LENGTH_MAX, "length %llu, bag %llu, qgram %llu, passed %llu",
+                     (unsigned long long) __atomic_load_n(&_prefilter_totals[PREFILTER_LENGTH], __ATOMIC_RELAXED),
+                     (unsigned long long) __atomic_load_n(&_prefilter_totals[PREFILTER_BAG], __ATOMIC_RELAXED),
+                     (unsigned long long) __atomic_load_n(&_prefilter_totals[PREFILTER_QGRAM], __ATOMIC_RELAXED),
+                     (unsigned long long) __atomic_load_n(&_prefilter_totals[PREFILTER_PASSED], __ATOMIC_RELAXED));
 
-  return lowest_dist;
+  return result;
 }
 
 #endif /* HAVE_DLOPEN */
@@ -42,3 +42,8 @@ typedef long long longlong;
 #include <stdarg.h>
 #include <errno.h>
 #include <stdint.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
@@ -62,6 +62,26 @@ static char * strip_w_test_3() {
     return 0;
 }
 
+static char * normalize_to_test() {
+    if(lib_handle != NULL) {
+        printf("Testing => %s\n", __FUNCTION__);
+
+        int (*normalize_to)() = dlsym(lib_handle, "_normalize_to");
+        char out[64];
+        //not null terminated, stops at the NUL like the strlen of a _strip_w copy
+        char testString[] = "   Dirty \r\n  TEST  string \n\0 tail";
+        int len = normalize_to(out, testString, (int) sizeof(testString) - 1, 1);
+        //printf("%d [%s]\n", len, out);
+        mu_assert("Error, normalize_to_test => length - expected 17", len == 17);
+        mu_assert("Error, normalize_to_test => expected [dirty test string]", strcmp(out, "dirty test string") == 0);
+
+        len = normalize_to(out, "  a  B ", 7, 0);
+        mu_assert("Error, normalize_to_test => expected [a B]", len == 3 && strcmp(out, "a B") == 0);
+    }
+
+    return 0;
+}
+
 static char * levenshtein_k_core_test() {
     if(lib_handle != NULL) {
         printf("Testing => %s\n", __FUNCTION__);
@@ -76,6 +96,34 @@ static char * levenshtein_k_core_test() {
     return 0;
 }
 
+static char * levenshtein_k_bp_core_test() {
+    if(lib_handle != NULL) {
+        printf("Testing => %s\n", __FUNCTION__);
+
+        void *(*bp_scratch_alloc)() = dlsym(lib_handle, "_bp_scratch_alloc");
+        void (*bp_scratch_free)() = dlsym(lib_handle, "_bp_scratch_free");
+        longlong (*levenshtein_k_bp_core)() = dlsym(lib_handle, "_levenshtein_k_bp_core");
+
+        /* 300 characters, 5 substitutions spread over several 64 bit blocks */
+        char testString1[301], testString2[301];
+        int i;
+        for (i = 0; i < 300; i++)
+            testString1[i] = testString2[i] = 'a' + (i % 10);
+        testString1[300] = testString2[300] = '\0';
+        for (i = 10; i < 300; i += 60)
+            testString2[i] = 'X';
+
+        void *bp = bp_scratch_alloc(300);
+        longlong result1 = levenshtein_k_bp_core(testString1, 300, testString2, 300, 10, bp);
+        longlong result2 = levenshtein_k_bp_core(testString1, 300, testString2, 300, 2, bp);
+        bp_scratch_free(bp);
+        mu_assert("Error, levenshtein_k_bp_core_test => k = 10 - expected 5", result1 == 5);
+        mu_assert("Error, levenshtein_k_bp_core_test => k = 2 - expected 3", result2 == 3);
+    }
+
+    return 0;
+}
+
 static char * levenshtein_test() {
 
     if(lib_handle != NULL) {
@@ -132,6 +180,61 @@ static char * levenshtein_test() {
     return 0;
 }
 
+static char * levenshtein_long_test() {
+
+    if(lib_handle != NULL) {
+        printf("Testing => %s\n", __FUNCTION__);
+
+        /* longer than one 64 bit word, runs the blocked bit-parallel kernel */
+        char *testString1 = "The quick brown fox jumps over the lazy dog while the dog keeps sleeping in the warm afternoon sun";
+        char *testString2 = "The quikc brown fox jumped over the lazy dogs while a dog keeps sleeping in the warm afternon sun";
+
+
+        my_bool (*levenshtein_init)() = dlsym(lib_handle, "levenshtein_init");
+        longlong (*levenshtein)() = dlsym(lib_handle, "levenshtein");
+        void(*levenshtein_deinit)() = dlsym(lib_handle, "levenshtein_deinit");
+
+        UDF_INIT *init = (UDF_INIT *) malloc(sizeof(UDF_INIT));
+        UDF_ARGS *args = (UDF_ARGS *) malloc(sizeof(UDF_ARGS));
+        args->arg_type = (enum Item_result *) malloc(sizeof(enum Item_result)*2);
+        args->lengths = (long unsigned int *) malloc(sizeof(long unsigned int)*2);
+        char *message = (char *) malloc(sizeof(char)*MYSQL_ERRMSG_SIZE);
+        char *error = (char *) malloc(sizeof(char));
+        char *is_null = (char *) malloc(sizeof(char));
+
+        args->arg_type[0] = STRING_RESULT;
+        args->arg_type[1] = STRING_RESULT;
+        args->lengths[0] = strlen(testString1);
+        args->lengths[1] = strlen(testString2);
+        args->arg_count = 2;
+        is_null[0] = '\0';
+        error[0] = '\0';
+        args->args = (char **) malloc(sizeof(char *)*2);
+        args->args[0] = testString1;
+        args->args[1] = testString2;
+
+        my_bool ret = levenshtein_init(init, args, message);
+        mu_assert("Error, levenshtein_long_test => levenshtein_init - expected 0", ret == 0);
+
+        longlong result = levenshtein(init, args, is_null, error);
+        mu_assert("Error, levenshtein_long_test => levenshtein - expected 9", result == 9);
+
+
+        levenshtein_deinit(init);
+
+        free(args->args);
+        free(is_null);
+        free(error);
+        free(message);
+        free(args->arg_type);
+        free(args->lengths);
+        free(args);
+        free(init);
+    }
+
+    return 0;
+}
+
 static char * levenshtein_k_test() {
     if(lib_handle != NULL) {
         printf("Testing => %s\n", __FUNCTION__);
@@ -191,6 +294,150 @@ static char * levenshtein_k_test() {
     return 0;
 }
 
+static char * levenshtein_const_test() {
+    if(lib_handle != NULL) {
+        printf("Testing => %s\n", __FUNCTION__);
+
+        long long limit_arg = 3;
+        char *pattern = "kitten";
+        char *rows[4] = {"sitting", "kitten", "", "mittens on the kitchen table"};
+        longlong expected[4] = {3, 0, 6, 23};
+        longlong expected_k[4] = {3, 0, 4, 4};
+        int i;
+
+        my_bool (*levenshtein_init)() = dlsym(lib_handle, "levenshtein_init");
+        longlong (*levenshtein)() = dlsym(lib_handle, "levenshtein");
+        void(*levenshtein_deinit)() = dlsym(lib_handle, "levenshtein_deinit");
+        my_bool (*levenshtein_k_init)() = dlsym(lib_handle, "levenshtein_k_init");
+        longlong (*levenshtein_k)() = dlsym(lib_handle, "levenshtein_k");
+        void(*levenshtein_k_deinit)() = dlsym(lib_handle, "levenshtein_k_deinit");
+
+        UDF_INIT *init = (UDF_INIT *) malloc(sizeof(UDF_INIT));
+        UDF_INIT *init_k = (UDF_INIT *) malloc(sizeof(UDF_INIT));
+        UDF_ARGS *args = (UDF_ARGS *) malloc(sizeof(UDF_ARGS));
+        args->arg_type = (enum Item_result *) malloc(sizeof(enum Item_result)*3);
+        args->lengths = (long unsigned int *) malloc(sizeof(long unsigned int)*3);
+        char *message = (char *) malloc(sizeof(char)*MYSQL_ERRMSG_SIZE);
+        char *error = (char *) malloc(sizeof(char));
+        char *is_null = (char *) malloc(sizeof(char));
+
+        args->arg_type[0] = STRING_RESULT;
+        args->arg_type[1] = STRING_RESULT;
+        args->arg_type[2] = INT_RESULT;
+        args->lengths[0] = strlen(pattern);
+        args->lengths[1] = 0;
+        is_null[0] = '\0';
+        error[0] = '\0';
+        args->args = (char **) malloc(sizeof(char *)*3);
+
+        //constant pattern, the other arguments are only known row by row
+        args->args[0] = pattern;
+        args->args[1] = NULL;
+        args->args[2] = NULL;
+
+        args->arg_count = 2;
+        my_bool ret = levenshtein_init(init, args, message);
+        mu_assert("Error, levenshtein_const_test => levenshtein_init - expected 0", ret == 0);
+        args->arg_count = 3;
+        ret = levenshtein_k_init(init_k, args, message);
+        mu_assert("Error, levenshtein_const_test => levenshtein_k_init - expected 0", ret == 0);
+
+        args->args[2] = (char *) &limit_arg;
+        for (i = 0; i < 4; i++) {
+            args->args[1] = rows[i];
+            args->lengths[1] = strlen(rows[i]);
+
+            args->arg_count = 2;
+            longlong result = levenshtein(init, args, is_null, error);
+            mu_assert("Error, levenshtein_const_test => levenshtein - unexpected distance", result == expected[i]);
+
+            args->arg_count = 3;
+            result = levenshtein_k(init_k, args, is_null, error);
+            mu_assert("Error, levenshtein_const_test => levenshtein_k - unexpected distance", result == expected_k[i]);
+        }
+
+        levenshtein_deinit(init);
+        levenshtein_k_deinit(init_k);
+
+        free(args->args);
+        free(is_null);
+        free(error);
+        free(message);
+        free(args->arg_type);
+        free(args->lengths);
+        free(args);
+        free(init_k);
+        free(init);
+    }
+
+    return 0;
+}
+
+static char * levenshtein_repeated_test() {
+    if(lib_handle != NULL) {
+        printf("Testing => %s\n", __FUNCTION__);
+
+        //outer values of a join, the same buffer is reused for all of them;
+        //the last two only differ in the middle and share their hash
+        char outer[32];
+        char *outers[3] = {"the quick brown fox", "jumps over the lazy dog", "jumps over THE lazy dog"};
+        char *inners[3] = {"the quick brown fix", "jumps over the lazy dog", "the quick brown fox"};
+        longlong expected[3][3] = {{1, 20, 0}, {21, 0, 20}, {21, 3, 20}};
+        int i, j, r;
+
+        my_bool (*levenshtein_init)() = dlsym(lib_handle, "levenshtein_init");
+        longlong (*levenshtein)() = dlsym(lib_handle, "levenshtein");
+        void(*levenshtein_deinit)() = dlsym(lib_handle, "levenshtein_deinit");
+
+        UDF_INIT *init = (UDF_INIT *) malloc(sizeof(UDF_INIT));
+        UDF_ARGS *args = (UDF_ARGS *) malloc(sizeof(UDF_ARGS));
+        args->arg_type = (enum Item_result *) malloc(sizeof(enum Item_result)*2);
+        args->lengths = (long unsigned int *) malloc(sizeof(long unsigned int)*2);
+        char *message = (char *) malloc(sizeof(char)*MYSQL_ERRMSG_SIZE);
+        char *error = (char *) malloc(sizeof(char));
+        char *is_null = (char *) malloc(sizeof(char));
+
+        args->arg_type[0] = STRING_RESULT;
+        args->arg_type[1] = STRING_RESULT;
+        args->arg_count = 2;
+        is_null[0] = '\0';
+        error[0] = '\0';
+        args->args = (char **) malloc(sizeof(char *)*2);
+        args->args[0] = NULL;
+        args->args[1] = NULL;
+
+        my_bool ret = levenshtein_init(init, args, message);
+        mu_assert("Error, levenshtein_repeated_test => levenshtein_init - expected 0", ret == 0);
+
+        for (i = 0; i < 3; i++) {
+            strcpy(outer, outers[i]);
+            args->args[0] = outer;
+            args->lengths[0] = strlen(outer);
+            for (r = 0; r < 3; r++) { //the value is compiled on its second row
+                for (j = 0; j < 3; j++) {
+                    args->args[1] = inners[j];
+                    args->lengths[1] = strlen(inners[j]);
+                    longlong result = levenshtein(init, args, is_null, error);
+                    mu_assert("Error, levenshtein_repeated_test => levenshtein - unexpected distance", result == expected[i][j]);
+                }
+            }
+        }
+
+        levenshtein_deinit(init);
+
+        free(args->args);
+        free(is_null);
+        free(error);
+        free(message);
+        free(args->arg_type);
+        free(args->lengths);
+        free(args);
+        free(init);
+    }
+
+    return 0;
+}
+
 static char * levenshtein_substring_k_test1() {
     if(lib_handle != NULL) {
         printf("Testing => %s\n", __FUNCTION__);
@@ -429,6 +676,78 @@ static char * levenshtein_k_ratio_test() {
     return 0;
 }
 
+static char * levenshtein_substring_ci_k_rows_test() {
+    if(lib_handle != NULL) {
+        printf("Testing => %s\n", __FUNCTION__);
+
+        //rows of different sizes, the second one outgrows the first block of the per row arena
+        long long limit_arg = 3;
+        char *needle = "Hello   World";
+        char *rows[3];
+        longlong expected[3] = {0, 2, 0};
+        int i;
+
+        rows[0] = strdup("say hello world!");
+        rows[1] = (char *) malloc(6100);
+        for (i = 0; i < 6000; i += 2)
+            memcpy(rows[1] + i, "ab", 2);
+        strcpy(rows[1] + 6000, " hellO  wrld cdcdcdcdcdcdcdcdcdcd");
+        rows[2] = strdup("hELLo wOrLd");
+
+        my_bool (*levenshtein_substring_ci_k_init)() = dlsym(lib_handle, "levenshtein_substring_ci_k_init");
+        longlong (*levenshtein_substring_ci_k)() = dlsym(lib_handle, "levenshtein_substring_ci_k");
+        void(*levenshtein_substring_ci_k_deinit)() = dlsym(lib_handle, "levenshtein_substring_ci_k_deinit");
+
+        UDF_INIT *init = (UDF_INIT *) malloc(sizeof(UDF_INIT));
+        UDF_ARGS *args = (UDF_ARGS *) malloc(sizeof(UDF_ARGS));
+        args->arg_type = (enum Item_result *) malloc(sizeof(enum Item_result)*3);
+        args->lengths = (long unsigned int *) malloc(sizeof(long unsigned int)*3);
+        char *message = (char *) malloc(sizeof(char)*MYSQL_ERRMSG_SIZE);
+        char *error = (char *) malloc(sizeof(char));
+        char *is_null = (char *) malloc(sizeof(char));
+
+        args->arg_type[0] = STRING_RESULT;
+        args->arg_type[1] = STRING_RESULT;
+        args->arg_type[2] = INT_RESULT;
+        args->lengths[0] = strlen(needle);
+        args->lengths[1] = 0;
+        args->arg_count = 3;
+        is_null[0] = '\0';
+        error[0] = '\0';
+        args->args = (char **) malloc(sizeof(char *)*3);
+        args->args[0] = NULL; //not constant, normalized on every row
+        args->args[1] = NULL;
+        args->args[2] = (char *) &limit_arg;
+
+        my_bool ret = levenshtein_substring_ci_k_init(init, args, message);
+        mu_assert("Error, levenshtein_substring_ci_k_rows_test => levenshtein_substring_ci_k_init - expected 0", ret == 0);
+
+        args->args[0] = needle;
+        for (i = 0; i < 3; i++) {
+            args->args[1] = rows[i];
+            args->lengths[1] = strlen(rows[i]);
+            longlong result = levenshtein_substring_ci_k(init, args, is_null, error);
+            mu_assert("Error, levenshtein_substring_ci_k_rows_test => levenshtein_substring_ci_k - unexpected distance",
+                      result == expected[i] && error[0] == '\0');
+        }
+
+        levenshtein_substring_ci_k_deinit(init);
+
+        for (i = 0; i < 3; i++)
+            free(rows[i]);
+        free(args->args);
+        free(is_null);
+        free(error);
+        free(message);
+        free(args->arg_type);
+        free(args->lengths);
+        free(args);
+        free(init);
+    }
+
+    return 0;
+}
+
 static char * levenshtein_ratio_test() {
     if(lib_handle != NULL) {
         printf("Testing => %s\n", __FUNCTION__);
@@ -475,53 +794,68 @@ static char * levenshtein_ratio_test() {
     return 0;
 }
 
-static char * damerau_test() {
+static char * levenshtein_best_test() {
     if(lib_handle != NULL) {
         printf("Testing => %s\n", __FUNCTION__);
 
-        char *testString1 = "This is a test string";
-        char *testString2 = "This is a etst tsring";
-
+        char *pattern = "Levenshtein";
+        longlong k = 2;
+        char *candidates[] = {"Lev", "Levenstein", "Damerau", "Levenshtain", "levenshtein", "Leven", "Jaro",
+                              "Winkler", "Hamming", "Levenshtein distance"};
+        const int count = sizeof(candidates) / sizeof(candidates[0]);
+        int i;
 
-        my_bool (*damerau_init)() = dlsym(lib_handle, "damerau_init");
-        longlong (*damerau)() = dlsym(lib_handle, "damerau");
-        void(*damerau_deinit)() = dlsym(lib_handle, "damerau_deinit");
+        my_bool (*levenshtein_best_init)() = dlsym(lib_handle, "levenshtein_best_init");
+        char *(*levenshtein_best)() = dlsym(lib_handle, "levenshtein_best");
+        void(*levenshtein_best_deinit)() = dlsym(lib_handle, "levenshtein_best_deinit");
 
         UDF_INIT *init = (UDF_INIT *) malloc(sizeof(UDF_INIT));
         UDF_ARGS *args = (UDF_ARGS *) malloc(sizeof(UDF_ARGS));
-        args->arg_type = (enum Item_result *) malloc(sizeof(enum Item_result)*2);
-        args->lengths = (long unsigned int *) malloc(sizeof(long unsigned int)*2);
+        args->arg_type = (enum Item_result *) malloc(sizeof(enum Item_result)*(count + 2));
+        args->lengths = (long unsigned int *) malloc(sizeof(long unsigned int)*(count + 2));
+        args->args = (char **) malloc(sizeof(char *)*(count + 2));
         char *message = (char *) malloc(sizeof(char)*MYSQL_ERRMSG_SIZE);
+        char *result = (char *) malloc(sizeof(char)*256);
+        unsigned long length = 0;
         char *error = (char *) malloc(sizeof(char));
         char *is_null = (char *) malloc(sizeof(char));
 
+        args->arg_count = count + 2;
         args->arg_type[0] = STRING_RESULT;
-        args->arg_type[1] = STRING_RESULT;
-        args->lengths[0] = strlen(testString1);
-        args->lengths[1] = strlen(testString2);
-        args->arg_count = 2;
+        args->arg_type[1] = INT_RESULT;
+        args->args[0] = pattern;
+        args->lengths[0] = strlen(pattern);
+        args->args[1] = (char *) &k;
+        for (i = 0; i < count; i++) {
+            args->arg_type[i + 2] = STRING_RESULT;
+            args->args[i + 2] = candidates[i];
+            args->lengths[i + 2] = strlen(candidates[i]);
+        }
         is_null[0] = '\0';
         error[0] = '\0';
-        args->args = (char **) malloc(sizeof(char *)*2);
-        args->args[0] = (char *) malloc(sizeof(char)*(args->lengths[0]));
-        args->args[0] = testString1;
-        args->args[1] = (char *) malloc(sizeof(char)*(args->lengths[1]));
-        args->args[1] = testString2;
 
-        my_bool ret = damerau_init(init, args, message);
-        mu_assert("Error, damerau_test => damerau_init - expected 0", ret == 0);
+        my_bool ret = levenshtein_best_init(init, args, message);
+        mu_assert("Error, levenshtein_best_test => levenshtein_best_init - expected 0", ret == 0);
 
-        longlong result = damerau(init, args, is_null, error);
-        mu_assert("Error, damerau_test => damerau - expected 2", result == 2);
+        /* "Levenstein" (2nd) is 1 away, as "Levenshtain" and "levenshtein" after it */
+        char *best = levenshtein_best(init, args, result, &length, is_null, error);
+        mu_assert("Error, levenshtein_best_test => levenshtein_best - expected [2, 1]",
+                  is_null[0] == 0 && length == 6 && strncmp(best, "[2, 1]", 6) == 0);
 
-        damerau_deinit(init);
+        /* nothing within k = 0 */
+        k = 0;
+        best = levenshtein_best(init, args, result, &length, is_null, error);
+        mu_assert("Error, levenshtein_best_test => levenshtein_best - expected NULL", is_null[0] == 1);
 
-        free(args->args);
-        free(is_null);
-        free(error);
+        levenshtein_best_deinit(init);
+
+        free(result);
         free(message);
-        free(args->arg_type);
+        free(error);
+        free(is_null);
+        free(args->args);
         free(args->lengths);
+        free(args->arg_type);
         free(args);
         free(init);
     }
@@ -529,46 +863,225 @@ static char * damerau_test() {
     return 0;
 }
 
-static char * damerau_substring_test1() {
+static char * levenshtein_best_json_test() {
     if(lib_handle != NULL) {
         printf("Testing => %s\n", __FUNCTION__);
 
-        char *testString1 = "Test String with many white spaces";
-        char *testString2 = "This is not a test string with many whitespaces and newlines";
-
+        char *pattern = "caf\xc3\xa9";
+        longlong k = 3;
+        char *json = "[\"coffee\", null, \"tea\", \"caf\\u00e9s\", \"caf\\u00e9\"]";
+        char *malformed = "[\"coffee\", 12]";
 
-        my_bool (*damerau_substring_init)() = dlsym(lib_handle, "damerau_substring_init");
-        longlong (*damerau_substring)() = dlsym(lib_handle, "damerau_substring");
-        void(*damerau_substring_deinit)() = dlsym(lib_handle, "damerau_substring_deinit");
+        my_bool (*levenshtein_best_json_init)() = dlsym(lib_handle, "levenshtein_best_json_init");
+        char *(*levenshtein_best_json)() = dlsym(lib_handle, "levenshtein_best_json");
+        void(*levenshtein_best_json_deinit)() = dlsym(lib_handle, "levenshtein_best_json_deinit");
 
         UDF_INIT *init = (UDF_INIT *) malloc(sizeof(UDF_INIT));
         UDF_ARGS *args = (UDF_ARGS *) malloc(sizeof(UDF_ARGS));
-        args->arg_type = (enum Item_result *) malloc(sizeof(enum Item_result)*2);
-        args->lengths = (long unsigned int *) malloc(sizeof(long unsigned int)*2);
+        args->arg_type = (enum Item_result *) malloc(sizeof(enum Item_result)*3);
+        args->lengths = (long unsigned int *) malloc(sizeof(long unsigned int)*3);
+        args->args = (char **) malloc(sizeof(char *)*3);
         char *message = (char *) malloc(sizeof(char)*MYSQL_ERRMSG_SIZE);
+        char *result = (char *) malloc(sizeof(char)*256);
+        unsigned long length = 0;
         char *error = (char *) malloc(sizeof(char));
         char *is_null = (char *) malloc(sizeof(char));
 
+        args->arg_count = 3;
         args->arg_type[0] = STRING_RESULT;
-        args->arg_type[1] = STRING_RESULT;
-        args->lengths[0] = strlen(testString1);
-        args->lengths[1] = strlen(testString2);
-        args->arg_count = 2;
+        args->arg_type[1] = INT_RESULT;
+        args->arg_type[2] = STRING_RESULT;
+        args->args[0] = pattern;
+        args->lengths[0] = strlen(pattern);
+        args->args[1] = (char *) &k;
+        args->args[2] = json;
+        args->lengths[2] = strlen(json);
         is_null[0] = '\0';
         error[0] = '\0';
-        args->args = (char **) malloc(sizeof(char *)*2);
-        args->args[0] = (char *) malloc(sizeof(char)*(args->lengths[0]));
-        args->args[0] = testString1;
-        args->args[1] = (char *) malloc(sizeof(char)*(args->lengths[1]));
-        args->args[1] = testString2;
 
-        my_bool ret = damerau_substring_init(init, args, message);
-        mu_assert("Error, damerau_substring_test1 => damerau_substring_init - expected 0", ret == 0);
+        my_bool ret = levenshtein_best_json_init(init, args, message);
+        mu_assert("Error, levenshtein_best_json_test => levenshtein_best_json_init - expected 0", ret == 0);
 
-        longlong result = damerau_substring(init, args, is_null, error);
-        mu_assert("Error, damerau_substring_test1 => damerau_substring - expected 4", result == 4);
+        /* the escaped "caf\u00e9" (5th element) is the pattern itself */
+        char *best = levenshtein_best_json(init, args, result, &length, is_null, error);
+        mu_assert("Error, levenshtein_best_json_test => levenshtein_best_json - expected [5, 0]",
+                  is_null[0] == 0 && error[0] == 0 && length == 6 && strncmp(best, "[5, 0]", 6) == 0);
 
-        damerau_substring_deinit(init);
+        args->args[2] = malformed;
+        args->lengths[2] = strlen(malformed);
+        levenshtein_best_json(init, args, result, &length, is_null, error);
+        mu_assert("Error, levenshtein_best_json_test => levenshtein_best_json - expected error", error[0] == 1);
+
+        levenshtein_best_json_deinit(init);
+
+        free(result);
+        free(message);
+        free(error);
+        free(is_null);
+        free(args->args);
+        free(args->lengths);
+        free(args->arg_type);
+        free(args);
+        free(init);
+    }
+
+    return 0;
+}
+
+static char * damerau_test() {
+    if(lib_handle != NULL) {
+        printf("Testing => %s\n", __FUNCTION__);
+
+        char *testString1 = "This is a test string";
+        char *testString2 = "This is a etst tsring";
+
+
+        my_bool (*damerau_init)() = dlsym(lib_handle, "damerau_init");
+        longlong (*damerau)() = dlsym(lib_handle, "damerau");
+        void(*damerau_deinit)() = dlsym(lib_handle, "damerau_deinit");
+
+        UDF_INIT *init = (UDF_INIT *) malloc(sizeof(UDF_INIT));
+        UDF_ARGS *args = (UDF_ARGS *) malloc(sizeof(UDF_ARGS));
+        args->arg_type = (enum Item_result *) malloc(sizeof(enum Item_result)*2);
+        args->lengths = (long unsigned int *) malloc(sizeof(long unsigned int)*2);
+        char *message = (char *) malloc(sizeof(char)*MYSQL_ERRMSG_SIZE);
+        char *error = (char *) malloc(sizeof(char));
+        char *is_null = (char *) malloc(sizeof(char));
+
+        args->arg_type[0] = STRING_RESULT;
+        args->arg_type[1] = STRING_RESULT;
+        args->lengths[0] = strlen(testString1);
+        args->lengths[1] = strlen(testString2);
+        args->arg_count = 2;
+        is_null[0] = '\0';
+        error[0] = '\0';
+        args->args = (char **) malloc(sizeof(char *)*2);
+        args->args[0] = (char *) malloc(sizeof(char)*(args->lengths[0]));
+        args->args[0] = testString1;
+        args->args[1] = (char *) malloc(sizeof(char)*(args->lengths[1]));
+        args->args[1] = testString2;
+
+        my_bool ret = damerau_init(init, args, message);
+        mu_assert("Error, damerau_test => damerau_init - expected 0", ret == 0);
+
+        longlong result = damerau(init, args, is_null, error);
+        mu_assert("Error, damerau_test => damerau - expected 2", result == 2);
+
+        damerau_deinit(init);
+
+        free(args->args);
+        free(is_null);
+        free(error);
+        free(message);
+        free(args->arg_type);
+        free(args->lengths);
+        free(args);
+        free(init);
+    }
+
+    return 0;
+}
+
+static char * damerau_long_test() {
+    if(lib_handle != NULL) {
+        printf("Testing => %s\n", __FUNCTION__);
+
+        /* 3000 x 3000 cells, far beyond a thread stack if kept as a full matrix */
+        static char testString1[3001], testString2[3001];
+        int i;
+        for (i = 0; i < 3000; i++)
+            testString1[i] = testString2[i] = 'a' + (i % 10);
+        testString1[3000] = testString2[3000] = '\0';
+        for (i = 100; i < 3000; i += 1000) {
+            testString2[i] = testString1[i + 1];
+            testString2[i + 1] = testString1[i];
+        }
+
+
+        my_bool (*damerau_init)() = dlsym(lib_handle, "damerau_init");
+        longlong (*damerau)() = dlsym(lib_handle, "damerau");
+        void(*damerau_deinit)() = dlsym(lib_handle, "damerau_deinit");
+
+        UDF_INIT *init = (UDF_INIT *) malloc(sizeof(UDF_INIT));
+        UDF_ARGS *args = (UDF_ARGS *) malloc(sizeof(UDF_ARGS));
+        args->arg_type = (enum Item_result *) malloc(sizeof(enum Item_result)*2);
+        args->lengths = (long unsigned int *) malloc(sizeof(long unsigned int)*2);
+        char *message = (char *) malloc(sizeof(char)*MYSQL_ERRMSG_SIZE);
+        char *error = (char *) malloc(sizeof(char));
+        char *is_null = (char *) malloc(sizeof(char));
+
+        args->arg_type[0] = STRING_RESULT;
+        args->arg_type[1] = STRING_RESULT;
+        args->lengths[0] = strlen(testString1);
+        args->lengths[1] = strlen(testString2);
+        args->arg_count = 2;
+        is_null[0] = '\0';
+        error[0] = '\0';
+        args->args = (char **) malloc(sizeof(char *)*2);
+        args->args[0] = testString1;
+        args->args[1] = testString2;
+
+        my_bool ret = damerau_init(init, args, message);
+        mu_assert("Error, damerau_long_test => damerau_init - expected 0", ret == 0);
+
+        longlong result = damerau(init, args, is_null, error);
+        mu_assert("Error, damerau_long_test => damerau - expected 3", result == 3);
+
+        damerau_deinit(init);
+
+        free(args->args);
+        free(is_null);
+        free(error);
+        free(message);
+        free(args->arg_type);
+        free(args->lengths);
+        free(args);
+        free(init);
+    }
+
+    return 0;
+}
+
+static char * damerau_substring_test1() {
+    if(lib_handle != NULL) {
+        printf("Testing => %s\n", __FUNCTION__);
+
+        char *testString1 = "Test String with many white spaces";
+        char *testString2 = "This is not a test string with many whitespaces and newlines";
+
+
+        my_bool (*damerau_substring_init)() = dlsym(lib_handle, "damerau_substring_init");
+        longlong (*damerau_substring)() = dlsym(lib_handle, "damerau_substring");
+        void(*damerau_substring_deinit)() = dlsym(lib_handle, "damerau_substring_deinit");
+
+        UDF_INIT *init = (UDF_INIT *) malloc(sizeof(UDF_INIT));
+        UDF_ARGS *args = (UDF_ARGS *) malloc(sizeof(UDF_ARGS));
+        args->arg_type = (enum Item_result *) malloc(sizeof(enum Item_result)*2);
+        args->lengths = (long unsigned int *) malloc(sizeof(long unsigned int)*2);
+        char *message = (char *) malloc(sizeof(char)*MYSQL_ERRMSG_SIZE);
+        char *error = (char *) malloc(sizeof(char));
+        char *is_null = (char *) malloc(sizeof(char));
+
+        args->arg_type[0] = STRING_RESULT;
+        args->arg_type[1] = STRING_RESULT;
+        args->lengths[0] = strlen(testString1);
+        args->lengths[1] = strlen(testString2);
+        args->arg_count = 2;
+        is_null[0] = '\0';
+        error[0] = '\0';
+        args->args = (char **) malloc(sizeof(char *)*2);
+        args->args[0] = (char *) malloc(sizeof(char)*(args->lengths[0]));
+        args->args[0] = testString1;
+        args->args[1] = (char *) malloc(sizeof(char)*(args->lengths[1]));
+        args->args[1] = testString2;
+
+        my_bool ret = damerau_substring_init(init, args, message);
+        mu_assert("Error, damerau_substring_test1 => damerau_substring_init - expected 0", ret == 0);
+
+        longlong result = damerau_substring(init, args, is_null, error);
+        mu_assert("Error, damerau_substring_test1 => damerau_substring - expected 4", result == 4);
+
+        damerau_substring_deinit(init);
 
         free(args->args);
         free(is_null);
@@ -691,22 +1204,1411 @@ static char * damerau_substring_ci_test() {
     return 0;
 }
 
+static char * damerau_substring_ci_rows_test() {
+    if(lib_handle != NULL) {
+        printf("Testing => %s\n", __FUNCTION__);
+
+        //constant pattern, the case of both strings is folded by the masks; the third row is the shorter one
+        char *needle = "KiTTen";
+        char *rows[4] = {"the sitting KITTEN sat", "a kiTETn", "KITE", "Xyz  ABC"};
+        longlong expected[4] = {0, 1, 1, 6};
+        int i;
+
+        my_bool (*damerau_substring_ci_init)() = dlsym(lib_handle, "damerau_substring_ci_init");
+        longlong (*damerau_substring_ci)() = dlsym(lib_handle, "damerau_substring_ci");
+        void(*damerau_substring_ci_deinit)() = dlsym(lib_handle, "damerau_substring_ci_deinit");
+
+        UDF_INIT *init = (UDF_INIT *) malloc(sizeof(UDF_INIT));
+        UDF_ARGS *args = (UDF_ARGS *) malloc(sizeof(UDF_ARGS));
+        args->arg_type = (enum Item_result *) malloc(sizeof(enum Item_result)*2);
+        args->lengths = (long unsigned int *) malloc(sizeof(long unsigned int)*2);
+        char *message = (char *) malloc(sizeof(char)*MYSQL_ERRMSG_SIZE);
+        char *error = (char *) malloc(sizeof(char));
+        char *is_null = (char *) malloc(sizeof(char));
+
+        args->arg_type[0] = STRING_RESULT;
+        args->arg_type[1] = STRING_RESULT;
+        args->lengths[0] = strlen(needle);
+        args->lengths[1] = 0;
+        args->arg_count = 2;
+        is_null[0] = '\0';
+        error[0] = '\0';
+        args->args = (char **) malloc(sizeof(char *)*2);
+        args->args[0] = needle;
+        args->args[1] = NULL;
+
+        my_bool ret = damerau_substring_ci_init(init, args, message);
+        mu_assert("Error, damerau_substring_ci_rows_test => damerau_substring_ci_init - expected 0", ret == 0);
+
+        for (i = 0; i < 4; i++) {
+            args->args[1] = rows[i];
+            args->lengths[1] = strlen(rows[i]);
+            longlong result = damerau_substring_ci(init, args, is_null, error);
+            mu_assert("Error, damerau_substring_ci_rows_test => damerau_substring_ci - unexpected distance",
+                      result == expected[i] && error[0] == '\0');
+        }
+
+        damerau_substring_ci_deinit(init);
+
+        free(args->args);
+        free(is_null);
+        free(error);
+        free(message);
+        free(args->arg_type);
+        free(args->lengths);
+        free(args);
+        free(init);
+    }
+
+    return 0;
+}
+
+static char * damerau_k_test() {
+    if(lib_handle != NULL) {
+        printf("Testing => %s\n", __FUNCTION__);
+
+        long long limit_arg = 2;
+        char *testString1 = "This is a test string";
+        char *testString2 = "This is a etst tsring";
+
+
+        my_bool (*damerau_k_init)() = dlsym(lib_handle, "damerau_k_init");
+        longlong (*damerau_k)() = dlsym(lib_handle, "damerau_k");
+        void(*damerau_k_deinit)() = dlsym(lib_handle, "damerau_k_deinit");
+
+        UDF_INIT *init = (UDF_INIT *) malloc(sizeof(UDF_INIT));
+        UDF_ARGS *args = (UDF_ARGS *) malloc(sizeof(UDF_ARGS));
+        args->arg_type = (enum Item_result *) malloc(sizeof(enum Item_result)*3);
+        args->lengths = (long unsigned int *) malloc(sizeof(long unsigned int)*3);
+        char *message = (char *) malloc(sizeof(char)*MYSQL_ERRMSG_SIZE);
+        char *error = (char *) malloc(sizeof(char));
+        char *is_null = (char *) malloc(sizeof(char));
+
+        long long *limit_arg_ptr = &limit_arg;
+
+        args->arg_type[0] = STRING_RESULT;
+        args->arg_type[1] = STRING_RESULT;
+        args->arg_type[2] = INT_RESULT;
+        args->lengths[0] = strlen(testString1);
+        args->lengths[1] = strlen(testString2);
+        args->lengths[2] = sizeof(long long);
+        args->arg_count = 3;
+        is_null[0] = '\0';
+        error[0] = '\0';
+        args->args = (char **) malloc(sizeof(char *)*3);
+        args->args[0] = testString1;
+        args->args[1] = testString2;
+        args->args[2] = (char *) limit_arg_ptr;
+
+        my_bool ret = damerau_k_init(init, args, message);
+        mu_assert("Error, damerau_k_test => damerau_k_init - expected 0", ret == 0);
+
+        longlong result = damerau_k(init, args, is_null, error);
+        mu_assert("Error, damerau_k_test => damerau_k - expected 2", result == 2);
+
+        damerau_k_deinit(init);
+
+        free(args->args);
+        free(is_null);
+        free(error);
+        free(message);
+        free(args->arg_type);
+        free(args->lengths);
+        free(args);
+        free(init);
+    }
+
+    return 0;
+}
+
+static char * k_sorted_rows_test() {
+    if(lib_handle != NULL) {
+        printf("Testing => %s\n", __FUNCTION__);
+
+        //rows of an index scan, sharing prefixes with the previous one
+        long long limit_arg = 3;
+        char *pattern = "muellerstrasse";
+        char *rows[8] = {"mueller strasse", "muellerstrase", "muellerstrasse", "muellerstrasse 1",
+                         "muellerstrsase", "muellertsrasse", "muellrestrasse", "muller"};
+        longlong expected_lev[8] = {1, 1, 0, 2, 2, 2, 2, 4};
+        longlong expected_dam[8] = {1, 1, 0, 2, 1, 1, 1, 4};
+        int i;
+
+        my_bool (*levenshtein_k_init)() = dlsym(lib_handle, "levenshtein_k_init");
+        longlong (*levenshtein_k)() = dlsym(lib_handle, "levenshtein_k");
+        void(*levenshtein_k_deinit)() = dlsym(lib_handle, "levenshtein_k_deinit");
+        my_bool (*damerau_k_init)() = dlsym(lib_handle, "damerau_k_init");
+        longlong (*damerau_k)() = dlsym(lib_handle, "damerau_k");
+        void(*damerau_k_deinit)() = dlsym(lib_handle, "damerau_k_deinit");
+
+        UDF_INIT *init_lev = (UDF_INIT *) malloc(sizeof(UDF_INIT));
+        UDF_INIT *init_dam = (UDF_INIT *) malloc(sizeof(UDF_INIT));
+        UDF_ARGS *args = (UDF_ARGS *) malloc(sizeof(UDF_ARGS));
+        args->arg_type = (enum Item_result *) malloc(sizeof(enum Item_result)*3);
+        args->lengths = (long unsigned int *) malloc(sizeof(long unsigned int)*3);
+        char *message = (char *) malloc(sizeof(char)*MYSQL_ERRMSG_SIZE);
+        char *error = (char *) malloc(sizeof(char));
+        char *is_null = (char *) malloc(sizeof(char));
+
+        args->arg_type[0] = STRING_RESULT;
+        args->arg_type[1] = STRING_RESULT;
+        args->arg_type[2] = INT_RESULT;
+        args->lengths[0] = 0;
+        args->lengths[1] = strlen(pattern);
+        args->arg_count = 3;
+        is_null[0] = '\0';
+        error[0] = '\0';
+        args->args = (char **) malloc(sizeof(char *)*3);
+        args->args[0] = NULL;
+        args->args[1] = pattern;
+        args->args[2] = (char *) &limit_arg;
+
+        my_bool ret = levenshtein_k_init(init_lev, args, message);
+        mu_assert("Error, k_sorted_rows_test => levenshtein_k_init - expected 0", ret == 0);
+        ret = damerau_k_init(init_dam, args, message);
+        mu_assert("Error, k_sorted_rows_test => damerau_k_init - expected 0", ret == 0);
+
+        for (i = 0; i < 8; i++) {
+            args->args[0] = rows[i];
+            args->lengths[0] = strlen(rows[i]);
+
+            longlong result = levenshtein_k(init_lev, args, is_null, error);
+            mu_assert("Error, k_sorted_rows_test => levenshtein_k - unexpected distance", result == expected_lev[i]);
+            result = damerau_k(init_dam, args, is_null, error);
+            mu_assert("Error, k_sorted_rows_test => damerau_k - unexpected distance", result == expected_dam[i]);
+        }
+
+        levenshtein_k_deinit(init_lev);
+        damerau_k_deinit(init_dam);
+
+        free(args->args);
+        free(is_null);
+        free(error);
+        free(message);
+        free(args->arg_type);
+        free(args->lengths);
+        free(args);
+        free(init_dam);
+        free(init_lev);
+    }
+
+    return 0;
+}
+
+static char * damerau_k_ratio_test() {
+    if(lib_handle != NULL) {
+        printf("Testing => %s\n", __FUNCTION__);
+
+        long long limit_arg = 2;
+        char *testString1 = "Levenhstein";
+        char *testString2 = "Levenshtein";
+
+
+        my_bool (*damerau_k_ratio_init)() = dlsym(lib_handle, "damerau_k_ratio_init");
+        double (*damerau_k_ratio)() = dlsym(lib_handle, "damerau_k_ratio");
+        void(*damerau_k_ratio_deinit)() = dlsym(lib_handle, "damerau_k_ratio_deinit");
+
+        UDF_INIT *init = (UDF_INIT *) malloc(sizeof(UDF_INIT));
+        UDF_ARGS *args = (UDF_ARGS *) malloc(sizeof(UDF_ARGS));
+        args->arg_type = (enum Item_result *) malloc(sizeof(enum Item_result)*3);
+        args->lengths = (long unsigned int *) malloc(sizeof(long unsigned int)*3);
+        char *message = (char *) malloc(sizeof(char)*MYSQL_ERRMSG_SIZE);
+        char *error = (char *) malloc(sizeof(char));
+        char *is_null = (char *) malloc(sizeof(char));
+
+        long long *limit_arg_ptr = &limit_arg;
+
+        args->arg_type[0] = STRING_RESULT;
+        args->arg_type[1] = STRING_RESULT;
+        args->arg_type[2] = INT_RESULT;
+        args->lengths[0] = strlen(testString1);
+        args->lengths[1] = strlen(testString2);
+        args->lengths[2] = sizeof(long long);
+        args->arg_count = 3;
+        is_null[0] = '\0';
+        error[0] = '\0';
+        args->args = (char **) malloc(sizeof(char *)*3);
+        args->args[0] = testString1;
+        args->args[1] = testString2;
+        args->args[2] = (char *) limit_arg_ptr;
+
+        my_bool ret = damerau_k_ratio_init(init, args, message);
+        mu_assert("Error, damerau_k_ratio_test => damerau_k_ratio_init - expected 0", ret == 0);
+
+        double result = damerau_k_ratio(init, args, is_null, error);
+        mu_assert("Error, damerau_k_ratio_test => damerau_k_ratio - expected 0.909091", result > 0.9090 && result < 0.9091);
+
+        damerau_k_ratio_deinit(init);
+
+        free(args->args);
+        free(is_null);
+        free(error);
+        free(message);
+        free(args->arg_type);
+        free(args->lengths);
+        free(args);
+        free(init);
+    }
+
+    return 0;
+}
+
+static char * damerau_core_costs_test() {
+    if(lib_handle != NULL) {
+        printf("Testing => %s\n", __FUNCTION__);
+
+        void *(*bp_scratch_alloc)() = dlsym(lib_handle, "_bp_scratch_alloc");
+        void (*bp_scratch_free)() = dlsym(lib_handle, "_bp_scratch_free");
+        longlong (*damerau_core)() = dlsym(lib_handle, "_damerau_core");
+
+        char *testString1 = "This is a test string";
+        char *testString2 = "This is a etst tsring";
+        int rows[3 * 22];
+        void *bp = bp_scratch_alloc(strlen(testString1));
+
+        /* unit costs run the bit-parallel kernel, other costs the rolling rows */
+        longlong result1 = damerau_core(testString1, strlen(testString1), testString2, strlen(testString2),
+                                        1, 1, 1, 1, NULL, bp);
+        longlong result2 = damerau_core(testString1, strlen(testString1), testString2, strlen(testString2),
+                                        3, 1, 1, 1, rows, bp);
+        bp_scratch_free(bp);
+        mu_assert("Error, damerau_core_costs_test => unit costs - expected 2", result1 == 2);
+        mu_assert("Error, damerau_core_costs_test => swap costs 3 - expected 4", result2 == 4);
+    }
+
+    return 0;
+}
+
+static char * damerau_full_test() {
+    if(lib_handle != NULL) {
+        printf("Testing => %s\n", __FUNCTION__);
+
+        /* transposition with an insertion in between, the optimal string alignment (damerau) gives 3 */
+        char *testString1 = "CA";
+        char *testString2 = "ABC";
+
+
+        my_bool (*damerau_full_init)() = dlsym(lib_handle, "damerau_full_init");
+        longlong (*damerau_full)() = dlsym(lib_handle, "damerau_full");
+        void(*damerau_full_deinit)() = dlsym(lib_handle, "damerau_full_deinit");
+
+        UDF_INIT *init = (UDF_INIT *) malloc(sizeof(UDF_INIT));
+        UDF_ARGS *args = (UDF_ARGS *) malloc(sizeof(UDF_ARGS));
+        args->arg_type = (enum Item_result *) malloc(sizeof(enum Item_result)*2);
+        args->lengths = (long unsigned int *) malloc(sizeof(long unsigned int)*2);
+        char *message = (char *) malloc(sizeof(char)*MYSQL_ERRMSG_SIZE);
+        char *error = (char *) malloc(sizeof(char));
+        char *is_null = (char *) malloc(sizeof(char));
+
+        args->arg_type[0] = STRING_RESULT;
+        args->arg_type[1] = STRING_RESULT;
+        args->lengths[0] = strlen(testString1);
+        args->lengths[1] = strlen(testString2);
+        args->arg_count = 2;
+        is_null[0] = '\0';
+        error[0] = '\0';
+        args->args = (char **) malloc(sizeof(char *)*2);
+        args->args[0] = testString1;
+        args->args[1] = testString2;
+
+        my_bool ret = damerau_full_init(init, args, message);
+        mu_assert("Error, damerau_full_test => damerau_full_init - expected 0", ret == 0);
+
+        longlong result = damerau_full(init, args, is_null, error);
+        mu_assert("Error, damerau_full_test => damerau_full - expected 2", result == 2);
+
+        damerau_full_deinit(init);
+
+        free(args->args);
+        free(is_null);
+        free(error);
+        free(message);
+        free(args->arg_type);
+        free(args->lengths);
+        free(args);
+        free(init);
+    }
+
+    return 0;
+}
+
+static char * utf8_test() {
+    if(lib_handle != NULL) {
+        printf("Testing => %s\n", __FUNCTION__);
+
+        //ASCII, non-ASCII (remapped to bytes), invalid bytes, too many distinct characters for a byte alphabet
+        char *s[5] = {"kitten", "café crème", "a\xc3", "\xff", NULL};
+        char *t[5] = {"sitting", "cafe creme", "a", "\xfe", NULL};
+        longlong expected_levenshtein[5] = {3, 2, 1, 1, 1};
+        longlong expected_damerau[5] = {3, 2, 1, 1, 2};
+        char buf1[1000], buf2[1000];
+        int i;
+
+        //200 distinct CJK characters in both, one substitution and one transposition apart
+        for (i = 0; i < 200; i++) {
+            buf1[3 * i] = (char) 0xE4;
+            buf1[3 * i + 1] = (char) (0x80 | (i >> 6));
+            buf1[3 * i + 2] = (char) (0x80 | (i & 0x3F));
+        }
+        memcpy(buf2, buf1, 600);
+        buf2[2] = (char) 0xBF; //U+403F
+        memcpy(buf2 + 300, buf1 + 303, 3);
+        memcpy(buf2 + 303, buf1 + 300, 3);
+        buf1[600] = buf2[600] = '\0';
+        s[4] = buf1;
+        t[4] = buf2;
+        expected_levenshtein[4] = 3;
+
+        my_bool (*levenshtein_utf8_init)() = dlsym(lib_handle, "levenshtein_utf8_init");
+        longlong (*levenshtein_utf8)() = dlsym(lib_handle, "levenshtein_utf8");
+        void(*levenshtein_utf8_deinit)() = dlsym(lib_handle, "levenshtein_utf8_deinit");
+        my_bool (*damerau_utf8_init)() = dlsym(lib_handle, "damerau_utf8_init");
+        longlong (*damerau_utf8)() = dlsym(lib_handle, "damerau_utf8");
+        void(*damerau_utf8_deinit)() = dlsym(lib_handle, "damerau_utf8_deinit");
+
+        UDF_INIT *init = (UDF_INIT *) malloc(sizeof(UDF_INIT));
+        UDF_INIT *init2 = (UDF_INIT *) malloc(sizeof(UDF_INIT));
+        UDF_ARGS *args = (UDF_ARGS *) malloc(sizeof(UDF_ARGS));
+        args->arg_type = (enum Item_result *) malloc(sizeof(enum Item_result)*2);
+        args->lengths = (long unsigned int *) malloc(sizeof(long unsigned int)*2);
+        char *message = (char *) malloc(sizeof(char)*MYSQL_ERRMSG_SIZE);
+        char *error = (char *) malloc(sizeof(char));
+        char *is_null = (char *) malloc(sizeof(char));
+
+        args->arg_type[0] = STRING_RESULT;
+        args->arg_type[1] = STRING_RESULT;
+        args->arg_count = 2;
+        is_null[0] = '\0';
+        error[0] = '\0';
+        args->args = (char **) malloc(sizeof(char *)*2);
+        args->args[0] = NULL;
+        args->args[1] = NULL;
+
+        my_bool ret = levenshtein_utf8_init(init, args, message);
+        mu_assert("Error, utf8_test => levenshtein_utf8_init - expected 0", ret == 0);
+        ret = damerau_utf8_init(init2, args, message);
+        mu_assert("Error, utf8_test => damerau_utf8_init - expected 0", ret == 0);
+
+        for (i = 0; i < 5; i++) {
+            args->args[0] = s[i];
+            args->lengths[0] = strlen(s[i]);
+            args->args[1] = t[i];
+            args->lengths[1] = strlen(t[i]);
+            longlong result = levenshtein_utf8(init, args, is_null, error);
+            //printf("%d %lld\n", i, result);
+            mu_assert("Error, utf8_test => levenshtein_utf8 - unexpected distance",
+                      result == expected_levenshtein[i] && error[0] == '\0');
+            result = damerau_utf8(init2, args, is_null, error);
+            mu_assert("Error, utf8_test => damerau_utf8 - unexpected distance",
+                      result == expected_damerau[i] && error[0] == '\0');
+        }
+
+        levenshtein_utf8_deinit(init);
+        damerau_utf8_deinit(init2);
+
+        free(args->args);
+        free(is_null);
+        free(error);
+        free(message);
+        free(args->arg_type);
+        free(args->lengths);
+        free(args);
+        free(init);
+        free(init2);
+    }
+
+    return 0;
+}
+
+static char * collation_test() {
+    if(lib_handle != NULL) {
+        printf("Testing => %s\n", __FUNCTION__);
+
+        //latin1 bytes, then UTF-8 Latin, Cyrillic and Greek (final sigma too); the ASCII collation keeps the
+        //accent of the last pair
+        char *collation[6] = {"latin1", "utf8mb4", "utf8mb4", "UTF8MB4", "utf8mb4", "ascii"};
+        char *s[6] = {"\xc9mile", "muller", "\xd0\x81\xd0\xbb\xd0\xba\xd0\xb0", "\xce\xa3\xce\x9f\xce\xa6\xce\x8a\xce\x91",
+                      "\xce\x9f\xce\x94\xce\x9f\xce\xa3", "Emile"};
+        char *t[6] = {"said \xe9MILE", "Herr M\xc3\xbcller", "\xd1\x91\xd0\xbb\xd0\xba\xd0\xb0 \xd0\xb8",
+                      "\xcf\x83\xce\xbf\xcf\x86\xce\xb9\xce\xb1", "\xce\xbf\xce\xb4\xce\xbf\xcf\x82", "said \xc3\xa9mile"};
+        longlong expected[6] = {0, 0, 0, 0, 0, 1};
+        int k = 3;
+        int i;
+
+        my_bool (*levenshtein_substring_ci_k_init)() = dlsym(lib_handle, "levenshtein_substring_ci_k_init");
+        longlong (*levenshtein_substring_ci_k)() = dlsym(lib_handle, "levenshtein_substring_ci_k");
+        void(*levenshtein_substring_ci_k_deinit)() = dlsym(lib_handle, "levenshtein_substring_ci_k_deinit");
+        my_bool (*damerau_substring_ci_init)() = dlsym(lib_handle, "damerau_substring_ci_init");
+        longlong (*damerau_substring_ci)() = dlsym(lib_handle, "damerau_substring_ci");
+        void(*damerau_substring_ci_deinit)() = dlsym(lib_handle, "damerau_substring_ci_deinit");
+
+        UDF_INIT *init = (UDF_INIT *) malloc(sizeof(UDF_INIT));
+        UDF_INIT *init2 = (UDF_INIT *) malloc(sizeof(UDF_INIT));
+        UDF_ARGS *args = (UDF_ARGS *) malloc(sizeof(UDF_ARGS));
+        UDF_ARGS *args2 = (UDF_ARGS *) malloc(sizeof(UDF_ARGS));
+        args->arg_type = (enum Item_result *) malloc(sizeof(enum Item_result)*4);
+        args->lengths = (long unsigned int *) malloc(sizeof(long unsigned int)*4);
+        args->args = (char **) malloc(sizeof(char *)*4);
+        args2->arg_type = (enum Item_result *) malloc(sizeof(enum Item_result)*3);
+        args2->lengths = (long unsigned int *) malloc(sizeof(long unsigned int)*3);
+        args2->args = (char **) malloc(sizeof(char *)*3);
+        char *message = (char *) malloc(sizeof(char)*MYSQL_ERRMSG_SIZE);
+        char *error = (char *) malloc(sizeof(char));
+        char *is_null = (char *) malloc(sizeof(char));
+
+        args->arg_type[0] = STRING_RESULT;
+        args->arg_type[1] = STRING_RESULT;
+        args->arg_type[2] = INT_RESULT;
+        args->arg_type[3] = STRING_RESULT;
+        args->arg_count = 4;
+        args2->arg_type[0] = STRING_RESULT;
+        args2->arg_type[1] = STRING_RESULT;
+        args2->arg_type[2] = STRING_RESULT;
+        args2->arg_count = 3;
+        is_null[0] = '\0';
+        error[0] = '\0';
+
+        //the collation must be known
+        args->args[0] = args->args[1] = NULL;
+        args->args[2] = (char *) &k;
+        args->args[3] = "klingon";
+        args->lengths[3] = strlen(args->args[3]);
+        my_bool ret = levenshtein_substring_ci_k_init(init, args, message);
+        mu_assert("Error, collation_test => levenshtein_substring_ci_k_init - expected 1", ret == 1);
+
+        for (i = 0; i < 6; i++) {
+            args->args[0] = args2->args[0] = s[i];
+            args->lengths[0] = args2->lengths[0] = strlen(s[i]);
+            args->args[1] = args2->args[1] = NULL;
+            args->args[3] = args2->args[2] = collation[i];
+            args->lengths[3] = args2->lengths[2] = strlen(collation[i]);
+
+            ret = levenshtein_substring_ci_k_init(init, args, message);
+            mu_assert("Error, collation_test => levenshtein_substring_ci_k_init - expected 0", ret == 0);
+            ret = damerau_substring_ci_init(init2, args2, message);
+            mu_assert("Error, collation_test => damerau_substring_ci_init - expected 0", ret == 0);
+
+            args->args[1] = args2->args[1] = t[i];
+            args->lengths[1] = args2->lengths[1] = strlen(t[i]);
+            longlong result = levenshtein_substring_ci_k(init, args, is_null, error);
+            mu_assert("Error, collation_test => levenshtein_substring_ci_k - unexpected distance",
+                      result == expected[i] && error[0] == '\0');
+            result = damerau_substring_ci(init2, args2, is_null, error);
+            mu_assert("Error, collation_test => damerau_substring_ci - unexpected distance",
+                      result == expected[i] && error[0] == '\0');
+
+            levenshtein_substring_ci_k_deinit(init);
+            damerau_substring_ci_deinit(init2);
+        }
+
+        free(args->args);
+        free(args2->args);
+        free(is_null);
+        free(error);
+        free(message);
+        free(args->arg_type);
+        free(args->lengths);
+        free(args2->arg_type);
+        free(args2->lengths);
+        free(args);
+        free(args2);
+        free(init);
+        free(init2);
+    }
+
+    return 0;
+}
+
+static char * similarities_cpu_features_test() {
+    if(lib_handle != NULL) {
+        printf("Testing => %s\n", __FUNCTION__);
+
+        my_bool (*similarities_cpu_features_init)() = dlsym(lib_handle, "similarities_cpu_features_init");
+        char *(*similarities_cpu_features)() = dlsym(lib_handle, "similarities_cpu_features");
+        void(*similarities_cpu_features_deinit)() = dlsym(lib_handle, "similarities_cpu_features_deinit");
+
+        UDF_INIT *init = (UDF_INIT *) malloc(sizeof(UDF_INIT));
+        UDF_ARGS *args = (UDF_ARGS *) malloc(sizeof(UDF_ARGS));
+        char *message = (char *) malloc(sizeof(char)*MYSQL_ERRMSG_SIZE);
+        char *result = (char *) malloc(sizeof(char)*256);
+        unsigned long length = 0;
+        char *error = (char *) malloc(sizeof(char));
+        char *is_null = (char *) malloc(sizeof(char));
+
+        args->arg_count = 0;
+        is_null[0] = '\0';
+        error[0] = '\0';
+
+        my_bool ret = similarities_cpu_features_init(init, args, message);
+        mu_assert("Error, similarities_cpu_features_test => similarities_cpu_features_init - expected 0", ret == 0);
+
+        char *features = similarities_cpu_features(init, args, result, &length, is_null, error);
+        printf("Kernels => %.*s\n", (int) length, features);
+        mu_assert("Error, similarities_cpu_features_test => similarities_cpu_features - expected a kernel path",
+                  strncmp(features, "scalar (", 8) == 0 || strncmp(features, "sse4.1 (", 8) == 0 ||
+                  strncmp(features, "avx2 (", 6) == 0 || strncmp(features, "avx512 (", 8) == 0);
+        mu_assert("Error, similarities_cpu_features_test => similarities_cpu_features - expected closing bracket",
+                  length > 0 && features[length - 1] == ')');
+
+        similarities_cpu_features_deinit(init);
+
+        free(result);
+        free(message);
+        free(error);
+        free(is_null);
+        free(args);
+        free(init);
+    }
+
+    return 0;
+}
+
+static char * prefilter_test() {
+    if(lib_handle != NULL) {
+        printf("Testing => %s\n", __FUNCTION__);
+
+        //rejected by the length difference, by the bag distance, by the 2-grams, passed on to the recurrence
+        char buf1[3][65], buf2[3][65];
+        char *s[4] = {"abc", buf1[1], buf1[2], "kitten"};
+        char *t[4] = {"abcdefgh", buf2[1], buf2[2], "sitting"};
+        int k[4] = {2, 20, 15, 3};
+        longlong expected[4] = {3, 21, 16, 3};
+        unsigned long long before[4], after[4];
+        int i;
+
+        memset(buf1[1], 'a', 64);
+        memset(buf2[1], 'b', 64);
+        for (i = 0; i < 64; i++) {
+            buf1[2][i] = "ab"[i % 2];
+            buf2[2][i] = "aabb"[i % 4];
+        }
+        buf1[1][64] = buf2[1][64] = buf1[2][64] = buf2[2][64] = '\0';
+
+        my_bool (*levenshtein_k_init)() = dlsym(lib_handle, "levenshtein_k_init");
+        longlong (*levenshtein_k)() = dlsym(lib_handle, "levenshtein_k");
+        void(*levenshtein_k_deinit)() = dlsym(lib_handle, "levenshtein_k_deinit");
+        char *(*similarities_prefilter_stats)() = dlsym(lib_handle, "similarities_prefilter_stats");
+
+        UDF_INIT *init = (UDF_INIT *) malloc(sizeof(UDF_INIT));
+        UDF_ARGS *args = (UDF_ARGS *) malloc(sizeof(UDF_ARGS));
+        args->arg_type = (enum Item_result *) malloc(sizeof(enum Item_result)*3);
+        args->lengths = (long unsigned int *) malloc(sizeof(long unsigned int)*3);
+        args->args = (char **) malloc(sizeof(char *)*3);
+        char *message = (char *) malloc(sizeof(char)*MYSQL_ERRMSG_SIZE);
+        char *result = (char *) malloc(sizeof(char)*256);
+        unsigned long length = 0;
+        char *error = (char *) malloc(sizeof(char));
+        char *is_null = (char *) malloc(sizeof(char));
+
+        args->arg_type[0] = STRING_RESULT;
+        args->arg_type[1] = STRING_RESULT;
+        args->arg_type[2] = INT_RESULT;
+        args->arg_count = 3;
+        args->args[0] = NULL;
+        args->args[1] = NULL;
+        args->args[2] = NULL;
+        is_null[0] = '\0';
+        error[0] = '\0';
+
+        similarities_prefilter_stats(init, args, result, &length, is_null, error);
+        mu_assert("Error, prefilter_test => similarities_prefilter_stats - unexpected format",
+                  sscanf(result, "length %llu, bag %llu, qgram %llu, passed %llu",
+                         &before[0], &before[1], &before[2], &before[3]) == 4);
+
+        my_bool ret = levenshtein_k_init(init, args, message);
+        mu_assert("Error, prefilter_test => levenshtein_k_init - expected 0", ret == 0);
+
+        for (i = 0; i < 4; i++) {
+            args->args[0] = s[i];
+            args->lengths[0] = strlen(s[i]);
+            args->args[1] = t[i];
+            args->lengths[1] = strlen(t[i]);
+            args->args[2] = (char *) &k[i];
+            longlong dist = levenshtein_k(init, args, is_null, error);
+            mu_assert("Error, prefilter_test => levenshtein_k - unexpected distance",
+                      dist == expected[i] && error[0] == '\0');
+        }
+
+        //the counts of a statement are added when it ends
+        levenshtein_k_deinit(init);
+
+        similarities_prefilter_stats(init, args, result, &length, is_null, error);
+        mu_assert("Error, prefilter_test => similarities_prefilter_stats - unexpected format",
+                  sscanf(result, "length %llu, bag %llu, qgram %llu, passed %llu",
+                         &after[0], &after[1], &after[2], &after[3]) == 4);
+        for (i = 0; i < 4; i++)
+            mu_assert("Error, prefilter_test => similarities_prefilter_stats - expected one more row per counter",
+                      after[i] == before[i] + 1);
+
+        free(args->args);
+        free(args->arg_type);
+        free(args->lengths);
+        free(result);
+        free(message);
+        free(error);
+        free(is_null);
+        free(args);
+        free(init);
+    }
+
+    return 0;
+}
+
+static char * signature_test() {
+    if(lib_handle != NULL) {
+        printf("Testing => %s\n", __FUNCTION__);
+
+        //within k, too far by the lengths, by the byte classes, by the 2-grams unless transpositions count as one edit
+        char *s[5] = {"kitten", "abc", "aaaa", "abcd", "abcd"};
+        char *t[5] = {"sitting", "abcdefgh", "bbbb", "acbd", "acbd"};
+        int k[5] = {3, 2, 0, 1, 1};
+        int transpositions[5] = {0, 0, 0, 0, 1};
+        longlong expected[5] = {1, 0, 0, 0, 1};
+        char sig1[5][32], sig2[5][32];
+        int i;
+
+        my_bool (*levenshtein_signature_init)() = dlsym(lib_handle, "levenshtein_signature_init");
+        char *(*levenshtein_signature)() = dlsym(lib_handle, "levenshtein_signature");
+        void(*levenshtein_signature_deinit)() = dlsym(lib_handle, "levenshtein_signature_deinit");
+        my_bool (*levenshtein_sig_may_match_init)() = dlsym(lib_handle, "levenshtein_sig_may_match_init");
+        longlong (*levenshtein_sig_may_match)() = dlsym(lib_handle, "levenshtein_sig_may_match");
+        void(*levenshtein_sig_may_match_deinit)() = dlsym(lib_handle, "levenshtein_sig_may_match_deinit");
+
+        UDF_INIT *init = (UDF_INIT *) malloc(sizeof(UDF_INIT));
+        UDF_ARGS *args = (UDF_ARGS *) malloc(sizeof(UDF_ARGS));
+        args->arg_type = (enum Item_result *) malloc(sizeof(enum Item_result)*4);
+        args->lengths = (long unsigned int *) malloc(sizeof(long unsigned int)*4);
+        args->args = (char **) malloc(sizeof(char *)*4);
+        char *message = (char *) malloc(sizeof(char)*MYSQL_ERRMSG_SIZE);
+        char *result = (char *) malloc(sizeof(char)*256);
+        unsigned long length = 0;
+        char *error = (char *) malloc(sizeof(char));
+        char *is_null = (char *) malloc(sizeof(char));
+
+        args->arg_type[0] = STRING_RESULT;
+        args->arg_count = 1;
+        args->args[0] = NULL;
+        is_null[0] = '\0';
+        error[0] = '\0';
+
+        my_bool ret = levenshtein_signature_init(init, args, message);
+        mu_assert("Error, signature_test => levenshtein_signature_init - expected 0", ret == 0);
+
+        for (i = 0; i < 5; i++) {
+            args->args[0] = s[i];
+            args->lengths[0] = strlen(s[i]);
+            levenshtein_signature(init, args, result, &length, is_null, error);
+            mu_assert("Error, signature_test => levenshtein_signature - expected 32 bytes of version 1",
+                      length == 32 && result[0] == 1);
+            memcpy(sig1[i], result, 32);
+
+            args->args[0] = t[i];
+            args->lengths[0] = strlen(t[i]);
+            levenshtein_signature(init, args, result, &length, is_null, error);
+            memcpy(sig2[i], result, 32);
+        }
+
+        levenshtein_signature_deinit(init);
+
+        args->arg_type[1] = STRING_RESULT;
+        args->arg_type[2] = INT_RESULT;
+        args->arg_type[3] = INT_RESULT;
+        args->arg_count = 4;
+
+        ret = levenshtein_sig_may_match_init(init, args, message);
+        mu_assert("Error, signature_test => levenshtein_sig_may_match_init - expected 0", ret == 0);
+
+        for (i = 0; i < 5; i++) {
+            args->args[0] = sig1[i];
+            args->lengths[0] = 32;
+            args->args[1] = sig2[i];
+            args->lengths[1] = 32;
+            args->args[2] = (char *) &k[i];
+            args->args[3] = (char *) &transpositions[i];
+            longlong may_match = levenshtein_sig_may_match(init, args, is_null, error);
+            mu_assert("Error, signature_test => levenshtein_sig_may_match - unexpected filter result",
+                      may_match == expected[i]);
+        }
+
+        //nothing is proven about a value which is not a fingerprint
+        args->args[0] = NULL;
+        args->args[1] = sig2[1];
+        args->args[2] = (char *) &k[1];
+        args->args[3] = (char *) &transpositions[1];
+        mu_assert("Error, signature_test => levenshtein_sig_may_match - expected 1 for NULL",
+                  levenshtein_sig_may_match(init, args, is_null, error) == 1);
+
+        levenshtein_sig_may_match_deinit(init);
+
+        free(args->args);
+        free(args->arg_type);
+        free(args->lengths);
+        free(result);
+        free(message);
+        free(error);
+        free(is_null);
+        free(args);
+        free(init);
+    }
+
+    return 0;
+}
+
+static char * partition_test() {
+    if(lib_handle != NULL) {
+        printf("Testing => %s\n", __FUNCTION__);
+
+        my_bool (*levenshtein_partition_keys_init)() = dlsym(lib_handle, "levenshtein_partition_keys_init");
+        char *(*levenshtein_partition_keys)() = dlsym(lib_handle, "levenshtein_partition_keys");
+        void(*levenshtein_partition_keys_deinit)() = dlsym(lib_handle, "levenshtein_partition_keys_deinit");
+        my_bool (*levenshtein_partition_probes_init)() = dlsym(lib_handle, "levenshtein_partition_probes_init");
+        char *(*levenshtein_partition_probes)() = dlsym(lib_handle, "levenshtein_partition_probes");
+        void(*levenshtein_partition_probes_deinit)() = dlsym(lib_handle, "levenshtein_partition_probes_deinit");
+
+        UDF_INIT *init = (UDF_INIT *) malloc(sizeof(UDF_INIT));
+        UDF_ARGS *args = (UDF_ARGS *) malloc(sizeof(UDF_ARGS));
+        args->arg_type = (enum Item_result *) malloc(sizeof(enum Item_result)*2);
+        args->lengths = (long unsigned int *) malloc(sizeof(long unsigned int)*2);
+        args->args = (char **) malloc(sizeof(char *)*2);
+        char *message = (char *) malloc(sizeof(char)*MYSQL_ERRMSG_SIZE);
+        char *result = (char *) malloc(sizeof(char)*256);
+        unsigned long length = 0;
+        char *error = (char *) malloc(sizeof(char));
+        char *is_null = (char *) malloc(sizeof(char));
+        int k = 2, negative = -1;
+
+        args->arg_type[0] = STRING_RESULT;
+        args->arg_type[1] = INT_RESULT;
+        args->arg_count = 2;
+        args->args[0] = "Levenshtein";
+        args->lengths[0] = strlen("Levenshtein");
+        args->args[1] = (char *) &k;
+        is_null[0] = '\0';
+        error[0] = '\0';
+
+        my_bool ret = levenshtein_partition_keys_init(init, args, message);
+        mu_assert("Error, partition_test => levenshtein_partition_keys_init - expected 0", ret == 0);
+
+        //11 bytes in 3 segments, the last two one longer
+        char *keys = levenshtein_partition_keys(init, args, result, &length, is_null, error);
+        mu_assert("Error, partition_test => levenshtein_partition_keys - unexpected keys",
+                  keys != NULL && length == strlen("[\"11:0:Lev\",\"11:1:ensh\",\"11:2:tein\"]") &&
+                  strncmp(keys, "[\"11:0:Lev\",\"11:1:ensh\",\"11:2:tein\"]", length) == 0);
+
+        args->args[1] = (char *) &negative;
+        is_null[0] = '\0';
+        levenshtein_partition_keys(init, args, result, &length, is_null, error);
+        mu_assert("Error, partition_test => levenshtein_partition_keys - expected null for a negative k", is_null[0] == 1);
+
+        levenshtein_partition_keys_deinit(init);
+
+        //a transposition away: the first and last segments are found unedited, the middle one is not
+        args->args[0] = "Levenhstein";
+        args->args[1] = (char *) &k;
+        is_null[0] = '\0';
+
+        ret = levenshtein_partition_probes_init(init, args, message);
+        mu_assert("Error, partition_test => levenshtein_partition_probes_init - expected 0", ret == 0);
+
+        char *probes = levenshtein_partition_probes(init, args, result, &length, is_null, error);
+        mu_assert("Error, partition_test => levenshtein_partition_probes - expected a JSON array",
+                  probes != NULL && length > 2 && probes[0] == '[' && probes[length - 1] == ']');
+        char *copy = strndup(probes, length);
+        mu_assert("Error, partition_test => levenshtein_partition_probes - expected the keys of the unedited segments",
+                  strstr(copy, "\"11:0:Lev\"") != NULL && strstr(copy, "\"11:2:tein\"") != NULL);
+        mu_assert("Error, partition_test => levenshtein_partition_probes - unexpected key of the edited segment",
+                  strstr(copy, "\"11:1:ensh\"") == NULL);
+        free(copy);
+
+        //a k far above the length: the lengths up to k have the one probe of their empty first segment
+        int large = 1000;
+        args->args[0] = "abc";
+        args->lengths[0] = 3;
+        args->args[1] = (char *) &large;
+        probes = levenshtein_partition_probes(init, args, result, &length, is_null, error);
+        mu_assert("Error, partition_test => levenshtein_partition_probes - expected the probes of a large k",
+                  probes != NULL && is_null[0] == '\0' && error[0] == '\0' && strncmp(probes, "[\"0:0:\"", 7) == 0);
+        copy = strndup(probes, length);
+        mu_assert("Error, partition_test => levenshtein_partition_probes - expected one probe of a length up to k",
+                  strstr(copy, "\"1000:0:\"") != NULL && strstr(copy, "\"1000:1:") == NULL);
+        free(copy);
+
+        levenshtein_partition_probes_deinit(init);
+
+        free(args->args);
+        free(args->arg_type);
+        free(args->lengths);
+        free(result);
+        free(message);
+        free(error);
+        free(is_null);
+        free(args);
+        free(init);
+    }
+
+    return 0;
+}
+
+static char * levenshtein_argmin_test() {
+    if(lib_handle != NULL) {
+        printf("Testing => %s\n", __FUNCTION__);
+
+        //closest first found at 1, then an exact match, after which nothing can replace it
+        char *group1[6] = {"Levenhstein", "Levenshtain", "Lovenshtein", NULL, "Levenshtein", "Levenshtein "};
+        //nothing within k
+        char *group2[2] = {"Damerau", "Hamming"};
+        int k = 3;
+        int i;
+
+        my_bool (*levenshtein_argmin_init)() = dlsym(lib_handle, "levenshtein_argmin_init");
+        void (*levenshtein_argmin_clear)() = dlsym(lib_handle, "levenshtein_argmin_clear");
+        void (*levenshtein_argmin_add)() = dlsym(lib_handle, "levenshtein_argmin_add");
+        void (*levenshtein_argmin_reset)() = dlsym(lib_handle, "levenshtein_argmin_reset");
+        char *(*levenshtein_argmin)() = dlsym(lib_handle, "levenshtein_argmin");
+        void(*levenshtein_argmin_deinit)() = dlsym(lib_handle, "levenshtein_argmin_deinit");
+
+        UDF_INIT *init = (UDF_INIT *) malloc(sizeof(UDF_INIT));
+        UDF_ARGS *args = (UDF_ARGS *) malloc(sizeof(UDF_ARGS));
+        args->arg_type = (enum Item_result *) malloc(sizeof(enum Item_result)*3);
+        args->lengths = (long unsigned int *) malloc(sizeof(long unsigned int)*3);
+        args->args = (char **) malloc(sizeof(char *)*3);
+        char *message = (char *) malloc(sizeof(char)*MYSQL_ERRMSG_SIZE);
+        char *result = (char *) malloc(sizeof(char)*256);
+        unsigned long length = 0;
+        char *error = (char *) malloc(sizeof(char));
+        char *is_null = (char *) malloc(sizeof(char));
+
+        args->arg_type[0] = STRING_RESULT;
+        args->arg_type[1] = STRING_RESULT;
+        args->arg_type[2] = INT_RESULT;
+        args->arg_count = 3;
+        args->args[0] = "Levenshtein";
+        args->lengths[0] = strlen("Levenshtein");
+        args->args[1] = NULL;
+        args->lengths[1] = 255;
+        args->args[2] = (char *) &k;
+        is_null[0] = '\0';
+        error[0] = '\0';
+
+        my_bool ret = levenshtein_argmin_init(init, args, message);
+        mu_assert("Error, levenshtein_argmin_test => levenshtein_argmin_init - expected 0", ret == 0);
+
+        levenshtein_argmin_clear(init, is_null, error);
+        for (i = 0; i < 6; i++) {
+            args->args[1] = group1[i];
+            args->lengths[1] = (group1[i] == NULL) ? 0 : strlen(group1[i]);
+            levenshtein_argmin_add(init, args, is_null, error);
+
+            //"Levenshtain" is the first at distance 1, "Lovenshtein" ties with it
+            if (i == 2) {
+                char *best = levenshtein_argmin(init, args, result, &length, is_null, error);
+                mu_assert("Error, levenshtein_argmin_test => levenshtein_argmin - expected Levenshtain",
+                          is_null[0] == '\0' && length == 11 && strncmp(best, "Levenshtain", length) == 0);
+            }
+        }
+        char *best = levenshtein_argmin(init, args, result, &length, is_null, error);
+        mu_assert("Error, levenshtein_argmin_test => levenshtein_argmin - expected Levenshtein",
+                  is_null[0] == '\0' && length == 11 && strncmp(best, "Levenshtein", length) == 0);
+
+        levenshtein_argmin_clear(init, is_null, error);
+        for (i = 0; i < 2; i++) {
+            args->args[1] = group2[i];
+            args->lengths[1] = strlen(group2[i]);
+            levenshtein_argmin_add(init, args, is_null, error);
+        }
+        levenshtein_argmin(init, args, result, &length, is_null, error);
+        mu_assert("Error, levenshtein_argmin_test => levenshtein_argmin - expected null", is_null[0] == 1);
+
+        //reset is clear and add of the first row of a group
+        is_null[0] = '\0';
+        args->args[1] = "Lewenstein";
+        args->lengths[1] = strlen("Lewenstein");
+        levenshtein_argmin_reset(init, args, is_null, error);
+        best = levenshtein_argmin(init, args, result, &length, is_null, error);
+        mu_assert("Error, levenshtein_argmin_test => levenshtein_argmin - expected Lewenstein",
+                  is_null[0] == '\0' && length == 10 && strncmp(best, "Lewenstein", length) == 0);
+
+        levenshtein_argmin_deinit(init);
+
+        free(args->args);
+        free(args->arg_type);
+        free(args->lengths);
+        free(result);
+        free(message);
+        free(error);
+        free(is_null);
+        free(args);
+        free(init);
+    }
+
+    return 0;
+}
+
+static char * levenshtein_topn_test() {
+    if(lib_handle != NULL) {
+        printf("Testing => %s\n", __FUNCTION__);
+
+        //"Lovenshtein" ties with "Levenshtain", which came first
+        char *values[6] = {"Levenhstein", "Levenshtain", "Lovenshtein", "Hamming", NULL, "Levenshtein"};
+        char *expected = "[[\"Levenshtein\", 0], [\"Levenshtain\", 1]]";
+        int top = 2, k = 3;
+        int i;
+
+        my_bool (*levenshtein_topn_init)() = dlsym(lib_handle, "levenshtein_topn_init");
+        void (*levenshtein_topn_clear)() = dlsym(lib_handle, "levenshtein_topn_clear");
+        void (*levenshtein_topn_add)() = dlsym(lib_handle, "levenshtein_topn_add");
+        char *(*levenshtein_topn)() = dlsym(lib_handle, "levenshtein_topn");
+        void(*levenshtein_topn_deinit)() = dlsym(lib_handle, "levenshtein_topn_deinit");
+
+        UDF_INIT *init = (UDF_INIT *) malloc(sizeof(UDF_INIT));
+        UDF_ARGS *args = (UDF_ARGS *) malloc(sizeof(UDF_ARGS));
+        args->arg_type = (enum Item_result *) malloc(sizeof(enum Item_result)*4);
+        args->lengths = (long unsigned int *) malloc(sizeof(long unsigned int)*4);
+        args->args = (char **) malloc(sizeof(char *)*4);
+        char *message = (char *) malloc(sizeof(char)*MYSQL_ERRMSG_SIZE);
+        char *result = (char *) malloc(sizeof(char)*256);
+        unsigned long length = 0;
+        char *error = (char *) malloc(sizeof(char));
+        char *is_null = (char *) malloc(sizeof(char));
+
+        args->arg_type[0] = STRING_RESULT;
+        args->arg_type[1] = STRING_RESULT;
+        args->arg_type[2] = INT_RESULT;
+        args->arg_type[3] = INT_RESULT;
+        args->arg_count = 4;
+        args->args[0] = "Levenshtein";
+        args->lengths[0] = strlen("Levenshtein");
+        args->args[1] = NULL;
+        args->lengths[1] = 255;
+        args->args[2] = (char *) &top;
+        args->args[3] = (char *) &k;
+        is_null[0] = '\0';
+        error[0] = '\0';
+
+        my_bool ret = levenshtein_topn_init(init, args, message);
+        mu_assert("Error, levenshtein_topn_test => levenshtein_topn_init - expected 0", ret == 0);
+
+        levenshtein_topn_clear(init, is_null, error);
+        for (i = 0; i < 6; i++) {
+            args->args[1] = values[i];
+            args->lengths[1] = (values[i] == NULL) ? 0 : strlen(values[i]);
+            levenshtein_topn_add(init, args, is_null, error);
+        }
+        char *top_values = levenshtein_topn(init, args, result, &length, is_null, error);
+        mu_assert("Error, levenshtein_topn_test => levenshtein_topn - unexpected values",
+                  is_null[0] == '\0' && length == strlen(expected) && strncmp(top_values, expected, length) == 0);
+
+        //an empty group
+        levenshtein_topn_clear(init, is_null, error);
+        levenshtein_topn(init, args, result, &length, is_null, error);
+        mu_assert("Error, levenshtein_topn_test => levenshtein_topn - expected null", is_null[0] == 1);
+
+        levenshtein_topn_deinit(init);
+
+        free(args->args);
+        free(args->arg_type);
+        free(args->lengths);
+        free(result);
+        free(message);
+        free(error);
+        free(is_null);
+        free(args);
+        free(init);
+    }
+
+    return 0;
+}
+
+/**
+ * Dictionary directory of the bktree, symspell and trie tests: words.txt in a
+ * new directory, set as SIMILARITIES_DICT_DIR
+ *
+ * @param dir template of mkdtemp, the directory on return
+ * @param path of 64 bytes, words.txt on return
+ * @result 0, 1 if the directory or the file could not be created
+ */
+static int dict_dir_setup(char *dir, char *path, const char *words) {
+    if (mkdtemp(dir) == NULL)
+        return 1;
+    snprintf(path, 64, "%s/words.txt", dir);
+    FILE *f = fopen(path, "w");
+    if (f == NULL)
+        return 1;
+    fputs(words, f);
+    fclose(f);
+    setenv("SIMILARITIES_DICT_DIR", dir, 1);
+
+    return 0;
+}
+
+static void dict_dir_cleanup(const char *dir, const char *path) {
+    remove(path);
+    remove(dir);
+    unsetenv("SIMILARITIES_DICT_DIR");
+}
+
+static char * bktree_test() {
+    if(lib_handle != NULL) {
+        printf("Testing => %s\n", __FUNCTION__);
+
+        //a duplicate, an empty line and a CRLF ending
+        char *words = "Levenshtein\nLevenstein\nDamerau\nLevenshtein\n\nHamming\r\nLewenstein\n";
+        char *expected = "[[\"Levenstein\", 0], [\"Levenshtein\", 1], [\"Lewenstein\", 1]]";
+        char dir[] = "/tmp/similarities_test_XXXXXX";
+        char path[64];
+        int k = 2;
+
+        my_bool (*bktree_load_init)() = dlsym(lib_handle, "bktree_load_init");
+        longlong (*bktree_load)() = dlsym(lib_handle, "bktree_load");
+        void(*bktree_load_deinit)() = dlsym(lib_handle, "bktree_load_deinit");
+        my_bool (*bktree_search_init)() = dlsym(lib_handle, "bktree_search_init");
+        char *(*bktree_search)() = dlsym(lib_handle, "bktree_search");
+        void(*bktree_search_deinit)() = dlsym(lib_handle, "bktree_search_deinit");
+
+        mu_assert("Error, bktree_test => dict_dir_setup - expected the dictionary file", dict_dir_setup(dir, path, words) == 0);
+
+        UDF_INIT *init = (UDF_INIT *) malloc(sizeof(UDF_INIT));
+        UDF_ARGS *args = (UDF_ARGS *) malloc(sizeof(UDF_ARGS));
+        args->arg_type = (enum Item_result *) malloc(sizeof(enum Item_result)*3);
+        args->lengths = (long unsigned int *) malloc(sizeof(long unsigned int)*3);
+        args->args = (char **) malloc(sizeof(char *)*3);
+        char *message = (char *) malloc(sizeof(char)*MYSQL_ERRMSG_SIZE);
+        char *result = (char *) malloc(sizeof(char)*256);
+        unsigned long length = 0;
+        char *error = (char *) malloc(sizeof(char));
+        char *is_null = (char *) malloc(sizeof(char));
+
+        args->arg_type[0] = STRING_RESULT;
+        args->arg_type[1] = STRING_RESULT;
+        args->arg_count = 2;
+        args->args[0] = "names";
+        args->lengths[0] = strlen("names");
+        args->args[1] = "words.txt";
+        args->lengths[1] = strlen("words.txt");
+        is_null[0] = '\0';
+        error[0] = '\0';
+
+        my_bool ret = bktree_load_init(init, args, message);
+        mu_assert("Error, bktree_test => bktree_load_init - expected 0", ret == 0);
+
+        longlong count = bktree_load(init, args, is_null, error);
+        mu_assert("Error, bktree_test => bktree_load - expected 5 distinct words", is_null[0] == '\0' && count == 5);
+
+        //only files of the dictionary directory
+        args->args[1] = "../words.txt";
+        args->lengths[1] = strlen("../words.txt");
+        bktree_load(init, args, is_null, error);
+        mu_assert("Error, bktree_test => bktree_load - expected null outside of the directory", is_null[0] == 1);
+
+        bktree_load_deinit(init);
+
+        args->arg_type[2] = INT_RESULT;
+        args->arg_count = 3;
+        args->args[1] = "Levenstein";
+        args->lengths[1] = strlen("Levenstein");
+        args->args[2] = (char *) &k;
+        is_null[0] = '\0';
+
+        ret = bktree_search_init(init, args, message);
+        mu_assert("Error, bktree_test => bktree_search_init - expected 0", ret == 0);
+
+        char *found = bktree_search(init, args, result, &length, is_null, error);
+        mu_assert("Error, bktree_test => bktree_search - unexpected words",
+                  is_null[0] == '\0' && length == strlen(expected) && strncmp(found, expected, length) == 0);
+
+        args->args[0] = "unknown";
+        args->lengths[0] = strlen("unknown");
+        bktree_search(init, args, result, &length, is_null, error);
+        mu_assert("Error, bktree_test => bktree_search - expected null for a tree not loaded", is_null[0] == 1);
+
+        bktree_search_deinit(init);
+
+        dict_dir_cleanup(dir, path);
+
+        free(args->args);
+        free(args->arg_type);
+        free(args->lengths);
+        free(result);
+        free(message);
+        free(error);
+        free(is_null);
+        free(args);
+        free(init);
+    }
+
+    return 0;
+}
+
+static char * symspell_test() {
+    if(lib_handle != NULL) {
+        printf("Testing => %s\n", __FUNCTION__);
+
+        //misspellings a transposition away, two edits for levenshtein
+        char *words = "receive\nbelieve\nweird\nrecipe\n";
+        char *expected_osa = "[[\"receive\", 1]]";
+        char dir[] = "/tmp/similarities_test_XXXXXX";
+        char path[64], index[64];
+        int k = 1, transpositions = 1;
+
+        my_bool (*symspell_build_init)() = dlsym(lib_handle, "symspell_build_init");
+        longlong (*symspell_build)() = dlsym(lib_handle, "symspell_build");
+        void(*symspell_build_deinit)() = dlsym(lib_handle, "symspell_build_deinit");
+        my_bool (*symspell_lookup_init)() = dlsym(lib_handle, "symspell_lookup_init");
+        char *(*symspell_lookup)() = dlsym(lib_handle, "symspell_lookup");
+        void(*symspell_lookup_deinit)() = dlsym(lib_handle, "symspell_lookup_deinit");
+
+        mu_assert("Error, symspell_test => dict_dir_setup - expected the dictionary file", dict_dir_setup(dir, path, words) == 0);
+        snprintf(index, sizeof(index), "%s/words.idx", dir);
+
+        UDF_INIT *init = (UDF_INIT *) malloc(sizeof(UDF_INIT));
+        UDF_ARGS *args = (UDF_ARGS *) malloc(sizeof(UDF_ARGS));
+        args->arg_type = (enum Item_result *) malloc(sizeof(enum Item_result)*4);
+        args->lengths = (long unsigned int *) malloc(sizeof(long unsigned int)*4);
+        args->args = (char **) malloc(sizeof(char *)*4);
+        char *message = (char *) malloc(sizeof(char)*MYSQL_ERRMSG_SIZE);
+        char *result = (char *) malloc(sizeof(char)*256);
+        unsigned long length = 0;
+        char *error = (char *) malloc(sizeof(char));
+        char *is_null = (char *) malloc(sizeof(char));
+
+        args->arg_type[0] = STRING_RESULT;
+        args->arg_type[1] = STRING_RESULT;
+        args->arg_type[2] = INT_RESULT;
+        args->arg_count = 3;
+        args->args[0] = "words.txt";
+        args->lengths[0] = strlen("words.txt");
+        args->args[1] = "words.idx";
+        args->lengths[1] = strlen("words.idx");
+        args->args[2] = (char *) &k;
+        is_null[0] = '\0';
+        error[0] = '\0';
+
+        my_bool ret = symspell_build_init(init, args, message);
+        mu_assert("Error, symspell_test => symspell_build_init - expected 0", ret == 0);
+
+        longlong count = symspell_build(init, args, is_null, error);
+        mu_assert("Error, symspell_test => symspell_build - expected 4 words", is_null[0] == '\0' && count == 4);
+
+        //only files of the dictionary directory
+        args->args[1] = "../words.idx";
+        args->lengths[1] = strlen("../words.idx");
+        symspell_build(init, args, is_null, error);
+        mu_assert("Error, symspell_test => symspell_build - expected null outside of the directory", is_null[0] == 1);
+
+        symspell_build_deinit(init);
+
+        args->args[0] = "words.idx";
+        args->lengths[0] = strlen("words.idx");
+        args->args[1] = "recieve";
+        args->lengths[1] = strlen("recieve");
+        is_null[0] = '\0';
+
+        ret = symspell_lookup_init(init, args, message);
+        mu_assert("Error, symspell_test => symspell_lookup_init - expected 0", ret == 0);
+
+        //the deletes of "recieve" and "receive" meet, but the swap takes two edits
+        symspell_lookup(init, args, result, &length, is_null, error);
+        mu_assert("Error, symspell_test => symspell_lookup - expected null without transpositions", is_null[0] == 1);
+
+        symspell_lookup_deinit(init);
+
+        args->arg_type[3] = INT_RESULT;
+        args->arg_count = 4;
+        args->args[3] = (char *) &transpositions;
+        is_null[0] = '\0';
+
+        ret = symspell_lookup_init(init, args, message);
+        mu_assert("Error, symspell_test => symspell_lookup_init - expected 0 with transpositions", ret == 0);
+
+        char *found = symspell_lookup(init, args, result, &length, is_null, error);
+        mu_assert("Error, symspell_test => symspell_lookup - unexpected words with transpositions",
+                  is_null[0] == '\0' && length == strlen(expected_osa) && strncmp(found, expected_osa, length) == 0);
+
+        //over the k of the index, some words could be missed
+        k = 2;
+        symspell_lookup(init, args, result, &length, is_null, error);
+        mu_assert("Error, symspell_test => symspell_lookup - expected null over the k of the index", is_null[0] == 1);
+
+        symspell_lookup_deinit(init);
+
+        remove(index);
+        dict_dir_cleanup(dir, path);
+
+        free(args->args);
+        free(args->arg_type);
+        free(args->lengths);
+        free(result);
+        free(message);
+        free(error);
+        free(is_null);
+        free(args);
+        free(init);
+    }
+
+    return 0;
+}
+
+static char * trie_test() {
+    if(lib_handle != NULL) {
+        printf("Testing => %s\n", __FUNCTION__);
+
+        //names sharing long prefixes, one a prefix of another, and a duplicate
+        char *words = "International Business Machines\nInternational Business Machine\n"
+                      "International Business Machines Corp\nInternational Paper\nIntel\n"
+                      "International Business Machines\n";
+        char *expected = "[[\"International Business Machine\", 1], [\"International Business Machines\", 1]]";
+        char *expected_osa = "[[\"International Business Machines\", 1]]";
+        char dir[] = "/tmp/similarities_test_XXXXXX";
+        char path[64];
+        int k = 2, transpositions = 1;
+
+        my_bool (*trie_load_init)() = dlsym(lib_handle, "trie_load_init");
+        longlong (*trie_load)() = dlsym(lib_handle, "trie_load");
+        void(*trie_load_deinit)() = dlsym(lib_handle, "trie_load_deinit");
+        my_bool (*trie_search_init)() = dlsym(lib_handle, "trie_search_init");
+        char *(*trie_search)() = dlsym(lib_handle, "trie_search");
+        void(*trie_search_deinit)() = dlsym(lib_handle, "trie_search_deinit");
+
+        mu_assert("Error, trie_test => dict_dir_setup - expected the dictionary file", dict_dir_setup(dir, path, words) == 0);
+
+        UDF_INIT *init = (UDF_INIT *) malloc(sizeof(UDF_INIT));
+        UDF_ARGS *args = (UDF_ARGS *) malloc(sizeof(UDF_ARGS));
+        args->arg_type = (enum Item_result *) malloc(sizeof(enum Item_result)*4);
+        args->lengths = (long unsigned int *) malloc(sizeof(long unsigned int)*4);
+        args->args = (char **) malloc(sizeof(char *)*4);
+        char *message = (char *) malloc(sizeof(char)*MYSQL_ERRMSG_SIZE);
+        char *result = (char *) malloc(sizeof(char)*256);
+        unsigned long length = 0;
+        char *error = (char *) malloc(sizeof(char));
+        char *is_null = (char *) malloc(sizeof(char));
+
+        args->arg_type[0] = STRING_RESULT;
+        args->arg_type[1] = STRING_RESULT;
+        args->arg_count = 2;
+        args->args[0] = "names";
+        args->lengths[0] = strlen("names");
+        args->args[1] = "words.txt";
+        args->lengths[1] = strlen("words.txt");
+        is_null[0] = '\0';
+        error[0] = '\0';
+
+        my_bool ret = trie_load_init(init, args, message);
+        mu_assert("Error, trie_test => trie_load_init - expected 0", ret == 0);
+
+        longlong count = trie_load(init, args, is_null, error);
+        mu_assert("Error, trie_test => trie_load - expected 5 distinct words", is_null[0] == '\0' && count == 5);
+
+        //only files of the dictionary directory
+        args->args[1] = "../words.txt";
+        args->lengths[1] = strlen("../words.txt");
+        trie_load(init, args, is_null, error);
+        mu_assert("Error, trie_test => trie_load - expected null outside of the directory", is_null[0] == 1);
+
+        trie_load_deinit(init);
+
+        args->arg_type[2] = INT_RESULT;
+        args->arg_count = 3;
+        args->args[1] = "International Business Machins";
+        args->lengths[1] = strlen("International Business Machins");
+        args->args[2] = (char *) &k;
+        is_null[0] = '\0';
+
+        ret = trie_search_init(init, args, message);
+        mu_assert("Error, trie_test => trie_search_init - expected 0", ret == 0);
+
+        char *found = trie_search(init, args, result, &length, is_null, error);
+        mu_assert("Error, trie_test => trie_search - unexpected words",
+                  is_null[0] == '\0' && length == strlen(expected) && strncmp(found, expected, length) == 0);
+
+        trie_search_deinit(init);
+
+        //a transposition away from "International Business Machines", two edits from the others
+        args->arg_type[3] = INT_RESULT;
+        args->arg_count = 4;
+        args->args[1] = "International Business Mahcines";
+        args->lengths[1] = strlen("International Business Mahcines");
+        args->args[3] = (char *) &transpositions;
+        k = 1;
+
+        ret = trie_search_init(init, args, message);
+        mu_assert("Error, trie_test => trie_search_init - expected 0 with transpositions", ret == 0);
+
+        found = trie_search(init, args, result, &length, is_null, error);
+        mu_assert("Error, trie_test => trie_search - unexpected words with transpositions",
+                  is_null[0] == '\0' && length == strlen(expected_osa) && strncmp(found, expected_osa, length) == 0);
+
+        //longer than every word by more than k
+        args->args[1] = "International Business Machines Corporation";
+        args->lengths[1] = strlen("International Business Machines Corporation");
+        trie_search(init, args, result, &length, is_null, error);
+        mu_assert("Error, trie_test => trie_search - expected null for a query longer than the words", is_null[0] == 1);
+
+        args->args[0] = "unknown";
+        args->lengths[0] = strlen("unknown");
+        is_null[0] = '\0';
+        trie_search(init, args, result, &length, is_null, error);
+        mu_assert("Error, trie_test => trie_search - expected null for a trie not loaded", is_null[0] == 1);
+
+        trie_search_deinit(init);
+
+        dict_dir_cleanup(dir, path);
+
+        free(args->args);
+        free(args->arg_type);
+        free(args->lengths);
+        free(result);
+        free(message);
+        free(error);
+        free(is_null);
+        free(args);
+        free(init);
+    }
+
+    return 0;
+}
+
 static char * all_tests() {
     mu_run_test(strip_w_test_1);
     mu_run_test(strip_w_test_2);
     mu_run_test(strip_w_test_3);
+    mu_run_test(normalize_to_test);
     mu_run_test(levenshtein_k_core_test);
+    mu_run_test(levenshtein_k_bp_core_test);
     mu_run_test(levenshtein_test);
+    mu_run_test(levenshtein_long_test);
     mu_run_test(levenshtein_k_test);
+    mu_run_test(levenshtein_const_test);
+    mu_run_test(levenshtein_repeated_test);
     mu_run_test(levenshtein_substring_k_test1);
     mu_run_test(levenshtein_substring_k_test2);
     mu_run_test(levenshtein_substring_ci_k_test);
+    mu_run_test(levenshtein_substring_ci_k_rows_test);
     mu_run_test(levenshtein_ratio_test);
     mu_run_test(levenshtein_k_ratio_test);
+    mu_run_test(levenshtein_best_test);
+    mu_run_test(levenshtein_best_json_test);
+    mu_run_test(levenshtein_argmin_test);
+    mu_run_test(levenshtein_topn_test);
     mu_run_test(damerau_test);
+    mu_run_test(damerau_long_test);
+    mu_run_test(damerau_core_costs_test);
+    mu_run_test(damerau_full_test);
+    mu_run_test(damerau_k_test);
+    mu_run_test(damerau_k_ratio_test);
+    mu_run_test(k_sorted_rows_test);
     mu_run_test(damerau_substring_test1);
     mu_run_test(damerau_substring_test2);
     mu_run_test(damerau_substring_ci_test);
+    mu_run_test(damerau_substring_ci_rows_test);
+    mu_run_test(utf8_test);
+    mu_run_test(collation_test);
+    mu_run_test(similarities_cpu_features_test);
+    mu_run_test(prefilter_test);
+    mu_run_test(signature_test);
+    mu_run_test(partition_test);
+    mu_run_test(bktree_test);
+    mu_run_test(symspell_test);
+    mu_run_test(trie_test);
 
     return 0;
 }
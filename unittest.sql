@@ -22,6 +22,84 @@ select 2 = levenshtein_k('aa', 'bb', 2) union
 select 2 = levenshtein_k('aa', 'bb', 999) union
 select 2 = levenshtein_k('aa', 'bb', 1) union
 select 2 = levenshtein_k('aa', 'bbbb', 1) union
+select 21 = levenshtein_k(repeat('a', 64), repeat('b', 64), 20) union
+select 16 = levenshtein_k(repeat('ab', 32), repeat('aabb', 16), 15) union
+
+
+-- levenshtein_best
+select levenshtein_best('p', 0, 'c', 'p') = '[2, 0]' union
+select levenshtein_best('aa', 1, 'bb', null, 'ab') = '[3, 1]' union
+select levenshtein_best('aa', 0, 'bb') is null union
+select levenshtein_best_json('aa', 1, '["bb", null, "ab"]') = '[3, 1]' union
+
+
+-- damerau_k
+select 0 = damerau_k(null, null, 0) union
+select 0 = damerau_k('', '', 0) union
+select 1 = damerau_k('ab', 'ba', 1) union
+select 2 = damerau_k('abc', 'ca', 1) union
+select 1 = damerau_k('Levenhstein', 'Levenshtein', 2) union
+select 21 = damerau_k(repeat('a', 64), repeat('b', 64), 20) union
+
+
+-- utf8 variants
+select 0 = levenshtein_utf8(null, null) union
+select 1 = levenshtein_utf8('café', 'cafe') union
+select 2 = levenshtein_utf8('ab', 'ñ') union
+select 2 = levenshtein_k_utf8('ñandú', 'nandu', 3) union
+select 2 = levenshtein_k_utf8('ñandú', 'nandu', 1) union
+select 1 = damerau_utf8('añb', 'ñab') union
+
+
+-- collations of the _ci functions
+select 1 = damerau_substring_ci('Jose', 'José') union
+select 0 = damerau_substring_ci('Jose', 'Señor JOSÉ', 'utf8mb4') union
+select 0 = levenshtein_substring_ci_k('muller', 'Herr Müller', 2, 'utf8mb4') union
+select 2 = levenshtein_substring_ci_k('mueller', 'Herr Müller', 2, 'utf8mb4') union
+
+
+-- fingerprints
+select 32 = length(levenshtein_signature('kitten')) union
+select 1 = levenshtein_sig_may_match(levenshtein_signature('kitten'), levenshtein_signature('sitting'), 3) union
+select 0 = levenshtein_sig_may_match(levenshtein_signature('abc'), levenshtein_signature('abcdefgh'), 2) union
+select 0 = levenshtein_sig_may_match(levenshtein_signature('abcd'), levenshtein_signature('acbd'), 1) union
+select 1 = levenshtein_sig_may_match(levenshtein_signature('abcd'), levenshtein_signature('acbd'), 1, 1) union
+select 1 = levenshtein_sig_may_match(null, levenshtein_signature('abc'), 0) union
+
+
+-- levenshtein_argmin
+select 'Levenshtain' = (select levenshtein_argmin('Levenshtein', v, 3) from
+    (select 'Levenhstein' v union all select 'Levenshtain' union all select 'Lovenshtein' union all select 'Hamming') t) union
+select (select levenshtein_argmin('Levenshtein', v, 3) from (select 'Damerau' v union all select 'Hamming') t) is null union
+
+
+-- levenshtein_topn
+select '[["Levenshtein", 0], ["Levenshtain", 1]]' = (select levenshtein_topn('Levenshtein', v, 2, 3) from
+    (select 'Levenhstein' v union all select 'Levenshtain' union all select 'Hamming' union all select 'Levenshtein') t) union
+select (select levenshtein_topn('Levenshtein', v, 2, 3) from (select 'Damerau' v union all select 'Hamming') t) is null union
+
+
+-- bktree
+select bktree_search('not loaded', 'Levenshtein', 1) is null union
+
+
+-- symspell
+select symspell_lookup('not built.idx', 'Levenshtein', 1) is null union
+select symspell_build('../outside.txt', 'outside.idx', 1) is null union
+
+
+-- trie
+select trie_search('not loaded', 'Levenshtein', 1) is null union
+select trie_load('outside', '../outside.txt') is null union
+
+
+-- partition keys
+select '["11:0:Lev","11:1:ensh","11:2:tein"]' = levenshtein_partition_keys('Levenshtein', 2) union
+select '["0:0:"]' = levenshtein_partition_keys(null, 1) union
+select 1 = json_contains(levenshtein_partition_probes('Levenhstein', 2), '"11:2:tein"') union
+select 0 = json_contains(levenshtein_partition_probes('Levenhstein', 2), '"11:1:ensh"') union
+select levenshtein_partition_probes('abc', 1000) is not null union
+select levenshtein_partition_keys('abc', -1) is null union
 
 
 -- levenshtein_ratio